@@ -0,0 +1,139 @@
+#ifndef __AR4BR_ADPARSER_H
+#define __AR4BR_ADPARSER_H
+
+#include <stdint.h>
+#include <string.h>
+
+// AD structure types
+#define AD_TYPE_UUID16_MORE    0x02
+#define AD_TYPE_UUID16_ALL     0x03
+#define AD_TYPE_UUID128_MORE   0x06
+#define AD_TYPE_UUID128_ALL    0x07
+#define AD_TYPE_NAME_SHORT     0x08
+#define AD_TYPE_NAME_COMPLETE  0x09
+#define AD_TYPE_MANUFACTURER   0xFF
+
+// Lower value wins, when advertisement matches multiple vendors
+enum AdvVendor : uint8_t {
+    ADV_VENDOR_ARANET = 0,
+    ADV_VENDOR_MIKROTIK,
+    ADV_VENDOR_AIRVALENT,
+    ADV_VENDOR_NONE
+};
+
+enum AdvMatchKind : uint8_t {
+    ADV_MATCH_COMPANY,  // manufacturer data company id
+    ADV_MATCH_UUID16,   // advertised 16-bit service
+    ADV_MATCH_UUID128,  // advertised 128-bit service (little endian, as sent over air)
+    ADV_MATCH_NAME      // substring of local name
+};
+
+typedef struct {
+    AdvVendor    vendor;
+    AdvMatchKind kind;
+    uint16_t     id;
+    uint8_t      uuid[16];
+    const char*  name;
+} AdvMatch;
+
+// View into advertisement payload
+typedef struct {
+    const uint8_t* data;
+    uint8_t        len;
+} AdSpan;
+
+// Result of single parser pass. Offsets point into payload.
+typedef struct {
+    AdvVendor vendor;
+    uint8_t   mfrOff;
+    uint8_t   mfrLen;
+    uint8_t   nameOff;
+    uint8_t   nameLen;
+} AdvInfo;
+
+inline bool adSpanContains(const uint8_t* data, uint8_t len, const char* str) {
+    size_t n = strlen(str);
+    if (n == 0 || n > len) return false;
+    for (uint8_t i = 0; i + n <= len; i++) {
+        if (data[i] == (uint8_t) str[0] && memcmp(data + i, str, n) == 0) return true;
+    }
+    return false;
+}
+
+/*
+    Walk AD structures once, remember manufacturer data and name location
+    and classify against match table.
+    @return false if payload is malformed
+*/
+template <size_t N>
+bool adClassify(const uint8_t* p, uint8_t len, const AdvMatch (&table)[N], AdvInfo* info) {
+    info->vendor = ADV_VENDOR_NONE;
+    info->mfrOff = info->mfrLen = 0;
+    info->nameOff = info->nameLen = 0;
+
+    uint8_t pos = 0;
+    while (pos < len) {
+        uint8_t flen = p[pos];
+        if (flen == 0) break; // padding
+        if (pos + 1 + flen > len) return false;
+
+        uint8_t type = p[pos + 1];
+        uint8_t off = pos + 2;
+        uint8_t dlen = flen - 1;
+        const uint8_t* d = p + off;
+
+        switch (type) {
+        case AD_TYPE_MANUFACTURER:
+            info->mfrOff = off;
+            info->mfrLen = dlen;
+            if (dlen >= 2) {
+                uint16_t company = d[0] | (d[1] << 8);
+                for (size_t i = 0; i < N; i++) {
+                    if (table[i].kind == ADV_MATCH_COMPANY && table[i].id == company && table[i].vendor < info->vendor) {
+                        info->vendor = table[i].vendor;
+                    }
+                }
+            }
+            break;
+        case AD_TYPE_NAME_SHORT:
+        case AD_TYPE_NAME_COMPLETE:
+            info->nameOff = off;
+            info->nameLen = dlen;
+            for (size_t i = 0; i < N; i++) {
+                if (table[i].kind == ADV_MATCH_NAME && table[i].vendor < info->vendor && adSpanContains(d, dlen, table[i].name)) {
+                    info->vendor = table[i].vendor;
+                }
+            }
+            break;
+        case AD_TYPE_UUID16_MORE:
+        case AD_TYPE_UUID16_ALL:
+            for (uint8_t k = 0; k + 2 <= dlen; k += 2) {
+                uint16_t uuid = d[k] | (d[k + 1] << 8);
+                for (size_t i = 0; i < N; i++) {
+                    if (table[i].kind == ADV_MATCH_UUID16 && table[i].id == uuid && table[i].vendor < info->vendor) {
+                        info->vendor = table[i].vendor;
+                    }
+                }
+            }
+            break;
+        case AD_TYPE_UUID128_MORE:
+        case AD_TYPE_UUID128_ALL:
+            for (uint8_t k = 0; k + 16 <= dlen; k += 16) {
+                for (size_t i = 0; i < N; i++) {
+                    if (table[i].kind == ADV_MATCH_UUID128 && table[i].vendor < info->vendor && memcmp(d + k, table[i].uuid, 16) == 0) {
+                        info->vendor = table[i].vendor;
+                    }
+                }
+            }
+            break;
+        default:
+            break;
+        }
+
+        pos += 1 + flen;
+    }
+
+    return true;
+}
+
+#endif
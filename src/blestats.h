@@ -0,0 +1,141 @@
+#ifndef __AR4BR_BLESTATS_H
+#define __AR4BR_BLESTATS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+
+/*
+    Per device timing of BLE operations, so stale sensors can be told apart:
+    slow connect, failing encryption, slow GATT reads or history transfers.
+    Fixed table in RAM, counters are totals since boot, max since last report.
+    Slot is held while device is saved, so jobs finishing after device is
+    removed do not take it again. Updated by GATT workers and loop task,
+    reported by loop task.
+*/
+
+enum BleOp : uint8_t {
+    BLE_OP_CONNECT, // connect, includes encryption of paired devices
+    BLE_OP_SECURE,  // secureConnection() while pairing
+    BLE_OP_READ,    // current readings over GATT
+    BLE_OP_HISTORY, // one history chunk
+    BLE_OP_COUNT
+};
+
+static const char* bleOpNames[BLE_OP_COUNT] = { "connect", "secure", "read", "history" };
+
+// upper bounds of histogram buckets in ms, last bucket is open
+#define BLESTAT_BUCKETS 7
+static const uint16_t bleStatBounds[BLESTAT_BUCKETS - 1] = { 100, 250, 500, 1000, 2500, 5000 };
+
+typedef struct {
+    uint32_t count;
+    uint32_t totalMs;
+    uint32_t maxMs;
+    uint16_t failures;
+    uint16_t lastError; // ar4_err_t or airv_err_t of last failure
+    uint16_t buckets[BLESTAT_BUCKETS];
+} BleOpStats;
+
+typedef struct {
+    uint64_t key; // device MAC key, 0 - free slot
+    BleOpStats ops[BLE_OP_COUNT];
+    uint32_t historyRecords;
+    uint32_t historyMs;
+} BleDeviceStats;
+
+BleDeviceStats bleStats[CFG_BLESTATS_SLOTS];
+portMUX_TYPE bleStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+    Find slot, must be called with bleStatsMux held
+    @return nullptr if device has no slot
+*/
+BleDeviceStats* bleStatsSlot(uint64_t key) {
+    for (BleDeviceStats &s : bleStats) {
+        if (s.key == key) return &s;
+    }
+    return nullptr;
+}
+
+/*
+    Allocate slot for saved device
+    @return false if table is full
+*/
+bool bleStatsAdd(uint64_t key) {
+    portENTER_CRITICAL(&bleStatsMux);
+    BleDeviceStats* s = bleStatsSlot(key);
+    if (!s) {
+        s = bleStatsSlot(0);
+        if (s) {
+            memset(s, 0, sizeof(BleDeviceStats));
+            s->key = key;
+        }
+    }
+    portEXIT_CRITICAL(&bleStatsMux);
+    return s != nullptr;
+}
+
+/*
+    Free slot of removed device
+*/
+void bleStatsRemove(uint64_t key) {
+    portENTER_CRITICAL(&bleStatsMux);
+    BleDeviceStats* s = bleStatsSlot(key);
+    if (s) memset(s, 0, sizeof(BleDeviceStats));
+    portEXIT_CRITICAL(&bleStatsMux);
+}
+
+/*
+    Record one operation
+    @param err 0 on success
+*/
+void bleStatRecord(uint64_t key, BleOp op, uint32_t ms, uint16_t err) {
+    uint8_t b = 0;
+    while (b < BLESTAT_BUCKETS - 1 && ms >= bleStatBounds[b]) b++;
+
+    portENTER_CRITICAL(&bleStatsMux);
+    BleDeviceStats* s = bleStatsSlot(key);
+    if (s) {
+        BleOpStats* o = &s->ops[op];
+        o->count++;
+        o->totalMs += ms;
+        if (ms > o->maxMs) o->maxMs = ms;
+        o->buckets[b]++;
+        if (err) {
+            o->failures++;
+            o->lastError = err;
+        }
+    }
+    portEXIT_CRITICAL(&bleStatsMux);
+}
+
+/*
+    Records received in whole history download
+*/
+void bleStatHistory(uint64_t key, uint32_t records, uint32_t ms) {
+    portENTER_CRITICAL(&bleStatsMux);
+    BleDeviceStats* s = bleStatsSlot(key);
+    if (s) {
+        s->historyRecords += records;
+        s->historyMs += ms;
+    }
+    portEXIT_CRITICAL(&bleStatsMux);
+}
+
+/*
+    Copy stats of device for report and restart max values
+    @return false if device has no stats
+*/
+bool bleStatsTake(uint64_t key, BleDeviceStats* out) {
+    portENTER_CRITICAL(&bleStatsMux);
+    BleDeviceStats* s = bleStatsSlot(key);
+    if (s) {
+        *out = *s;
+        for (BleOpStats &o : s->ops) o.maxMs = 0;
+    }
+    portEXIT_CRITICAL(&bleStatsMux);
+    return s != nullptr;
+}
+
+#endif
@@ -20,7 +20,7 @@ class MyAranet4Callbacks: public Aranet4Callbacks {
 
         Serial.println("PIN Requested. Waiting for web or timeout");
         long timeout = millis() + 30000;
-        while (pin == -1 && timeout > millis())
+        while (pin == (uint32_t) -1 && timeout > millis())
             vTaskDelay(500 / portTICK_PERIOD_MS);
 
         uint32_t ret = pin;
@@ -30,7 +30,7 @@ class MyAranet4Callbacks: public Aranet4Callbacks {
     }
 public:
     bool providePin(uint32_t newpin) {
-        if (pin == -1) {
+        if (pin == (uint32_t) -1) {
             pin = newpin;
             return true;
         }
@@ -0,0 +1,148 @@
+#ifndef __AR4BR_CAPTURE_H
+#define __AR4BR_CAPTURE_H
+
+#include "config.h"
+
+/*
+    Advertisement capture. Every scan result, including ignored vendors, is
+    appended to RAM buffer from NimBLE host task, before classification.
+    Capture is started by POST /capture_start and stops when buffer is full
+    or when GET /capture downloads it. Raw payload holds manufacturer data,
+    service UUIDs and name, adparser.h classifies it on host the same way.
+
+    File format, little endian:
+      header  "AR4C", u8 version, u8 addr size, u16 reserved, u32 millis at start,
+              u32 records, u32 advertisements lost after buffer filled
+      record  u32 ms since start, u8 addr[6] (native order), u8 addr type,
+              i8 rssi, u8 payload length, payload
+    With CFG_CAPTURE 0 capture compiles out.
+*/
+
+#if CFG_CAPTURE
+
+#include <memory>
+
+#define CAPTURE_VERSION     1
+#define CAPTURE_HEADER_SIZE 20
+#define CAPTURE_RECORD_SIZE 13 // without payload
+
+uint8_t captureBuf[CFG_CAPTURE_BUFFER];
+uint32_t captureLen = 0;
+uint32_t captureRecords = 0;
+uint32_t captureLost = 0;
+uint32_t captureStartedAt = 0;
+bool captureOn = false;
+bool captureReading = false; // download in progress, buffer must not change
+portMUX_TYPE captureMux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+    Append scan result, called by scan callback
+*/
+inline void captureAdv(const uint8_t* addr, uint8_t addrType, int8_t rssi, const uint8_t* payload, uint8_t len, uint32_t now) {
+    if (!captureOn) return;
+
+    portENTER_CRITICAL(&captureMux);
+    if (captureOn) {
+        if (captureLen + CAPTURE_RECORD_SIZE + len > CFG_CAPTURE_BUFFER) {
+            captureLost++;
+        } else {
+            uint8_t* p = captureBuf + captureLen;
+            uint32_t ts = now - captureStartedAt;
+            memcpy(p, &ts, 4);
+            memcpy(p + 4, addr, 6);
+            p[10] = addrType;
+            p[11] = (uint8_t) rssi;
+            p[12] = len;
+            memcpy(p + CAPTURE_RECORD_SIZE, payload, len);
+            captureLen += CAPTURE_RECORD_SIZE + len;
+            captureRecords++;
+        }
+    }
+    portEXIT_CRITICAL(&captureMux);
+}
+
+/*
+    Clear buffer and start new capture
+    @return false if previous capture is being downloaded
+*/
+bool captureStart() {
+    bool ok = false;
+    portENTER_CRITICAL(&captureMux);
+    if (!captureReading) {
+        captureLen = captureRecords = captureLost = 0;
+        captureStartedAt = millis();
+        captureOn = true;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&captureMux);
+    return ok;
+}
+
+/*
+    Stops capture and streams buffer, header first
+*/
+class CaptureWriter {
+    uint8_t header[CAPTURE_HEADER_SIZE];
+    uint32_t len = 0;
+    bool owner = false;
+
+public:
+    /*
+        @return false if other download is in progress
+    */
+    bool begin() {
+        portENTER_CRITICAL(&captureMux);
+        if (!captureReading) {
+            captureReading = true;
+            captureOn = false;
+            owner = true;
+        }
+        len = captureLen;
+        uint32_t records = captureRecords;
+        uint32_t lost = captureLost;
+        portEXIT_CRITICAL(&captureMux);
+        if (!owner) return false;
+
+        memcpy(header, "AR4C", 4);
+        header[4] = CAPTURE_VERSION;
+        header[5] = 6;
+        header[6] = header[7] = 0;
+        memcpy(header + 8, &captureStartedAt, 4);
+        memcpy(header + 12, &records, 4);
+        memcpy(header + 16, &lost, 4);
+        return true;
+    }
+
+    ~CaptureWriter() {
+        if (owner) captureReading = false;
+    }
+
+    size_t size() {
+        return CAPTURE_HEADER_SIZE + len;
+    }
+
+    size_t read(uint8_t* buf, size_t maxLen, size_t index) {
+        size_t n = 0;
+        if (index < CAPTURE_HEADER_SIZE) {
+            n = min(maxLen, CAPTURE_HEADER_SIZE - index);
+            memcpy(buf, header + index, n);
+            index += n;
+        }
+        if (n < maxLen && index < size()) {
+            size_t m = min(maxLen - n, size() - index);
+            memcpy(buf + n, captureBuf + index - CAPTURE_HEADER_SIZE, m);
+            n += m;
+        }
+        return n;
+    }
+};
+
+#define CAPTURE_ADV(addr, addrType, rssi, payload, len, now) captureAdv(addr, addrType, rssi, payload, len, now)
+
+#else
+
+#define CAPTURE_ADV(addr, addrType, rssi, payload, len, now) do {} while (0)
+
+#endif
+
+#endif
@@ -12,13 +12,74 @@
 
 #define CFG_BT_SCAN_DURATION    5 // seconds
 #define CFG_BT_CONNECT_TIMEOUT  5 // seconds
+// GATT clients working in parallel. NimBLE allows 3 connections by default
+// (CONFIG_BT_NIMBLE_MAX_CONNECTIONS), one is left for pairing.
+// Can be set in build flags together with NimBLE connection limit
+#ifndef CFG_GATT_POOL_SIZE
+#define CFG_GATT_POOL_SIZE      2
+#endif
 #define CFG_BT_TIMEOUT_DELAY   15 // seconds
 
+#define CFG_BT_SCAN_CONTINUOUS  1 // scan without stopping, process advertisements as they arrive
+#define CFG_BT_SCAN_STALL_TIMEOUT 60 // seconds without advertisements until scan is considered failed
+
+// continuous mode only: scan around expected readings, radio is idle otherwise
+#define CFG_BT_SCAN_SCHEDULED   1
+#define CFG_SCHED_LEAD          2  // seconds, scan starts before expected reading
+#define CFG_SCHED_WINDOW       15  // seconds to wait for reading after deadline
+#define CFG_SCHED_DISCOVERY_INTERVAL 60 // seconds between scans for new devices
+#define CFG_SCHED_DISCOVERY_SCAN      5 // seconds
+
+// scan parameters, 0.625 ms units. Window is tuned from missed measurements
+#define CFG_SCAN_INTERVAL      97
+#define CFG_SCAN_WINDOW        37 // initial
+#define CFG_SCAN_WINDOW_MIN    16
+#define CFG_SCAN_WINDOW_STEP    8
+#define CFG_SCAN_TUNE_PERIOD   60 // seconds
+#define CFG_SCAN_MISS_HIGH    5.0 // % of measurements, grow window above
+#define CFG_SCAN_MISS_LOW     1.0 // % of measurements, shrink window below
+#define CFG_SCAN_MISS_GAP      10 // longer gaps are not counted as misses
+#define CFG_SCAN_WIFI_BUSY_BYTES 32768 // uploaded per tune period
+
+#define CFG_BLESTATS_SLOTS     16   // devices with BLE operation stats
+
+// event tracer, /trace endpoint. Off: instrumentation is compiled out
+#define CFG_TRACE              0
+#define CFG_TRACE_EVENTS     512  // ring size, 16 bytes each
+#define CFG_BLESTATS_LINE_SIZE 1024
+
+// advertisement capture, /capture endpoint. Off: compiled out
+#ifndef CFG_CAPTURE
+#define CFG_CAPTURE            0
+#endif
+#define CFG_CAPTURE_BUFFER 32768  // bytes, 13 + payload per advertisement
+
+#define CFG_ADV_RING_SIZE      64 // must be power of two
+#define CFG_ADV_PAYLOAD_MAX_LEN 62 // advertisement + scan response
+
+#define CFG_SAVED_INDEX_SIZE    32 // must be power of two, usable 3/4
+#define CFG_SCANNED_INDEX_SIZE 256 // must be power of two, usable 3/4
+
 #define CFG_DEV_VER 2
 #define CFG_MAX_DEVICES 4
 #define CFG_DEVICE_OFFSET 512 // eeprom byte offset from node cfg
 
 #define CFG_HISTORY_CHUNK_SIZE 120
+#define CFG_HISTORY_PIPELINED  1 // upload chunk on core 0, while next chunk is received
+#define CFG_HISTORY_PROXY_TIMEOUT 30000 // ms, /sensor_history job dropped when chunk is not taken
+
+#if CFG_HISTORY_PIPELINED
+#define CFG_HISTORY_BUFFERS 2
+#else
+#define CFG_HISTORY_BUFFERS 1
+#endif
+
+#define CFG_CURSOR_NAMESPACE     "histCursor"
+#define CFG_CURSOR_SAVE_INTERVAL 15 // minutes
+
+// Stored time series, one file per device in SPIFFS. ~95 readings per block
+#define CFG_TS_BLOCK_SIZE 512
+#define CFG_TS_BLOCKS     64 // 32 KB per device, ~4 days of 1 minute readings
 
 #define CFG_NTP_SYNC_INTERVAL 60 // (minutes)
 
@@ -34,7 +95,26 @@ const char *password = "Ar@net4Br1dge";
 // influxdb
 #define WRITE_BUFFER_SIZE 120
 #define MAX_BATCH_SIZE 60
-#define WRITE_PRECISION WritePrecision::S
+#define CFG_INFLUX_BUFFER_SIZE 12288 // encoded lines waiting for upload
+#define CFG_INFLUX_BATCH_BYTES 8192  // max batch body, also gzip output buffer
+#define CFG_INFLUX_HTTP_TIMEOUT 10000
+#define CFG_INFLUX_RETRY_INTERVAL 5000
+#define CFG_INFLUX_RETRY_MAX   300000
+#define CFG_INFLUX_LINE_SIZE 256 // encode buffer for one line
+#define CFG_INFLUX_LOG_SIZE  512
+#define CFG_INFLUX_TAGS_SIZE 128 // pre-escaped device and name tags
+#define CFG_INFLUX_TAG_SLOTS 8
+
+// influxdb store and forward queue (raw flash partition)
+#define CFG_QUEUE_PARTITION_LABEL   "ifxq"
+#define CFG_QUEUE_PARTITION_SUBTYPE 0x40
+#define CFG_QUEUE_REPLAY_BATCH      MAX_BATCH_SIZE
+#define CFG_QUEUE_REPLAY_BATCHES    10 // max batches per replay pass
+
+// BLE side -> egress task measurement rings
+#define CFG_EGRESS_RING_SIZE     64   // per producer, power of two
+#define CFG_EGRESS_HISTORY_WAIT  5000 // max wait for free slot, history records only
+#define CFG_EGRESS_IDLE_WAIT     1000 // egress task wakes up at least this often
 
 enum ILog {
     NONE = 0,
@@ -46,11 +126,19 @@ enum ILog {
 
 // mqtt
 #define CFG_DEF_MQTT_PORT 1883
+#define CFG_MQTT_TOPIC_PREFIX "aranet4bridge/sensor/"
+#define CFG_MQTT_TOPIC_SIZE 48
+#define CFG_MQTT_QUEUE_LEN 16          // messages waiting for MQTT task
+#define CFG_MQTT_CONNECT_TIMEOUT 3000
+#define CFG_MQTT_RETRY_INTERVAL 2000   // first reconnect delay, doubled on failure
+#define CFG_MQTT_RETRY_MAX 120000
 
 // Keystore keys
 #define PREF_K_SYS_NAME       "sys_name"
 
 #define PREF_K_SCAN_REBOOT    "scan_reboot"
+#define PREF_K_SCAN_INTERVAL  "scan_interval"
+#define PREF_K_SCAN_WINDOW    "scan_window"
 
 #define PREF_K_LOGIN_USER     "sys_user"
 #define PREF_K_LOGIN_PASSWORD "sys_password"
@@ -79,11 +167,13 @@ enum ILog {
 #define PREF_K_INFLUX_BUCKET  "influx_bucket"
 #define PREF_K_INFLUX_DBVER   "influx_dbver"
 #define PREF_K_INFLUX_LOG     "influx_log"
+#define PREF_K_INFLUX_GZIP    "influx_gzip"
 
 #define PREF_K_MQTT_SERVER    "mqtt_server_ip"
 #define PREF_K_MQTT_PORT      "mqtt_port"
 #define PREF_K_MQTT_USER      "mqtt_user"
 #define PREF_K_MQTT_PASSWORD  "mqtt_password"
+#define PREF_K_MQTT_JSON      "mqtt_json"
 
 #define PREF_K_CFG_INIT       "cfg_init"
 
@@ -0,0 +1,90 @@
+#ifndef __AR4BR_CURSOR_H
+#define __AR4BR_CURSOR_H
+
+#include <vector>
+#include <Preferences.h>
+#include "config.h"
+#include "types.h"
+#include "settings.h"
+
+/*
+    History cursor: last uploaded measurement of each sensor, kept in NVS,
+    so after reboot only missing records are downloaded.
+    Cursors are updated in RAM and written in batches to limit flash wear.
+*/
+
+void cursorKey(AranetDevice* d, char* key) {
+    const uint8_t* mac = d->addr.getNative();
+    sprintf(key, "%02x%02x%02x%02x%02x%02x", mac[5], mac[4], mac[3], mac[2], mac[1], mac[0]);
+}
+
+void cursorUpdate(AranetDevice* d, uint32_t timestamp, uint16_t index = 0) {
+    if (timestamp <= d->cursor.timestamp) return;
+    d->cursor.timestamp = timestamp;
+    if (index) d->cursor.index = index;
+    d->cursorDirty = true;
+}
+
+/*
+    Load cursors for all devices
+*/
+void cursorLoad(std::vector<AranetDevice*> &devices) {
+    Preferences cp;
+    if (!cp.begin(CFG_CURSOR_NAMESPACE, true)) return;
+
+    char key[13];
+    for (AranetDevice* d : devices) {
+        cursorKey(d, key);
+        nvsAccesses++;
+        if (cp.getBytes(key, &d->cursor, sizeof(HistoryCursor)) != sizeof(HistoryCursor)) {
+            d->cursor.timestamp = 0;
+            d->cursor.index = 0;
+        }
+        d->cursorDirty = false;
+    }
+    cp.end();
+}
+
+/*
+    Write changed cursors in single batch
+    @return number of written cursors
+*/
+int cursorSave(std::vector<AranetDevice*> &devices) {
+    int count = 0;
+    for (AranetDevice* d : devices) {
+        if (d->cursorDirty) count++;
+    }
+    if (count == 0) return 0;
+
+    Preferences cp;
+    if (!cp.begin(CFG_CURSOR_NAMESPACE)) return 0;
+
+    char key[13];
+    count = 0;
+    for (AranetDevice* d : devices) {
+        if (!d->cursorDirty) continue;
+        cursorKey(d, key);
+        nvsAccesses++;
+        if (cp.putBytes(key, &d->cursor, sizeof(HistoryCursor)) == sizeof(HistoryCursor)) {
+            d->cursorDirty = false;
+            count++;
+        }
+    }
+    cp.end();
+
+    return count;
+}
+
+/*
+    Number of records measured after cursor and before latest measurement.
+    Record at cursor is uploaded already, latest is sent as current reading.
+    @param latest unix time of latest measurement
+*/
+int cursorMissingRecords(AranetDevice* d, uint32_t latest) {
+    if (d->cursor.timestamp == 0 || d->data.interval == 0) return 0;
+    if (latest <= d->cursor.timestamp) return 0;
+    int records = (latest - d->cursor.timestamp) / d->data.interval;
+    return records > 0 ? records - 1 : 0;
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef __AR4BR_GATTPOOL_H
+#define __AR4BR_GATTPOOL_H
+
+#include <atomic>
+#include "config.h"
+#include "types.h"
+#include "bt.h"
+#include "Aranet4.h"
+#include "include/airvalent.h"
+
+/*
+    Pool of GATT clients, each with own worker task, so slow sensors do
+    not delay others. NimBLE can establish only one connection at a time,
+    so connects are serialized with gattConnectMutex, reads and history
+    downloads run in parallel.
+*/
+
+enum GattJobKind : uint8_t {
+    GATT_JOB_ARANET,
+    GATT_JOB_AIRVALENT,
+    GATT_JOB_HISTORY_PROXY // serve historyProxy request, holds slot until response is done
+};
+
+typedef struct {
+    GattJobKind kind;
+    AranetDevice* device; // nullptr for history proxy, device is looked up by key
+    NimBLEAddress addr;
+    int8_t rssi;
+    bool current; // read current values
+    bool history; // download pending history first
+} GattJob;
+
+typedef struct {
+    uint8_t id;
+    MyAranet4Callbacks callbacks; // own pairing state, workers never pair
+    Aranet4* ar4;
+    Airvalent* airv;
+    TaskHandle_t task;
+    QueueHandle_t jobs;
+    std::atomic<bool> busy;
+    volatile uint32_t deadline; // millis, 0 - no job running
+
+    // current readings of this slot, one producer per ring
+    EgressRing ring;
+
+    // history chunks, released by upload task when pipelined
+    AranetDataCompact logs[CFG_HISTORY_BUFFERS][CFG_HISTORY_CHUNK_SIZE];
+    SemaphoreHandle_t historyFree;
+
+    uint32_t jobsDone;
+    uint32_t busyMs;
+} GattSlot;
+
+GattSlot gattSlots[CFG_GATT_POOL_SIZE];
+SemaphoreHandle_t gattConnectMutex;
+uint32_t gattNoSlot = 0; // jobs skipped, all slots busy
+
+void gattPoolBegin(TaskFunction_t code) {
+    gattConnectMutex = xSemaphoreCreateMutex();
+
+    for (uint8_t i = 0; i < CFG_GATT_POOL_SIZE; i++) {
+        GattSlot* s = &gattSlots[i];
+        s->id = i;
+        s->callbacks.disablePairing();
+        s->ar4 = new Aranet4(&s->callbacks);
+        s->ar4->setConnectTimeout(CFG_BT_CONNECT_TIMEOUT);
+        s->airv = new Airvalent(&s->callbacks);
+        s->airv->setConnectTimeout(CFG_BT_CONNECT_TIMEOUT);
+        s->jobs = xQueueCreate(1, sizeof(GattJob));
+        s->busy = false;
+        s->deadline = 0;
+        s->historyFree = xSemaphoreCreateCounting(CFG_HISTORY_BUFFERS, CFG_HISTORY_BUFFERS);
+        s->jobsDone = s->busyMs = 0;
+
+        char name[12];
+        snprintf(name, sizeof(name), "GattTask%u", i);
+        xTaskCreatePinnedToCore(code, name, 8192, s, 1, &s->task, 1);
+    }
+}
+
+/*
+    Hand job to free slot, device must not have job running
+    @return false if all slots are busy
+*/
+bool gattDispatch(GattJob* job) {
+    for (GattSlot &s : gattSlots) {
+        if (s.busy) continue;
+
+        s.busy = true;
+        if (job->device) job->device->gattBusy = true;
+        xQueueSend(s.jobs, job, 0);
+        return true;
+    }
+    gattNoSlot++;
+    return false;
+}
+
+uint8_t gattBusySlots() {
+    uint8_t n = 0;
+    for (GattSlot &s : gattSlots) n += s.busy;
+    return n;
+}
+
+/*
+    Per slot watchdog, checked by loop task
+*/
+void gattSlotWatchdog(GattSlot* s, uint32_t seconds) {
+    s->deadline = millis() + seconds * 1000;
+    if (s->deadline == 0) s->deadline = 1;
+}
+
+GattSlot* gattStuckSlot() {
+    for (GattSlot &s : gattSlots) {
+        uint32_t deadline = s.deadline;
+        if (deadline && (int32_t) (millis() - deadline) > 0) return &s;
+    }
+    return nullptr;
+}
+
+void gattConnectLock() {
+    xSemaphoreTake(gattConnectMutex, portMAX_DELAY);
+}
+
+void gattConnectUnlock() {
+    xSemaphoreGive(gattConnectMutex);
+}
+
+/*
+    Connect lock for slot job. Pairing holds lock while PIN is entered, so
+    waiting for it is not counted by slot watchdog, deadline is armed
+    once lock is taken.
+*/
+void gattSlotConnectLock(GattSlot* s, uint32_t seconds) {
+    s->deadline = 0;
+    gattConnectLock();
+    gattSlotWatchdog(s, seconds);
+}
+
+bool gattConnecting() {
+    return xSemaphoreGetMutexHolder(gattConnectMutex) != NULL;
+}
+
+#endif
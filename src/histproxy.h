@@ -0,0 +1,136 @@
+#ifndef __AR4BR_HISTPROXY_H
+#define __AR4BR_HISTPROXY_H
+
+#include <atomic>
+#include <ESPAsyncWebServer.h>
+#include "config.h"
+#include "types.h"
+
+enum ProxyState : uint8_t {
+    PROXY_WAIT,  // GATT worker is reading next chunk
+    PROXY_READY, // chunk can be sent
+    PROXY_DONE
+};
+
+/*
+    History request, passed from HTTP handler to GATT worker by loop task.
+    Worker reads one chunk over BLE, HTTP response formats it and
+    hands buffer back, so memory is bounded by one chunk.
+    Device is kept by MAC key, it may be removed while job runs.
+*/
+class HistoryProxyJob {
+    char line[112];
+    uint8_t lineLen = 0;
+    uint8_t linePos = 0;
+    uint16_t pos = 0;
+    uint16_t sent = 0;
+    bool started = false;
+    bool finished = false;
+
+    void formatRecord(uint16_t i) {
+        AranetDataCompact* log = &logs[i];
+        uint16_t index = chunkStart + i;
+        uint32_t ts = firstTimestamp ? firstTimestamp + (uint32_t) (index - first) * interval : 0;
+
+        AranetData data;
+        data.type = type;
+        if (type == ARANET_RADIATION) {
+            data.radiation_rate = log->aranetr.rad_dose_rate * 10;
+            data.radiation_total = log->aranetr.rad_dose_integral;
+        } else {
+            data.co2 = log->aranet4.co2;
+            data.temperature = log->aranet4.temperature;
+            data.pressure = log->aranet4.pressure;
+            data.humidity = log->aranet4.humidity;
+        }
+
+        const char* fmt = json
+            ? "%s{\"i\":%u,\"t\":%u,\"co2\":%i,\"temperature\":%.1f,\"pressure\":%.1f,\"humidity\":%.1f,\"rad_rate\":%lu,\"rad_total\":%llu}"
+            : "%s%u;%u;%i;%.1f;%.1f;%.1f;%lu;%llu\n";
+
+        lineLen = snprintf(line, sizeof(line), fmt,
+            json && sent > 0 ? "," : "",
+            index,
+            (unsigned) ts,
+            data.getCO2(),
+            data.getTemperature(),
+            data.getPressure(),
+            data.getHumidity(),
+            data.getRadiationRate(),
+            data.getRadiationTotal()
+        );
+        linePos = 0;
+        sent++;
+    }
+
+public:
+    uint64_t key;
+    bool json;
+    bool dispatched = false; // handed to GATT worker, set by loop task
+
+    // requested range, updated by worker
+    uint16_t first;
+    uint16_t next;
+    uint16_t remaining;
+    bool connected = false;
+
+    // current chunk, written by worker
+    AranetDataCompact logs[CFG_HISTORY_CHUNK_SIZE];
+    uint16_t chunkStart = 0;
+    uint16_t chunkCount = 0;
+    AranetType type = AranetType::UNKNOWN;
+    uint32_t firstTimestamp = 0; // of record "first", 0 if not known
+    uint16_t interval = 0;
+    uint32_t readyAt = 0;        // millis() when chunk was handed to response
+    std::atomic<uint8_t> state;
+
+    HistoryProxyJob(uint64_t key, uint16_t start, uint16_t count, bool json)
+        : key(key), json(json), first(start), next(start), remaining(count) {
+        state = PROXY_WAIT;
+    }
+
+    /*
+        Fill response buffer
+        @return bytes written, 0 when done or RESPONSE_TRY_AGAIN while waiting for chunk
+    */
+    size_t read(uint8_t* buf, size_t maxLen) {
+        size_t len = 0;
+        while (len < maxLen) {
+            if (linePos < lineLen) {
+                size_t n = lineLen - linePos;
+                if (n > maxLen - len) n = maxLen - len;
+                memcpy(buf + len, line + linePos, n);
+                len += n;
+                linePos += n;
+                continue;
+            }
+
+            if (!started) {
+                started = true;
+                lineLen = strlcpy(line, json ? "[" : "index;timestamp;co2;temperature;pressure;humidity;rad_rate;rad_total\n", sizeof(line));
+                linePos = 0;
+                continue;
+            }
+
+            uint8_t s = state;
+            if (s == PROXY_READY) {
+                if (pos < chunkCount) {
+                    formatRecord(pos++);
+                } else {
+                    pos = 0;
+                    state = PROXY_WAIT;
+                }
+            } else if (s == PROXY_DONE) {
+                if (finished) break;
+                finished = true;
+                lineLen = strlcpy(line, json ? "]" : "", sizeof(line));
+                linePos = 0;
+            } else {
+                return len > 0 ? len : RESPONSE_TRY_AGAIN;
+            }
+        }
+        return len;
+    }
+};
+
+#endif
@@ -1,4 +1,10 @@
 #ifndef __AR4BR_HTML_H
+#define __AR4BR_HTML_H
+
+#include <functional>
+#include <stdarg.h>
+#include <ESPAsyncWebServer.h>
+#include "settings.h"
 
 const char* htmlHeader =
     "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\">"
@@ -203,108 +209,156 @@ const char* indexScript = R"(
         return Math.round(num * p) / p;
     }
 
-    function updateCards() {
-        fetch("/data")
-            .then(response => response.text())
-            .then((dataStr) => {
+    let rows = {};
+    let uptime = 0;
+    let frameSeq = 0;
 
-            let devices = document.getElementById("devices");
-            devices.innerHTML = ""; // clear old
-
-            let lines = dataStr.split("\n");
-            var nextUpdate = 300;
-            for (let ln of lines) {
-                let pt = ln.split(";");
-                if (pt.length < 12) {
-                    continue;
-                }
-
-                let uid = pt[0];
-                let en = pt[1];
-
-                if (!en.includes("e")) continue;
-
-                let devname = pt[2];
-                let type = pt[4];
-                let co2 = pt[5];
-                let temperature = pt[6];
-                let pressure = pt[7];
-                let humidity = pt[8];
-                let rad_rate = pt[9];
-                let rad_total = pt[10];
-                let rad_duration = pt[11];
-                let batt = pt[12];
-                let interval = pt[13];
-                let age = pt[14];
-                let updat = pt[15];
-
-                let klass = "co2-none";
-
-                let card = document.createElement('div');
-                if (type == 0) {
-                    card.innerHTML = template;
-                    if (co2 == 0) kalss="co2-none";
-                    else if (co2 < 1000) klass="co2-ok";
-                    else if (co2 < 1400) klass="co2-warn";
-                    else klass = "co2-alert";
-                } else if (type == 1) {
-                    card.innerHTML = template2;
-                } else if (type == 2) {
-                    card.innerHTML = template3;
-                    // TODO: fix ranges
-                    if (rad_rate == 0) kalss="co2-none";
-                    else if (rad_rate < 200) klass="co2-ok";
-                    else if (rad_rate < 1000) klass="co2-warn";
-                    else klass = "co2-alert";
-                } else {
-                    card.innerHTML = template;
-                }
-
-                card = card.firstChild;
-
-                var batimg = "";
-
-                if (batt > 90) batimg ="100";
-                else if (batt > 80) batimg ="90";
-                else if (batt > 70) batimg ="80";
-                else if (batt > 60) batimg ="70";
-                else if (batt > 50) batimg ="60";
-                else if (batt > 40) batimg ="50";
-                else if (batt > 30) batimg ="40";
-                else if (batt > 20) batimg ="30";
-                else if (batt > 10) batimg ="20";
-                else batimg = "10";
-                var btimg = "bluetooth";
-                if (updat > (parseInt(interval)*2)) {
-                    btimg = "bluetoothred";
-                    klass = "co2-none";
-                }
-
-                card.getElementsByClassName("cardimg")[0].src = "/img/" + btimg + ".png";
-                card.getElementsByClassName("batt-val")[0].src = "/img/battery_" + batimg + ".png";
-                card.getElementsByClassName("batt-val")[0].title = batt + "%";
-
-                setval(card, "cardtitle", devname);
-                setval(card, "co2-val",   co2);
-                setval(card, "temp-val",  temperature);
-                setval(card, "humi-val",  humidity);
-                setval(card, "pres-val",  pressure);
-
-                setval(card, "radrate-val", rad_rate / 1000.0);
-                setval(card, "radtotal-val", naiveRound(rad_total / 1000000.0, 4));
-                setval(card, "radduration-val",  seconds2duration(rad_duration));
-
-                card.className="card " + klass;
-
-                let u = interval - updat;
-                if (u<nextUpdate)nextUpdate=u;
-
-                devices.appendChild(card);
+    function parseRows(lines) {
+        for (let ln of lines) {
+            let pt = ln.split(";");
+            if (pt.length < 12) continue;
+            rows[pt[0]] = pt;
+        }
+    }
+
+    // returns seconds until next expected update
+    function renderCards() {
+        let devices = document.getElementById("devices");
+        devices.innerHTML = ""; // clear old
+
+        var nextUpdate = 300;
+        for (let uid in rows) {
+            let pt = rows[uid];
+
+            let en = pt[1];
+
+            if (!en.includes("e")) continue;
+
+            let devname = pt[2];
+            let type = pt[4];
+            let co2 = pt[5];
+            let temperature = pt[6];
+            let pressure = pt[7];
+            let humidity = pt[8];
+            let rad_rate = pt[9];
+            let rad_total = pt[10];
+            let rad_duration = pt[11];
+            let batt = pt[12];
+            let interval = pt[13];
+            let age = pt[14];
+            let updat = Math.floor((uptime - pt[15]) / 1000);
+
+            let klass = "co2-none";
+
+            let card = document.createElement('div');
+            if (type == 0) {
+                card.innerHTML = template;
+                if (co2 == 0) kalss="co2-none";
+                else if (co2 < 1000) klass="co2-ok";
+                else if (co2 < 1400) klass="co2-warn";
+                else klass = "co2-alert";
+            } else if (type == 1) {
+                card.innerHTML = template2;
+            } else if (type == 2) {
+                card.innerHTML = template3;
+                // TODO: fix ranges
+                if (rad_rate == 0) kalss="co2-none";
+                else if (rad_rate < 200) klass="co2-ok";
+                else if (rad_rate < 1000) klass="co2-warn";
+                else klass = "co2-alert";
+            } else {
+                card.innerHTML = template;
             }
+
+            card = card.firstChild;
+
+            var batimg = "";
+
+            if (batt > 90) batimg ="100";
+            else if (batt > 80) batimg ="90";
+            else if (batt > 70) batimg ="80";
+            else if (batt > 60) batimg ="70";
+            else if (batt > 50) batimg ="60";
+            else if (batt > 40) batimg ="50";
+            else if (batt > 30) batimg ="40";
+            else if (batt > 20) batimg ="30";
+            else if (batt > 10) batimg ="20";
+            else batimg = "10";
+            var btimg = "bluetooth";
+            if (updat > (parseInt(interval)*2)) {
+                btimg = "bluetoothred";
+                klass = "co2-none";
+            }
+
+            card.getElementsByClassName("cardimg")[0].src = "/img/" + btimg + ".png";
+            card.getElementsByClassName("batt-val")[0].src = "/img/battery_" + batimg + ".png";
+            card.getElementsByClassName("batt-val")[0].title = batt + "%";
+
+            setval(card, "cardtitle", devname);
+            setval(card, "co2-val",   co2);
+            setval(card, "temp-val",  temperature);
+            setval(card, "humi-val",  humidity);
+            setval(card, "pres-val",  pressure);
+
+            setval(card, "radrate-val", rad_rate / 1000.0);
+            setval(card, "radtotal-val", naiveRound(rad_total / 1000000.0, 4));
+            setval(card, "radduration-val",  seconds2duration(rad_duration));
+
+            card.className="card " + klass;
+
+            let u = interval - updat;
+            if (u<nextUpdate)nextUpdate=u;
+
+            devices.appendChild(card);
+        }
+        return nextUpdate;
+    }
+
+    function loadData() {
+        return fetch("/data")
+            .then((response) => {
+                uptime = parseInt(response.headers.get("X-Uptime"));
+                return response.text();
+            })
+            .then((dataStr) => {
+                rows = {};
+                parseRows(dataStr.split("\n"));
+                return renderCards();
+            });
+    }
+
+    function updateCards() {
+        loadData().then((nextUpdate) => {
             let interval = (nextUpdate)*1000;
             if (interval < 10000) interval = 10000;
             setTimeout(updateCards, interval);
-            });
+        });
+    }
+
+    // changed devices are pushed as "DATA:<seq>;<uptime>" followed by /data lines
+    function liveUpdates() {
+        const socket = new WebSocket("ws://" + location.host + "/ws");
+        socket.onmessage = function(event) {
+            if (!event.data.startsWith("DATA:")) return;
+            let lines = event.data.substring(5).split("\n");
+            let hdr = lines.shift().split(";");
+            let seq = parseInt(hdr[0]);
+            uptime = parseInt(hdr[1]);
+
+            // frame was dropped, reload all
+            let missed = frameSeq && seq != frameSeq + 1;
+            frameSeq = seq;
+            if (missed) {
+                loadData();
+                return;
+            }
+
+            parseRows(lines);
+            renderCards();
+        };
+        socket.onclose = function() {
+            setTimeout(liveUpdates, 5000);
+        };
     }
 
     window.onload = function() {
@@ -321,6 +375,7 @@ const char* indexScript = R"(
                             .then((dataStr3) => {
                                 template3 = dataStr3.trim();
                                 updateCards();
+                                liveUpdates();
                             });
                     });
             });
@@ -337,6 +392,7 @@ const char* wsScript = R"(
     };
 
     socket.onmessage = function(event) {
+        if (event.data.startsWith("DATA:")) return; // live readings, used by home page
         if (event.data == "PAIR_PIN") {
             let pin = prompt("Enter PIN");
             if (pin > 0) {
@@ -371,6 +427,7 @@ const char* wsScript = R"(
 const char* devicesScript = R"(
     <script>
         var failed = 0;
+        var uptime = 0;
         const savedDevices = document.getElementById("saved");
         const newDevices = document.getElementById("new");
 
@@ -381,7 +438,7 @@ const char* devicesScript = R"(
             row.insertCell(0).innerHTML = parts[1];
             row.insertCell(1).innerHTML = parts[2];
             row.insertCell(2).innerHTML = parts[3];
-            row.insertCell(3).innerHTML = parts[4] / 1000 + 's ago';
+            row.insertCell(3).innerHTML = Math.floor((uptime - parts[4]) / 1000) + 's ago';
             row.insertCell(4).innerHTML = `<button onclick="addDevice('${parts[1]}', '${parts[2]}');">Add device</button>`;
         }
 
@@ -395,7 +452,7 @@ const char* devicesScript = R"(
             row.insertCell(0).innerHTML = parts[1]; // address
             row.insertCell(1).innerHTML = nameRow;  // name
             row.insertCell(2).innerHTML = parts[3]; // rssi
-            row.insertCell(3).innerHTML = parts[4] / 1000 + 's ago';
+            row.insertCell(3).innerHTML = Math.floor((uptime - parts[4]) / 1000) + 's ago';
 
 
             let utils = "";
@@ -455,7 +512,10 @@ const char* devicesScript = R"(
 
         function fetchResults() {
             fetch("/devices_list")
-                .then((response) => response.text())
+                .then((response) => {
+                    uptime = parseInt(response.headers.get("X-Uptime"));
+                    return response.text();
+                })
                 .then((dataStr) => {
                     // split new and saved
                     let groups = dataStr.split("#");
@@ -515,82 +575,144 @@ const char* devicesScript = R"(
             </script>
 )";
 
-String printHtmlLabel(const char *name, const char* title) {
-    char tmp[128];
-    sprintf(tmp, "<label for=\"%s\">%s</label>",name,title);
-    return String(tmp);
+/*
+    Writes page to response buffer. Page is rendered again for each chunk,
+    output before requested offset is skipped, so no page sized buffer is needed.
+*/
+class HtmlWriter {
+    uint8_t* buf;
+    size_t maxLen;
+    size_t skip;
+    size_t len = 0;
+
+public:
+    HtmlWriter(uint8_t* buf, size_t maxLen, size_t index) : buf(buf), maxLen(maxLen), skip(index) {}
+
+    void write(const char* s, size_t n) {
+        if (full()) return;
+        if (skip >= n) {
+            skip -= n;
+            return;
+        }
+        s += skip;
+        n -= skip;
+        skip = 0;
+        if (n > maxLen - len) n = maxLen - len;
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+
+    void print(const char* s) {
+        if (!full()) write(s, strlen(s));
+    }
+
+    void print(const String &s) {
+        write(s.c_str(), s.length());
+    }
+
+    void printf(const char* fmt, ...) {
+        if (full()) return;
+        char tmp[256];
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+        va_end(args);
+        if (n > 0) write(tmp, n < (int) sizeof(tmp) ? n : sizeof(tmp) - 1);
+    }
+
+    bool full() {
+        return len >= maxLen;
+    }
+
+    size_t length() {
+        return len;
+    }
+};
+
+typedef std::function<void(HtmlWriter*)> HtmlRenderer;
+
+AsyncWebServerResponse* beginHtmlResponse(AsyncWebServerRequest *request, HtmlRenderer render) {
+    return request->beginChunkedResponse("text/html", [render](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        HtmlWriter w(buffer, maxLen, index);
+        render(&w);
+        return w.length();
+    });
 }
 
-String printHtmlTextInput(const char *name, const char* title, String value, uint8_t maxlen) {
-    char tmp[256];
-    sprintf(tmp, "<br><input type=\"text\" name=\"%s\" maxlength=\"%i\" value=\"%s\"></br>", name, maxlen, value.c_str());
-    return printHtmlLabel(name, title) + String(tmp);
+void printHtmlLabel(HtmlWriter* w, const char *name, const char* title) {
+    w->printf("<label for=\"%s\">%s</label>", name, title);
 }
 
-String printHtmlNumberInput(const char *name, const char* title, uint16_t value, uint32_t max) {
-    char tmp[256];
-    sprintf(tmp, "<br><input type=\"number\" name=\"%s\" max=\"%i\" value=\"%i\"></br>", name, max, value);
-    return printHtmlLabel(name, title) + String(tmp);
+void printHtmlTextInput(HtmlWriter* w, const char *name, const char* title, const char* value, uint8_t maxlen) {
+    printHtmlLabel(w, name, title);
+    w->printf("<br><input type=\"text\" name=\"%s\" maxlength=\"%i\" value=\"%s\"></br>", name, maxlen, value);
 }
 
-String printHtmlCheckboxInput(const char *name, const char* title, uint32_t value) {
-    char tmp[256];
-    sprintf(tmp, "<input type=\"checkbox\" name=\"%s\" %s>", name, value ? "checked" : "");
-    return String(tmp) + printHtmlLabel(name, title) + String("<br>");
+void printHtmlNumberInput(HtmlWriter* w, const char *name, const char* title, uint16_t value, uint32_t max) {
+    printHtmlLabel(w, name, title);
+    w->printf("<br><input type=\"number\" name=\"%s\" max=\"%i\" value=\"%i\"></br>", name, max, value);
 }
 
-String printCard(String title, String body, String cardimg = "", String fn = "", uint8_t color = 0) {
-    String card = "<div ";
+void printHtmlCheckboxInput(HtmlWriter* w, const char *name, const char* title, uint32_t value) {
+    w->printf("<input type=\"checkbox\" name=\"%s\" %s>", name, value ? "checked" : "");
+    printHtmlLabel(w, name, title);
+    w->print("<br>");
+}
 
-    if (fn.length() > 0) {
-        card += "class=\"card clickable\" onclick=\"" + fn + "\">";
+/*
+    Card is written in two parts, body goes in between
+*/
+void printCardBegin(HtmlWriter* w, const char* title, const char* cardimg = "", const char* fn = "", uint8_t color = 0) {
+    if (fn[0]) {
+        w->printf("<div class=\"card clickable\" onclick=\"%s\">", fn);
     } else {
-        card += "class=\"card\">";
+        w->print("<div class=\"card\">");
     }
 
-    String klass = "";
-    if (color == 1) {
-        klass += " en";
+    w->print(color == 1 ? "<div class=\"cardtop en\"></div>" : "<div class=\"cardtop\"></div>");
+    w->print("<div class=\"cardbody\"><div>");
+
+    if (cardimg[0]) {
+        w->printf("<img src=\"%s\" class=\"cardimg\">", cardimg);
     }
 
-    card += "<div class=\"cardtop" + klass+ "\"></div><div class=\"cardbody\"><div>";
+    w->printf("<span class=\"cardtitle\">%s</span></div>", title);
+}
 
-    if (cardimg.length() > 0) {
-        card += "<img src=\"" + cardimg + "\" class=\"cardimg\">";
-    }
+void printCardEnd(HtmlWriter* w) {
+    w->print("</div></div>");
+}
 
-    card += "<span class=\"cardtitle\">" + title + "</span></div>";
-    if (body.length() > 0) {
-        card += "<div class=\"cardmsg\">" + body + "</div>";
+void printCard(HtmlWriter* w, const char* title, const char* body, const char* cardimg = "", const char* fn = "", uint8_t color = 0) {
+    printCardBegin(w, title, cardimg, fn, color);
+    if (body[0]) {
+        w->print("<div class=\"cardmsg\">");
+        w->print(body);
+        w->print("</div>");
     }
-    card += "</div></div>";
-
-    return card;
+    printCardEnd(w);
 }
 
-String printHtmlIndex(std::vector<AranetDevice*> devices) {
-    String page = String(htmlHeader);
-    Serial.print("Task1 running on core ");
-    Serial.println(xPortGetCoreID());
+void printHtmlIndex(HtmlWriter* w) {
+    w->print(htmlHeader);
 
-    page += "<div id=\"devices\"></div>";
+    w->print("<div id=\"devices\"></div>");
 
-    page += "<div class=\"card clickable\" onclick=\"page('devices')\">";
-    page +=   "<div class=\"cardtop\"></div>";
-    page +=   "<div class=\"cardbody\">";
-    page +=     "<img src=\"/img/plus.png\" class=\"cardimg\"> <span class=\"cardimg\">Manage devices</span>";
-    page +=   "</div>";
-    page += "</div>";
+    w->print("<div class=\"card clickable\" onclick=\"page('devices')\">"
+               "<div class=\"cardtop\"></div>"
+               "<div class=\"cardbody\">"
+                 "<img src=\"/img/plus.png\" class=\"cardimg\"> <span class=\"cardimg\">Manage devices</span>"
+               "</div>"
+             "</div>");
 
-    page += String(indexScript);
-    page += String(htmlFooter);
-    return page;
+    w->print(indexScript);
+    w->print(htmlFooter);
 }
 
-String printHtmlConfig(Preferences* prefs, bool updated = false) {
-    String page = String(htmlHeader);
+void printHtmlConfig(HtmlWriter* w, NodeConfig* cfg, bool updated = false) {
+    w->print(htmlHeader);
 
-    page += "<form id=\"cfg\" method=\"post\">";
+    w->print("<form id=\"cfg\" method=\"post\">");
 
     char ipAddr[16];
     char netmask[16];
@@ -599,15 +721,15 @@ String printHtmlConfig(Preferences* prefs, bool updated = false) {
     char mqttIpAddr[16];
     char wgIpAddr[16];
 
-    ip2str(prefs->getUInt(PREF_K_WIFI_IP_ADDR), ipAddr);
-    ip2str(prefs->getUInt(PREF_K_WIFI_IP_MASK), netmask);
-    ip2str(prefs->getUInt(PREF_K_WIFI_IP_GW), gateway);
-    ip2str(prefs->getUInt(PREF_K_WIFI_IP_DNS), dns);
-    ip2str(prefs->getUInt(PREF_K_MQTT_SERVER), mqttIpAddr);
-    ip2str(prefs->getUInt(PREF_K_WG_LOCAL_IP), wgIpAddr);
+    ip2str(cfg->wifiIpAddr, ipAddr);
+    ip2str(cfg->wifiIpMask, netmask);
+    ip2str(cfg->wifiIpGw, gateway);
+    ip2str(cfg->wifiIpDns, dns);
+    ip2str(cfg->mqttServer, mqttIpAddr);
+    ip2str(cfg->wgLocalIp, wgIpAddr);
 
     if (updated) {
-        page += printCard(
+        printCard(w,
         "Configuration updated", "",
         "/img/ok.png",
         "",
@@ -615,79 +737,110 @@ String printHtmlConfig(Preferences* prefs, bool updated = false) {
         );
     }
 
-    page += printCard("System", printHtmlTextInput(PREF_K_SYS_NAME, "Device Name", prefs->getString(PREF_K_SYS_NAME), 32)
-                                + printHtmlTextInput(PREF_K_NTP_URL, "NTP Server", prefs->getString(PREF_K_NTP_URL), 47)
-                                + printHtmlNumberInput(PREF_K_SCAN_REBOOT, "Rebbot after [n] failed scans", prefs->getUShort(PREF_K_SCAN_REBOOT), 0xFFFF));
-
-    page += printCard("Wireless", printHtmlTextInput(PREF_K_WIFI_SSID, "Wi-Fi SSID", prefs->getString(PREF_K_WIFI_SSID), 32)
-                                + printHtmlTextInput(PREF_K_WIFI_PASSWORD, "Wi-Fi Password", prefs->getString(PREF_K_WIFI_PASSWORD), 63)
-                                + printHtmlCheckboxInput(PREF_K_WIFI_IP_STATIC, "Set static IP address", prefs->getBool(PREF_K_WIFI_IP_STATIC))
-                                + "<div id=\"ipcfg\">"
-                                    + printHtmlTextInput(PREF_K_WIFI_IP_ADDR, "IP address", ipAddr, 15)
-                                    + printHtmlTextInput(PREF_K_WIFI_IP_MASK, "Network mask", netmask, 15)
-                                    + printHtmlTextInput(PREF_K_WIFI_IP_GW, "Gateway", gateway, 15)
-                                    + printHtmlTextInput(PREF_K_WIFI_IP_DNS, "DNS", dns, 15)
-                                + "</div>");
-
-    page += printCard("Wireguard", printHtmlCheckboxInput(PREF_K_WG_ENABLED, "Enabled", prefs->getBool(PREF_K_WG_ENABLED))
-                                + printHtmlTextInput(PREF_K_WG_ENDPOINT, "Endpoint", prefs->getString(PREF_K_WG_ENDPOINT), 64)
-                                + printHtmlNumberInput(PREF_K_WG_PORT, "Port", prefs->getUShort(PREF_K_WG_PORT), 0xFFFF)
-                                + printHtmlTextInput(PREF_K_WG_PUB_KEY, "Public key", prefs->getString(PREF_K_WG_PUB_KEY), 45)
-                                + printHtmlTextInput(PREF_K_WG_LOCAL_IP, "Local IP", wgIpAddr, 15)
-                                + printHtmlTextInput(PREF_K_WG_PRIVATE_KEY, "Private key", prefs->getString(PREF_K_WG_PRIVATE_KEY), 45));
-
-    page += printCard("Influx DB", printHtmlTextInput(PREF_K_INFLUX_URL, "Url", prefs->getString(PREF_K_INFLUX_URL), 128)
-                                + printHtmlTextInput(PREF_K_INFLUX_ORG, "Organisation", prefs->getString(PREF_K_INFLUX_ORG), 16)
-                                + printHtmlTextInput(PREF_K_INFLUX_TOKEN, "Token", prefs->getString(PREF_K_INFLUX_TOKEN), 128)
-                                + printHtmlTextInput(PREF_K_INFLUX_BUCKET, "Bucket/Database", prefs->getString(PREF_K_INFLUX_BUCKET), 32)
-                                + printHtmlCheckboxInput(PREF_K_INFLUX_DBVER, "InfluxDB v2", prefs->getUChar(PREF_K_INFLUX_DBVER) == 2)
-                                + printHtmlNumberInput(PREF_K_INFLUX_LOG, "Log level", prefs->getUShort(PREF_K_INFLUX_LOG), 4));
-
-    page += printCard("MQTT Client", printHtmlTextInput(PREF_K_MQTT_SERVER, "Server IP address", mqttIpAddr, 15)
-                                + printHtmlNumberInput(PREF_K_MQTT_PORT, "Port", prefs->getUShort(PREF_K_MQTT_PORT), 65535)
-                                + printHtmlTextInput(PREF_K_MQTT_USER, "User", prefs->getString(PREF_K_MQTT_USER), 128)
-                                + printHtmlTextInput(PREF_K_MQTT_PASSWORD, "Password", prefs->getString(PREF_K_MQTT_PASSWORD), 128));
-
-    page += printCard(
+    // skip formatting, when buffer is already full
+    printCardBegin(w, "System");
+    w->print("<div class=\"cardmsg\">");
+    if (!w->full()) {
+        printHtmlTextInput(w, PREF_K_SYS_NAME, "Device Name", cfg->sysName, 32);
+        printHtmlTextInput(w, PREF_K_NTP_URL, "NTP Server", cfg->ntpUrl, 47);
+        printHtmlNumberInput(w, PREF_K_SCAN_REBOOT, "Rebbot after [n] failed scans", cfg->scanReboot, 0xFFFF);
+        printHtmlNumberInput(w, PREF_K_SCAN_INTERVAL, "Scan interval [0.625 ms] 4-16384, 0 - default", cfg->scanInterval, 0x4000);
+        printHtmlNumberInput(w, PREF_K_SCAN_WINDOW, "Scan window [0.625 ms] up to interval, 0 - adaptive", cfg->scanWindow, 0x4000);
+    }
+    w->print("</div>");
+    printCardEnd(w);
+
+    printCardBegin(w, "Wireless");
+    w->print("<div class=\"cardmsg\">");
+    if (!w->full()) {
+        printHtmlTextInput(w, PREF_K_WIFI_SSID, "Wi-Fi SSID", cfg->wifiSsid, 32);
+        printHtmlTextInput(w, PREF_K_WIFI_PASSWORD, "Wi-Fi Password", cfg->wifiPassword, 63);
+        printHtmlCheckboxInput(w, PREF_K_WIFI_IP_STATIC, "Set static IP address", cfg->wifiIpStatic);
+        w->print("<div id=\"ipcfg\">");
+        printHtmlTextInput(w, PREF_K_WIFI_IP_ADDR, "IP address", ipAddr, 15);
+        printHtmlTextInput(w, PREF_K_WIFI_IP_MASK, "Network mask", netmask, 15);
+        printHtmlTextInput(w, PREF_K_WIFI_IP_GW, "Gateway", gateway, 15);
+        printHtmlTextInput(w, PREF_K_WIFI_IP_DNS, "DNS", dns, 15);
+        w->print("</div>");
+    }
+    w->print("</div>");
+    printCardEnd(w);
+
+    printCardBegin(w, "Wireguard");
+    w->print("<div class=\"cardmsg\">");
+    if (!w->full()) {
+        printHtmlCheckboxInput(w, PREF_K_WG_ENABLED, "Enabled", cfg->wgEnabled);
+        printHtmlTextInput(w, PREF_K_WG_ENDPOINT, "Endpoint", cfg->wgEndpoint, 64);
+        printHtmlNumberInput(w, PREF_K_WG_PORT, "Port", cfg->wgPort, 0xFFFF);
+        printHtmlTextInput(w, PREF_K_WG_PUB_KEY, "Public key", cfg->wgPubKey, 45);
+        printHtmlTextInput(w, PREF_K_WG_LOCAL_IP, "Local IP", wgIpAddr, 15);
+        printHtmlTextInput(w, PREF_K_WG_PRIVATE_KEY, "Private key", cfg->wgPrivateKey, 45);
+    }
+    w->print("</div>");
+    printCardEnd(w);
+
+    printCardBegin(w, "Influx DB");
+    w->print("<div class=\"cardmsg\">");
+    if (!w->full()) {
+        printHtmlTextInput(w, PREF_K_INFLUX_URL, "Url", cfg->influxUrl, 128);
+        printHtmlTextInput(w, PREF_K_INFLUX_ORG, "Organisation", cfg->influxOrg, 16);
+        printHtmlTextInput(w, PREF_K_INFLUX_TOKEN, "Token", cfg->influxToken, 128);
+        printHtmlTextInput(w, PREF_K_INFLUX_BUCKET, "Bucket/Database", cfg->influxBucket, 32);
+        printHtmlCheckboxInput(w, PREF_K_INFLUX_DBVER, "InfluxDB v2", cfg->influxDbVer == 2);
+        printHtmlCheckboxInput(w, PREF_K_INFLUX_GZIP, "Compress uploads (gzip)", cfg->influxGzip);
+        printHtmlNumberInput(w, PREF_K_INFLUX_LOG, "Log level", cfg->influxLog, 4);
+    }
+    w->print("</div>");
+    printCardEnd(w);
+
+    printCardBegin(w, "MQTT Client");
+    w->print("<div class=\"cardmsg\">");
+    if (!w->full()) {
+        printHtmlTextInput(w, PREF_K_MQTT_SERVER, "Server IP address", mqttIpAddr, 15);
+        printHtmlNumberInput(w, PREF_K_MQTT_PORT, "Port", cfg->mqttPort, 65535);
+        printHtmlTextInput(w, PREF_K_MQTT_USER, "User", cfg->mqttUser, 128);
+        printHtmlTextInput(w, PREF_K_MQTT_PASSWORD, "Password", cfg->mqttPassword, 128);
+        printHtmlCheckboxInput(w, PREF_K_MQTT_JSON, "Single JSON state message", cfg->mqttJson);
+    }
+    w->print("</div>");
+    printCardEnd(w);
+
+    printCard(w,
         "Save", "",
         "/img/ok.png",
         "saveConfig()"
     );
 
-    page += printCard(
+    printCard(w,
         "Restart", "",
         "/img/restart.png",
         "page('/restart')"
     );
 
-    page += printCard(
+    printCard(w,
         "Remove bonded devices", "",
         "/img/restart.png",
         "page('/clrbnd')"
     );
 
-    page += String("</form>");
-    page += String(cfgScript);
-    page += String(htmlFooter);
-
-    return page;
+    w->print("</form>");
+    w->print(cfgScript);
+    w->print(htmlFooter);
 }
 
-String printDevicesPage() {
-    String page = String(htmlHeader);
-    page += printCard(
+void printDevicesPage(HtmlWriter* w) {
+    w->print(htmlHeader);
+    printCard(w,
         "Saved devices",
         savedDevicesHtml
     );
-        page += printCard(
+    printCard(w,
         "Discovered devices",
         newDevicesHtml
     );
-    page += String(wsScript);
-    page += String(devicesScript);
-    page += String(htmlFooter);
-
-    return page;
+    w->print(wsScript);
+    w->print(devicesScript);
+    w->print(htmlFooter);
 }
 
 #endif
@@ -0,0 +1,371 @@
+#ifndef __AR4BR_FLASHQUEUE_H
+#define __AR4BR_FLASHQUEUE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "../measurement.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#else
+#include <stdio.h>
+#endif
+
+#define FQ_SECTOR_SIZE    4096
+#define FQ_SECTOR_MAGIC   0x51584649 // "IFXQ"
+#define FQ_REC_VALID      0xA5
+#define FQ_REC_CONSUMED   0x05       // valid with bits cleared, no erase needed
+#define FQ_REC_EMPTY      0xFF
+#define FQ_NO_SECTOR      0xFFFF
+
+/*
+    Raw flash access. Implemented on top of partition on device,
+    or by file for host tests.
+*/
+class QueueStorage {
+public:
+    virtual ~QueueStorage() {}
+    virtual bool read(uint32_t offset, void* data, size_t len) = 0;
+    virtual bool write(uint32_t offset, const void* data, size_t len) = 0;
+    virtual bool erase(uint32_t offset) = 0; // one sector
+    virtual uint32_t size() = 0;
+};
+
+#ifdef ESP_PLATFORM
+class PartitionStorage: public QueueStorage {
+    const esp_partition_t* part = nullptr;
+public:
+    bool begin(const char* label) {
+        part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t) CFG_QUEUE_PARTITION_SUBTYPE, label);
+        return part != nullptr;
+    }
+
+    bool read(uint32_t offset, void* data, size_t len) {
+        return esp_partition_read(part, offset, data, len) == ESP_OK;
+    }
+
+    bool write(uint32_t offset, const void* data, size_t len) {
+        return esp_partition_write(part, offset, data, len) == ESP_OK;
+    }
+
+    bool erase(uint32_t offset) {
+        return esp_partition_erase_range(part, offset, FQ_SECTOR_SIZE) == ESP_OK;
+    }
+
+    uint32_t size() {
+        return part ? part->size : 0;
+    }
+};
+#else
+/*
+    Flash emulated in file. Like NOR flash, erase sets bytes to 0xFF
+    and write can only clear bits.
+*/
+class FileStorage: public QueueStorage {
+    FILE* file = nullptr;
+    uint32_t bytes = 0;
+public:
+    ~FileStorage() {
+        if (file) fclose(file);
+    }
+
+    /*
+        Open existing file, or create erased one when size differs
+    */
+    bool begin(const char* path, uint32_t size) {
+        bytes = size;
+        file = fopen(path, "r+b");
+        if (file && fseek(file, 0, SEEK_END) == 0 && (uint32_t) ftell(file) == size) return true;
+        if (file) fclose(file);
+
+        file = fopen(path, "w+b");
+        if (!file) return false;
+        for (uint32_t offset = 0; offset < size; offset += FQ_SECTOR_SIZE) {
+            if (!erase(offset)) return false;
+        }
+        return true;
+    }
+
+    bool read(uint32_t offset, void* data, size_t len) {
+        if (!file || offset + len > bytes) return false;
+        return fseek(file, offset, SEEK_SET) == 0 && fread(data, 1, len, file) == len;
+    }
+
+    bool write(uint32_t offset, const void* data, size_t len) {
+        const uint8_t* src = (const uint8_t*) data;
+        uint8_t cur[64];
+        while (len > 0) {
+            size_t n = len < sizeof(cur) ? len : sizeof(cur);
+            if (!read(offset, cur, n)) return false;
+            for (size_t i = 0; i < n; i++) cur[i] &= src[i];
+            if (fseek(file, offset, SEEK_SET) != 0 || fwrite(cur, 1, n, file) != n) return false;
+            offset += n;
+            src += n;
+            len -= n;
+        }
+        return fflush(file) == 0;
+    }
+
+    bool erase(uint32_t offset) {
+        uint8_t ff[FQ_SECTOR_SIZE];
+        if (!file || offset % FQ_SECTOR_SIZE || offset + FQ_SECTOR_SIZE > bytes) return false;
+        memset(ff, 0xFF, sizeof(ff));
+        return fseek(file, offset, SEEK_SET) == 0 && fwrite(ff, 1, sizeof(ff), file) == sizeof(ff) && fflush(file) == 0;
+    }
+
+    uint32_t size() {
+        return bytes;
+    }
+};
+#endif
+
+/*
+    Append-only queue of Measurement records in sectors of raw flash.
+    Each sector starts with header (magic + sequence number), followed by records.
+    Consumed position is marked by clearing bits of last consumed record magic,
+    sector is erased, when all its records are consumed.
+    When flash is full, oldest sector is dropped and its records counted as lost.
+*/
+class FlashQueue {
+    typedef struct {
+        uint32_t magic;
+        uint32_t seq;
+    } SectorHeader;
+
+    static const uint16_t perSector = (FQ_SECTOR_SIZE - sizeof(SectorHeader)) / sizeof(Measurement);
+
+    QueueStorage* storage = nullptr;
+    uint16_t sectors = 0;
+
+    uint16_t head = FQ_NO_SECTOR; // oldest sector
+    uint16_t readIdx = 0;
+    uint16_t tail = FQ_NO_SECTOR; // sector being written
+    uint16_t writeIdx = 0;
+    uint16_t nextFree = 0;        // first sector to use, when queue is empty
+    uint32_t seq = 0;
+
+    uint32_t recordOffset(uint16_t sector, uint16_t idx) {
+        return sector * FQ_SECTOR_SIZE + sizeof(SectorHeader) + idx * sizeof(Measurement);
+    }
+
+    static uint8_t crc8(const uint8_t* data, size_t len) {
+        uint8_t crc = 0;
+        while (len--) {
+            crc ^= *data++;
+            for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+        return crc;
+    }
+
+    static uint8_t recordCrc(Measurement* m) {
+        uint8_t saved = m->crc;
+        uint8_t magic = m->magic;
+        m->crc = 0;
+        m->magic = 0;
+        uint8_t crc = crc8((uint8_t*) m, sizeof(Measurement));
+        m->crc = saved;
+        m->magic = magic;
+        return crc;
+    }
+
+    bool readHeader(uint16_t sector, SectorHeader* hdr) {
+        return storage->read(sector * FQ_SECTOR_SIZE, hdr, sizeof(SectorHeader)) && hdr->magic == FQ_SECTOR_MAGIC;
+    }
+
+    uint8_t readMagic(uint16_t sector, uint16_t idx) {
+        uint8_t magic = FQ_REC_EMPTY;
+        storage->read(recordOffset(sector, idx), &magic, 1);
+        return magic;
+    }
+
+    void reset() {
+        head = tail = FQ_NO_SECTOR;
+        readIdx = writeIdx = 0;
+    }
+
+    // drop fully consumed head sector
+    void releaseHead() {
+        storage->erase(head * FQ_SECTOR_SIZE);
+        if (head == tail) {
+            nextFree = (tail + 1) % sectors;
+            reset();
+        } else {
+            head = (head + 1) % sectors;
+            readIdx = 0;
+        }
+    }
+
+    bool openSector(uint16_t sector) {
+        SectorHeader hdr = { FQ_SECTOR_MAGIC, ++seq };
+        if (!storage->erase(sector * FQ_SECTOR_SIZE)) return false;
+        if (!storage->write(sector * FQ_SECTOR_SIZE, &hdr, sizeof(hdr))) return false;
+        tail = sector;
+        writeIdx = 0;
+        if (head == FQ_NO_SECTOR) {
+            head = sector;
+            readIdx = 0;
+        }
+        return true;
+    }
+
+public:
+    uint32_t stored = 0;   // records written
+    uint32_t replayed = 0; // records consumed
+    uint32_t dropped = 0;  // records lost to overflow
+    uint32_t corrupt = 0;  // records skipped because of bad crc
+
+    /*
+        Recover queue state from storage
+        @return false if storage can not be used
+    */
+    bool begin(QueueStorage* s) {
+        storage = s;
+        sectors = storage->size() / FQ_SECTOR_SIZE;
+        reset();
+        if (sectors < 2) return false;
+
+        // find oldest and newest sector by sequence number
+        uint32_t minSeq = 0xFFFFFFFF;
+        uint32_t maxSeq = 0;
+        SectorHeader hdr;
+        for (uint16_t i = 0; i < sectors; i++) {
+            if (!readHeader(i, &hdr)) continue;
+            if (hdr.seq < minSeq) {
+                minSeq = hdr.seq;
+                head = i;
+            }
+            if (hdr.seq >= maxSeq) {
+                maxSeq = hdr.seq;
+                tail = i;
+            }
+        }
+
+        if (head == FQ_NO_SECTOR) return true; // empty
+        seq = maxSeq;
+
+        while (writeIdx < perSector && readMagic(tail, writeIdx) != FQ_REC_EMPTY) writeIdx++;
+
+        // continue after last record marked as consumed
+        readIdx = 0;
+        for (uint16_t i = 0; i < perSector; i++) {
+            uint8_t magic = readMagic(head, i);
+            if (magic == FQ_REC_EMPTY) break;
+            if (magic == FQ_REC_CONSUMED) readIdx = i + 1;
+        }
+
+        if (readIdx >= (head == tail ? writeIdx : perSector)) {
+            releaseHead();
+        }
+
+        return true;
+    }
+
+    bool push(Measurement* m) {
+        if (!storage || sectors < 2) return false;
+
+        if (tail == FQ_NO_SECTOR) {
+            if (!openSector(nextFree)) return false;
+        } else if (writeIdx >= perSector) {
+            uint16_t next = (tail + 1) % sectors;
+            if (next == head) {
+                // full, drop oldest sector
+                dropped += perSector - readIdx;
+                head = (head + 1) % sectors;
+                readIdx = 0;
+            }
+            if (!openSector(next)) return false;
+        }
+
+        m->magic = FQ_REC_VALID;
+        m->crc = recordCrc(m);
+        if (!storage->write(recordOffset(tail, writeIdx), m, sizeof(Measurement))) return false;
+
+        writeIdx++;
+        stored++;
+        return true;
+    }
+
+    /*
+        Read oldest records without removing them
+        @return number of records read
+    */
+    uint16_t peek(Measurement* buf, uint16_t max) {
+        uint16_t count = 0;
+        uint16_t sector = head;
+        uint16_t idx = readIdx;
+
+        while (sector != FQ_NO_SECTOR && count < max) {
+            uint16_t end = sector == tail ? writeIdx : perSector;
+            if (idx >= end) {
+                if (sector == tail) break;
+                sector = (sector + 1) % sectors;
+                idx = 0;
+                continue;
+            }
+            storage->read(recordOffset(sector, idx), &buf[count], sizeof(Measurement));
+            idx++;
+            count++;
+        }
+
+        return count;
+    }
+
+    /*
+        Remove records returned by peek()
+    */
+    void consume(uint16_t count) {
+        uint16_t lastSector = FQ_NO_SECTOR;
+        uint16_t lastIdx = 0;
+
+        while (count > 0 && head != FQ_NO_SECTOR) {
+            uint16_t end = head == tail ? writeIdx : perSector;
+            uint16_t n = end - readIdx;
+            if (n > count) n = count;
+
+            readIdx += n;
+            count -= n;
+            replayed += n;
+            lastSector = head;
+            lastIdx = readIdx - 1;
+
+            if (readIdx >= end) {
+                releaseHead();
+                lastSector = FQ_NO_SECTOR;
+            }
+        }
+
+        // remember position in partially consumed sector
+        if (lastSector != FQ_NO_SECTOR) {
+            uint8_t magic = FQ_REC_CONSUMED;
+            storage->write(recordOffset(lastSector, lastIdx), &magic, 1);
+        }
+    }
+
+    bool validate(Measurement* m) {
+        if ((m->magic == FQ_REC_VALID || m->magic == FQ_REC_CONSUMED) && m->crc == recordCrc(m)) return true;
+        corrupt++;
+        return false;
+    }
+
+    uint32_t depth() {
+        if (head == FQ_NO_SECTOR) return 0;
+        uint32_t count = 0;
+        for (uint16_t s = head;; s = (s + 1) % sectors) {
+            uint16_t start = s == head ? readIdx : 0;
+            uint16_t end = s == tail ? writeIdx : perSector;
+            count += end - start;
+            if (s == tail) break;
+        }
+        return count;
+    }
+
+    bool empty() {
+        return head == FQ_NO_SECTOR;
+    }
+
+    uint32_t capacity() {
+        return (uint32_t) (sectors - 1) * perSector;
+    }
+};
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef __AR4BR_GZIP_H
+#define __AR4BR_GZIP_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+    Small gzip encoder for upload bodies.
+    LZ77 with single probe hash over the input buffer itself and fixed
+    Huffman codes, so only the hash table is needed besides in/out buffers.
+    Input must be smaller than 64 KiB.
+*/
+
+#ifndef GZIP_HASH_BITS
+#define GZIP_HASH_BITS 10
+#endif
+#ifndef GZIP_WINDOW
+#define GZIP_WINDOW 4096 // max match distance
+#endif
+
+#define GZIP_HASH_SIZE  (1 << GZIP_HASH_BITS)
+#define GZIP_MIN_MATCH  3
+#define GZIP_MAX_MATCH  258
+#define GZIP_OVERHEAD   18 // header and trailer
+
+static const uint16_t gzLenBase[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t gzLenExtra[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t gzDistBase[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t gzDistExtra[] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+inline uint32_t gzipCrc32(uint32_t crc, const uint8_t* data, size_t len) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 15];
+        crc = (crc >> 4) ^ table[crc & 15];
+    }
+    return ~crc;
+}
+
+class GzipBitWriter {
+    uint8_t* dst;
+    size_t size;
+    uint32_t bits = 0;
+    uint8_t count = 0;
+
+public:
+    size_t len = 0;
+    bool overflow = false;
+
+    GzipBitWriter(uint8_t* dst, size_t size, size_t start) : dst(dst), size(size), len(start) {}
+
+    // value bits are written LSB first
+    void put(uint32_t value, uint8_t n) {
+        bits |= value << count;
+        count += n;
+        while (count >= 8) {
+            if (len < size) dst[len++] = bits;
+            else overflow = true;
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    // Huffman codes are written MSB first
+    void code(uint32_t value, uint8_t n) {
+        uint32_t rev = 0;
+        for (uint8_t i = 0; i < n; i++) {
+            rev = (rev << 1) | (value & 1);
+            value >>= 1;
+        }
+        put(rev, n);
+    }
+
+    void align() {
+        if (count) put(0, 8 - count);
+    }
+};
+
+inline void gzipLiteral(GzipBitWriter* bw, uint16_t v) {
+    if (v < 144)      bw->code(0x30 + v, 8);
+    else if (v < 256) bw->code(0x190 + v - 144, 9);
+    else if (v < 280) bw->code(v - 256, 7);
+    else              bw->code(0xC0 + v - 280, 8);
+}
+
+inline void gzipMatch(GzipBitWriter* bw, uint16_t len, uint16_t dist) {
+    uint8_t i = 28;
+    while (gzLenBase[i] > len) i--;
+    gzipLiteral(bw, 257 + i);
+    if (gzLenExtra[i]) bw->put(len - gzLenBase[i], gzLenExtra[i]);
+
+    i = 29;
+    while (gzDistBase[i] > dist) i--;
+    bw->code(i, 5);
+    if (gzDistExtra[i]) bw->put(dist - gzDistBase[i], gzDistExtra[i]);
+}
+
+inline uint32_t gzipHash(const uint8_t* p) {
+    uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761u) >> (32 - GZIP_HASH_BITS);
+}
+
+/*
+    Compress buffer to gzip member
+    @param head hash table, GZIP_HASH_SIZE entries, reused between calls
+    @return compressed length, 0 if it did not fit in dst
+*/
+inline size_t gzipCompress(const uint8_t* src, size_t len, uint8_t* dst, size_t size, uint16_t* head) {
+    static const uint8_t header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+    if (size < GZIP_OVERHEAD || len > 0xFFFF) return 0;
+
+    memcpy(dst, header, sizeof(header));
+    GzipBitWriter bw(dst, size - 8, sizeof(header));
+    bw.put(1, 1); // last block
+    bw.put(1, 2); // fixed Huffman
+
+    // 0xFFFF marks empty slot, positions are below 64 KiB
+    memset(head, 0xFF, GZIP_HASH_SIZE * sizeof(uint16_t));
+
+    size_t pos = 0;
+    while (pos < len && !bw.overflow) {
+        uint16_t best = 0;
+        size_t dist = 0;
+
+        if (pos + GZIP_MIN_MATCH <= len) {
+            uint32_t h = gzipHash(src + pos);
+            uint16_t cand = head[h];
+            head[h] = pos;
+
+            if (cand != 0xFFFF && pos - cand <= GZIP_WINDOW) {
+                size_t max = len - pos;
+                if (max > GZIP_MAX_MATCH) max = GZIP_MAX_MATCH;
+                while (best < max && src[cand + best] == src[pos + best]) best++;
+                dist = pos - cand;
+            }
+        }
+
+        if (best >= GZIP_MIN_MATCH) {
+            gzipMatch(&bw, best, dist);
+            // index positions inside match, keeps later matches close
+            size_t end = pos + best;
+            for (pos++; pos < end; pos++) {
+                if (pos + GZIP_MIN_MATCH <= len) head[gzipHash(src + pos)] = pos;
+            }
+        } else {
+            gzipLiteral(&bw, src[pos++]);
+        }
+    }
+
+    gzipLiteral(&bw, 256); // end of block
+    bw.align();
+    if (bw.overflow) return 0;
+
+    size_t out = bw.len;
+    uint32_t crc = gzipCrc32(0, src, len);
+    for (uint8_t i = 0; i < 4; i++) dst[out++] = crc >> (8 * i);
+    for (uint8_t i = 0; i < 4; i++) dst[out++] = len >> (8 * i);
+    return out;
+}
+
+#endif
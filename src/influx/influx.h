@@ -1,114 +1,205 @@
 #ifndef __INFLUX_H
 #define __INFLUX_H
 
-#include "../main.h"
+#include <WiFi.h>
 #include "../types.h"
-
-// https://github.com/tobiasschuerg/InfluxDB-Client-for-Arduino
-#include <InfluxDbClient.h>
-#include <InfluxDbCloud.h>
+#include "../settings.h"
+#include "../measurement.h"
+#include "../registry.h"
+#include "../blestats.h"
+#include "flashqueue.h"
+#include "lineproto.h"
+
+#include "writer.h"
 #include "Aranet4.h"
 
 const char ilog_tags[] = {'A', 'E', 'W', 'I', 'D'};
 
-InfluxDBClient* influxCreateClient(Preferences *prefs) {
-  InfluxDBClient* influxClient = nullptr;
-
-  if (prefs->getString(PREF_K_INFLUX_URL).length() < 1 || prefs->getString(PREF_K_INFLUX_BUCKET).length() < 1) {
-      return influxClient;
-  }
-
-  if (prefs->getUChar(PREF_K_INFLUX_DBVER) == 2) {
-    influxClient = new InfluxDBClient(
-        prefs->getString(PREF_K_INFLUX_URL).c_str(),
-        prefs->getString(PREF_K_INFLUX_ORG).c_str(),
-        prefs->getString(PREF_K_INFLUX_BUCKET).c_str(),
-        prefs->getString(PREF_K_INFLUX_TOKEN).c_str(),
-        InfluxDbCloud2CACert
-    );
-  } else {
-    Serial.print("InfluxDB: ");
-    Serial.print(prefs->getString(PREF_K_INFLUX_URL));
-    Serial.print(" -> ");
-    Serial.println(prefs->getString(PREF_K_INFLUX_BUCKET));
-    influxClient = new InfluxDBClient(prefs->getString(PREF_K_INFLUX_URL).c_str(), prefs->getString(PREF_K_INFLUX_BUCKET).c_str());
-  }
-
-  influxClient->setWriteOptions(WriteOptions().batchSize(MAX_BATCH_SIZE).bufferSize(WRITE_BUFFER_SIZE));
-  return influxClient;
+InfluxWriter* influxCreateClient(NodeConfig* cfg) {
+    if (!cfg->influxUrl[0] || !cfg->influxBucket[0]) {
+        return nullptr;
+    }
+
+    Serial.printf("InfluxDB: %s -> %s%s\n", cfg->influxUrl, cfg->influxBucket, cfg->influxGzip ? " (gzip)" : "");
+    return new InfluxWriter(cfg);
 }
 
-Point influxCreateStatusPoint(Preferences *prefs) {
-    Point point("device_status");
-    point.addTag("device", prefs->getString(PREF_K_SYS_NAME));
-    point.addField("rssi", WiFi.RSSI());
-    point.addField("uptime", millis());
-    point.addField("heap_free", ESP.getFreeHeap());
-    point.addField("heap_used", ESP.getHeapSize());
-    return point;
+typedef struct {
+    bool valid;
+    uint64_t key;  // device MAC key, 0 - node tags only
+    char name[24];
+    char tags[CFG_INFLUX_TAGS_SIZE];
+} InfluxTags;
+
+// escaped tags, shared by egress task and status/log writers
+InfluxTags influxTags[CFG_INFLUX_TAG_SLOTS];
+portMUX_TYPE influxTagsMux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+    Drop cached tags, when node name changes
+*/
+void influxTagsReset() {
+    portENTER_CRITICAL(&influxTagsMux);
+    for (InfluxTags &t : influxTags) t.valid = false;
+    portEXIT_CRITICAL(&influxTagsMux);
 }
 
-Point influxCreateAirvalentPoint(Preferences *prefs, AranetDevice* device, AranetData *data) {
-    Point point("airvalent");
-    point.addTag("device", prefs->getString(PREF_K_SYS_NAME));
-    point.addTag("name", device->name);   
-    point.addField("co2", data->co2);
-    point.addField("temperature", data->temperature / 10.0);
-    point.addField("pressure", data->pressure);
-    point.addField("humidity", data->humidity / 10.0);
+/*
+    Start line with cached ",device=<node>[,name=<device>]" tags
+    @param key device MAC key, 0 for node lines
+*/
+void influxBegin(LineWriter* lw, const char* measurement, NodeConfig* cfg, uint64_t key, const char* name) {
+    InfluxTags* t = &influxTags[(uint32_t) (key ^ (key >> 24)) % CFG_INFLUX_TAG_SLOTS];
+    if (!name) name = "";
+
+    portENTER_CRITICAL(&influxTagsMux);
+    if (!t->valid || t->key != key || strcmp(t->name, name) != 0) {
+        size_t len = lpAppendTag(t->tags, sizeof(t->tags), 0, "device", cfg->sysName);
+        if (len && key) len = lpAppendTag(t->tags, sizeof(t->tags), len, "name", name);
+        if (!len) t->tags[0] = 0;
+        strlcpy(t->name, name, sizeof(t->name));
+        t->key = key;
+        t->valid = true;
+    }
+    lw->begin(measurement, t->tags);
+    portEXIT_CRITICAL(&influxTagsMux);
+}
 
-    return point;
+void influxWriteAirvalent(LineWriter* lw, NodeConfig* cfg, uint64_t key, const char* name, AranetData *data) {
+    influxBegin(lw, "airvalent", cfg, key, name);
+    lw->fieldInt("co2", data->co2);
+    lw->fieldFloat("temperature", data->temperature / 10.0);
+    lw->fieldInt("pressure", data->pressure);
+    lw->fieldFloat("humidity", data->humidity / 10.0);
 }
 
-Point influxCreatePoint(Preferences *prefs, AranetDevice* device, AranetData *data) {
-    Point point("aranet");
-    point.addTag("device", prefs->getString(PREF_K_SYS_NAME));
-    point.addTag("name", device->name);
+void influxWriteAranet(LineWriter* lw, NodeConfig* cfg, uint64_t key, const char* name, AranetData *data) {
+    influxBegin(lw, "aranet", cfg, key, name);
 
     if (data->type == AranetType::ARANET_RADIATION) {
         if (data->radiation_duration) {
             // history wont have this
-            point.addField("duration", data->radiation_duration);
+            lw->fieldUInt("duration", (unsigned long) data->radiation_duration);
         }
-        point.addField("radiation", data->radiation_rate / 1000.0);
-        point.addField("radiation_total", data->radiation_total / 1000.0);
+        lw->fieldFloat("radiation", data->radiation_rate / 1000.0);
+        lw->fieldFloat("radiation_total", data->radiation_total / 1000.0);
     } else if (data->type == AranetType::ARANET2) {
-        point.addField("temperature", data->temperature / 20.0);
-        point.addField("humidity", data->humidity / 10.0);
+        lw->fieldFloat("temperature", data->temperature / 20.0);
+        lw->fieldFloat("humidity", data->humidity / 10.0);
     } else if (data->type == AranetType::ARANET4) {
-        point.addField("co2", data->co2);
-        point.addField("temperature", data->temperature / 20.0);
-        point.addField("pressure", data->pressure / 10.0);
-        point.addField("humidity", data->humidity / 1.0);
+        lw->fieldInt("co2", data->co2);
+        lw->fieldFloat("temperature", data->temperature / 20.0);
+        lw->fieldFloat("pressure", data->pressure / 10.0);
+        lw->fieldFloat("humidity", data->humidity / 1.0);
     }
-    point.addField("battery", data->battery);
-    point.addField("interval", data->interval);
-    point.addField("ago", data->ago);
-    return point;
+    lw->fieldInt("battery", data->battery);
+    lw->fieldInt("interval", data->interval);
+    lw->fieldInt("ago", data->ago);
+}
+
+/*
+    MikroTik BT5 tag beacon, tagged with its MAC address
+*/
+void influxWriteTag(LineWriter* lw, NodeConfig* cfg, Measurement* m) {
+    char name[18];
+    snprintf(name, sizeof(name), "%02x:%02x:%02x:%02x:%02x:%02x",
+        m->mac[5], m->mac[4], m->mac[3], m->mac[2], m->mac[1], m->mac[0]);
+
+    influxBegin(lw, "bt5-tag", cfg, macKey(m->mac), name);
+    if (m->tag.temperature != MEAS_NO_TEMPERATURE) {
+        lw->fieldFloat("temperature", m->tag.temperature / 100.0);
+    }
+
+    lw->fieldFloat("accel_x", m->tag.accel[0] / 1000.0);
+    lw->fieldFloat("accel_y", m->tag.accel[1] / 1000.0);
+    lw->fieldFloat("accel_z", m->tag.accel[2] / 1000.0);
+
+    lw->fieldInt("battery", m->battery);
+    lw->fieldInt("flags", m->type);
+    lw->fieldInt("uptime", m->type);
 }
 
-Point influxCreatePointWithTimestamp(Preferences *prefs, AranetDevice* device, AranetData *data, long timestamp) {
-    Point point = influxCreatePoint(prefs, device, data);
-    point.setTime(WRITE_PRECISION);
-    point.setTime(timestamp);
-    return point;
+/*
+    Encode queued measurement as one line
+    @param name device name, not used for MikroTik tags
+*/
+bool influxWriteMeasurement(LineWriter* lw, NodeConfig* cfg, const char* name, Measurement* m) {
+    if (m->kind == MEAS_KIND_MIKROTIK) {
+        influxWriteTag(lw, cfg, m);
+    } else {
+        AranetData data;
+        measurementToData(m, &data);
+
+        if (m->kind == MEAS_KIND_AIRVALENT) {
+            influxWriteAirvalent(lw, cfg, macKey(m->mac), name, &data);
+        } else {
+            influxWriteAranet(lw, cfg, macKey(m->mac), name, &data);
+        }
+    }
+    if (m->rssi) lw->fieldInt("rssi", m->rssi);
+    return lw->end(m->timestamp);
+}
+
+/*
+    Status line, caller adds own fields and ends the line
+*/
+void influxWriteStatus(LineWriter* lw, NodeConfig* cfg) {
+    influxBegin(lw, "device_status", cfg, 0, nullptr);
+    lw->fieldInt("rssi", WiFi.RSSI());
+    lw->fieldUInt("uptime", millis());
+    lw->fieldUInt("heap_free", ESP.getFreeHeap());
+    lw->fieldUInt("heap_used", ESP.getHeapSize());
+}
+
+/*
+    BLE operation stats of one sensor, device_status line tagged with its name
+*/
+bool influxWriteBleStats(LineWriter* lw, NodeConfig* cfg, const char* name, BleDeviceStats* s) {
+    char field[24];
+    influxBegin(lw, "device_status", cfg, s->key, name);
+
+    for (uint8_t i = 0; i < BLE_OP_COUNT; i++) {
+        BleOpStats* o = &s->ops[i];
+        const char* op = bleOpNames[i];
+        if (o->count == 0) continue;
+
+        snprintf(field, sizeof(field), "%s_count", op);
+        lw->fieldUInt(field, o->count);
+        snprintf(field, sizeof(field), "%s_ms", op);
+        lw->fieldUInt(field, o->totalMs);
+        snprintf(field, sizeof(field), "%s_max_ms", op);
+        lw->fieldUInt(field, o->maxMs);
+        snprintf(field, sizeof(field), "%s_fail", op);
+        lw->fieldUInt(field, o->failures);
+        if (o->failures) {
+            snprintf(field, sizeof(field), "%s_err", op);
+            lw->fieldUInt(field, o->lastError);
+        }
+        for (uint8_t b = 0; b < BLESTAT_BUCKETS; b++) {
+            if (b < BLESTAT_BUCKETS - 1) snprintf(field, sizeof(field), "%s_lt%u", op, bleStatBounds[b]);
+            else snprintf(field, sizeof(field), "%s_ge%u", op, bleStatBounds[b - 1]);
+            lw->fieldUInt(field, o->buckets[b]);
+        }
+    }
+    if (s->historyMs) lw->fieldFloat("history_rate", s->historyRecords * 1000.0 / s->historyMs);
+    return lw->end();
 }
 
-bool influxSendPoint(InfluxDBClient *influxClient, Point pt) {
-    if (influxClient != nullptr) {
-        return influxClient->writePoint(pt);
+bool influxSendLine(InfluxWriter *influxClient, LineWriter* lw) {
+    if (influxClient != nullptr && !lw->empty()) {
+        return influxClient->writeRecord(lw->c_str());
     }
     return false;
 }
 
-void influxFlushBuffer(InfluxDBClient *influxClient) {
+void influxFlushBuffer(InfluxWriter *influxClient) {
     if (influxClient != nullptr && !influxClient->isBufferEmpty()) {
         influxClient->flushBuffer();
     }
 }
 
-bool influxSendLog(InfluxDBClient *influxClient, Preferences *prefs, String str, ILog level) {
-    uint16_t lvl = prefs->getUShort(PREF_K_INFLUX_LOG, 0);
+bool influxSendLog(InfluxWriter *influxClient, NodeConfig* cfg, String str, ILog level) {
+    uint16_t lvl = cfg->influxLog;
 
     Serial.printf("%c: ", ilog_tags[(uint16_t) level]);
     Serial.println(str);
@@ -116,15 +207,13 @@ bool influxSendLog(InfluxDBClient *influxClient, Preferences *prefs, String str,
     if (lvl > 0 && lvl >= level) {
         if (str.length() > 0) {
             if (influxClient != nullptr) {
-                Point point("log");
-                point.addTag("device", prefs->getString(PREF_K_SYS_NAME));
-                point.addField("message", str);
-                point.addField("level", (uint16_t) level);
-                point.setTime(WritePrecision::NoTime); // no time
-
-                // bypass timestamp
-                String line = influxClient->pointToLineProtocol(point);
-                return influxClient->writeRecord(line);
+                char buf[CFG_INFLUX_LOG_SIZE];
+                LineWriter lw(buf, sizeof(buf));
+                influxBegin(&lw, "log", cfg, 0, nullptr);
+                lw.fieldStr("message", str.c_str());
+                lw.fieldInt("level", (uint16_t) level);
+                lw.end(); // no time
+                return influxSendLine(influxClient, &lw);
             }
         }
     }
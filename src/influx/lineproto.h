@@ -0,0 +1,164 @@
+#ifndef __AR4BR_LINEPROTO_H
+#define __AR4BR_LINEPROTO_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+    InfluxDB line protocol encoder, writes into caller provided buffer.
+    Output matches Point of InfluxDB client: integers with "i" suffix,
+    floats with 2 decimal places.
+*/
+
+/*
+    Escape measurement name, tag key or tag value
+    @return length of escaped string, 0 if it does not fit
+*/
+inline size_t lpEscape(char* dst, size_t size, const char* src) {
+    size_t len = 0;
+    for (; *src; src++) {
+        bool esc = *src == ',' || *src == ' ' || *src == '=';
+        if (len + esc + 2 > size) return 0;
+        if (esc) dst[len++] = '\\';
+        dst[len++] = *src;
+    }
+    dst[len] = 0;
+    return len;
+}
+
+/*
+    Append ",key=value" with escaped value
+    @return new length, 0 if it does not fit
+*/
+inline size_t lpAppendTag(char* dst, size_t size, size_t len, const char* key, const char* value) {
+    size_t n = strlen(key);
+    if (len + n + 2 >= size) return 0;
+    dst[len++] = ',';
+    memcpy(dst + len, key, n);
+    len += n;
+    dst[len++] = '=';
+    dst[len] = 0;
+    size_t v = lpEscape(dst + len, size - len, value);
+    if (v == 0 && value[0]) return 0;
+    return len + v;
+}
+
+class LineWriter {
+    char* buf;
+    size_t size;
+    size_t len = 0;
+    size_t lineStart = 0;
+    bool hasFields = false;
+    bool overflow = false;
+
+    void append(const char* s, size_t n) {
+        if (overflow || len + n >= size) {
+            overflow = true;
+            return;
+        }
+        memcpy(buf + len, s, n);
+        len += n;
+        buf[len] = 0;
+    }
+
+    void key(const char* k) {
+        append(hasFields ? "," : " ", 1);
+        append(k, strlen(k));
+        append("=", 1);
+        hasFields = true;
+    }
+
+    void number(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+public:
+    LineWriter(char* buf, size_t size) : buf(buf), size(size) {
+        clear();
+    }
+
+    void clear() {
+        len = lineStart = 0;
+        overflow = false;
+        if (size) buf[0] = 0;
+    }
+
+    /*
+        Start new line, lines are separated by newline
+        @param measurement escaped measurement name
+        @param tags pre-escaped tags, each starting with comma
+    */
+    void begin(const char* measurement, const char* tags = "") {
+        lineStart = len;
+        hasFields = false;
+        overflow = false;
+        if (len > 0) append("\n", 1);
+        append(measurement, strlen(measurement));
+        append(tags, strlen(tags));
+    }
+
+    void fieldInt(const char* k, long v) {
+        key(k);
+        number("%lii", v);
+    }
+
+    void fieldUInt(const char* k, unsigned long v) {
+        key(k);
+        number("%lui", v);
+    }
+
+    void fieldFloat(const char* k, double v) {
+        key(k);
+        number("%.2f", v);
+    }
+
+    void fieldStr(const char* k, const char* v) {
+        key(k);
+        append("\"", 1);
+        for (; *v; v++) {
+            if (*v == '"' || *v == '\\') append("\\", 1);
+            append(v, 1);
+        }
+        append("\"", 1);
+    }
+
+    /*
+        Finish line, incomplete line is removed
+        @param timestamp 0 - no timestamp
+        @return false if line did not fit
+    */
+    bool end(uint32_t timestamp = 0) {
+        if (timestamp) number(" %lu", (unsigned long) timestamp);
+
+        if (overflow || !hasFields) {
+            len = lineStart;
+            if (size) buf[len] = 0;
+            return false;
+        }
+        return true;
+    }
+
+    const char* c_str() {
+        return buf;
+    }
+
+    size_t length() {
+        return len;
+    }
+
+    bool empty() {
+        return len == 0;
+    }
+};
+
+inline void LineWriter::number(const char* fmt, ...) {
+    char tmp[24];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+    if (n > 0 && n < (int) sizeof(tmp)) append(tmp, n);
+    else overflow = true;
+}
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef __AR4BR_INFLUX_WRITER_H
+#define __AR4BR_INFLUX_WRITER_H
+
+#include <memory>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include <InfluxDbCloud.h>
+#include "../config.h"
+#include "../settings.h"
+#include "../trace.h"
+#include "gzip.h"
+
+/*
+    Buffers encoded lines and posts them in batches of MAX_BATCH_SIZE,
+    optionally gzip compressed. Failed batch is kept and retried with
+    growing delay, while buffer has space new lines are accepted. Batch
+    rejected by server (4xx other than 408 and 429) is dropped, retry
+    would fail the same way and block the buffer.
+    Buffer lock is not held during upload, so adding lines never waits
+    for network.
+*/
+class InfluxWriter {
+    char buf[CFG_INFLUX_BUFFER_SIZE];
+    uint16_t len = 0;
+    uint16_t lines = 0;
+
+    String url;
+    String auth;
+    bool secure;
+    bool gzip;
+
+    std::unique_ptr<WiFiClient> client; // kept between posts, so connection is reused
+    uint32_t retryAt = 0;
+    uint32_t retryDelay = 0;
+    SemaphoreHandle_t mutex;      // buffer contents
+    SemaphoreHandle_t flushMutex; // one upload at a time
+
+    static uint8_t packed[CFG_INFLUX_BATCH_BYTES];
+    static uint16_t hashTable[GZIP_HASH_SIZE];
+
+    static void urlEncode(String &out, const char* s) {
+        static const char hex[] = "0123456789ABCDEF";
+        for (; *s; s++) {
+            char c = *s;
+            if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+                out += c;
+            } else {
+                out += '%';
+                out += hex[(uint8_t) c >> 4];
+                out += hex[c & 15];
+            }
+        }
+    }
+
+    /*
+        Length of first batch, whole lines only
+    */
+    uint16_t batchLength(uint16_t* count) {
+        uint16_t n = 0;
+        uint16_t end = 0;
+        *count = 0;
+        for (uint16_t i = 0; i < len && n < MAX_BATCH_SIZE; i++) {
+            if (buf[i] != '\n') continue;
+            if (i > CFG_INFLUX_BATCH_BYTES && n > 0) break;
+            end = i;
+            n++;
+        }
+        *count = n;
+        return end;
+    }
+
+    /*
+        @return HTTP status, negative on transport error
+    */
+    int post(const uint8_t* body, size_t size, bool compressed) {
+        TRACE_SCOPE("influx.post");
+        if (!client) {
+            if (secure) {
+                WiFiClientSecure* tls = new WiFiClientSecure();
+                if (auth.length()) tls->setCACert(InfluxDbCloud2CACert);
+                else tls->setInsecure();
+                client.reset(tls);
+            } else {
+                client.reset(new WiFiClient());
+            }
+        }
+
+        HTTPClient http;
+        http.setReuse(true);
+        http.setTimeout(CFG_INFLUX_HTTP_TIMEOUT);
+        if (!http.begin(*client, url)) return HTTPC_ERROR_CONNECTION_REFUSED;
+
+        http.addHeader("Content-Type", "text/plain; charset=utf-8");
+        if (compressed) http.addHeader("Content-Encoding", "gzip");
+        if (auth.length()) http.addHeader("Authorization", auth);
+
+        int code = http.POST((uint8_t*) body, size);
+        http.end();
+
+        if (code != 204) {
+            if (code < 0) client->stop(); // broken connection, next post reconnects
+            Serial.printf("[INFLUX] Write failed: %i\n", code);
+        }
+        return code;
+    }
+
+    // bad line, field type conflict, missing bucket, too large
+    static bool isRejected(int code) {
+        return code >= 400 && code < 500 && code != 408 && code != 429;
+    }
+
+public:
+    // totals since boot, reported in status
+    uint32_t bytesRaw = 0;
+    uint32_t bytesSent = 0;
+    uint32_t batches = 0;
+    uint32_t failures = 0;
+    uint32_t rejected = 0; // lines dropped after 4xx
+
+    InfluxWriter(NodeConfig* cfg) {
+        mutex = xSemaphoreCreateMutex();
+        flushMutex = xSemaphoreCreateMutex();
+        gzip = cfg->influxGzip;
+        secure = strncmp(cfg->influxUrl, "https", 5) == 0;
+
+        url = cfg->influxUrl;
+        if (url.endsWith("/")) url.remove(url.length() - 1);
+
+        if (cfg->influxDbVer == 2) {
+            url += "/api/v2/write?org=";
+            urlEncode(url, cfg->influxOrg);
+            url += "&bucket=";
+            urlEncode(url, cfg->influxBucket);
+            auth = "Token ";
+            auth += cfg->influxToken;
+        } else {
+            url += "/write?db=";
+            urlEncode(url, cfg->influxBucket);
+        }
+        url += "&precision=s";
+    }
+
+    ~InfluxWriter() {
+        vSemaphoreDelete(mutex);
+        vSemaphoreDelete(flushMutex);
+    }
+
+    /*
+        Add one line, sending is left to flushBuffer
+        @return false if there is no space left
+    */
+    bool writeRecord(const char* line) {
+        size_t n = strlen(line);
+        if (n == 0) return false;
+
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        bool ok = len + n + 1 <= sizeof(buf);
+        if (ok) {
+            memcpy(buf + len, line, n);
+            len += n;
+            buf[len++] = '\n';
+            lines++;
+        }
+        xSemaphoreGive(mutex);
+        return ok;
+    }
+
+    /*
+        Send buffered lines, stops at first failed batch
+    */
+    void flushBuffer() {
+        TRACE_SCOPE("influx.flush");
+        xSemaphoreTake(flushMutex, portMAX_DELAY);
+        while (len > 0) {
+            if (isRetryPending()) break;
+
+            // only flush moves data, batch stays in place while lines are added
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            uint16_t count;
+            uint16_t size = batchLength(&count);
+            xSemaphoreGive(mutex);
+
+            int code;
+            TRACE_BEGIN("gzip");
+            size_t compressed = gzip
+                ? gzipCompress((uint8_t*) buf, size, packed, sizeof(packed), hashTable)
+                : 0;
+            TRACE_END("gzip");
+
+            if (compressed > 0 && compressed < size) {
+                code = post(packed, compressed, true);
+            } else {
+                compressed = size;
+                code = post((uint8_t*) buf, size, false);
+            }
+
+            if (isRejected(code)) {
+                rejected += count;
+                Serial.printf("[INFLUX] Batch of %u lines rejected: %i, dropped\n", count, code);
+            } else if (code != 204) {
+                failures++;
+                retryDelay = retryDelay ? retryDelay * 2 : CFG_INFLUX_RETRY_INTERVAL;
+                if (retryDelay > CFG_INFLUX_RETRY_MAX) retryDelay = CFG_INFLUX_RETRY_MAX;
+                retryAt = millis() + retryDelay;
+                break;
+            }
+
+            retryDelay = 0;
+            if (code == 204) {
+                batches++;
+                bytesRaw += size;
+                bytesSent += compressed;
+            }
+
+            size++; // newline
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            memmove(buf, buf + size, len - size);
+            len -= size;
+            lines -= count;
+            xSemaphoreGive(mutex);
+        }
+        xSemaphoreGive(flushMutex);
+    }
+
+    bool isBatchFull() {
+        return lines >= MAX_BATCH_SIZE;
+    }
+
+    bool isBufferFull() {
+        return lines >= WRITE_BUFFER_SIZE || (size_t) len + CFG_INFLUX_LINE_SIZE > sizeof(buf);
+    }
+
+    bool isBufferEmpty() {
+        return len == 0;
+    }
+
+    bool isRetryPending() {
+        return retryDelay && (int32_t) (millis() - retryAt) < 0;
+    }
+
+    /*
+        Drop buffered lines, for callers that keep their own copy to retry
+    */
+    void clear() {
+        xSemaphoreTake(flushMutex, portMAX_DELAY);
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        len = 0;
+        lines = 0;
+        xSemaphoreGive(mutex);
+        xSemaphoreGive(flushMutex);
+    }
+};
+
+uint8_t InfluxWriter::packed[CFG_INFLUX_BATCH_BYTES];
+uint16_t InfluxWriter::hashTable[GZIP_HASH_SIZE];
+
+#endif
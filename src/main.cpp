@@ -10,19 +10,31 @@
 
 #include "main.h"
 #include "esp_task_wdt.h"
-#include "MikroTikBT5.h"
 
 const char* defname_aranet = "Aranet";
 const char* defname_airvalent = "Airvalent";
 const char* defname_mikrotik = "TG-BT5";
 
 long nextReport = 0;
-
-int downloadHistory(Aranet4* ar4, AranetDevice* d, int newRecords);
+long lastReport = 0;
+long nextCycle = 0;
+long nextCursorSave = 0;
+uint32_t reportedNvsAccesses = 0;
+
+int downloadHistory(GattSlot* s, AranetDevice* d, int newRecords);
+ar4_err_t gattConnectAranet(GattSlot* s, AranetDevice* d, NimBLEAddress addr);
+void GattTaskCode(void* p);
+int processScanResults();
+void restartAfterFlush();
+void serviceHistoryProxy();
+void gattRunHistoryProxy(GattSlot* s);
+uint16_t historyParams(AranetType type);
 
 void setup() {
     Serial.begin(115200);
     Serial.println("Setup");
+    influxClientMutex = xSemaphoreCreateMutex();
+    settingsMutex = xSemaphoreCreateMutex();
 
     pinMode(MODE_PIN, INPUT_PULLUP);
     pinMode(LED_PIN, OUTPUT); // green LED
@@ -33,6 +45,7 @@ void setup() {
     }
 
     configLoad();
+    newDevices.reserve(CFG_SCANNED_INDEX_SIZE); // never reallocated under devicesMux
     devicesLoad();
 
     isAp = getBootWiFiMode();
@@ -44,6 +57,12 @@ void setup() {
 
     createInfluxClient();
 
+    influxQueueOk = queueStorage.begin(CFG_QUEUE_PARTITION_LABEL) && influxQueue.begin(&queueStorage);
+    if (!influxQueueOk) {
+        log("Influx queue partition not available.", ILog::WARNING);
+    }
+    startEgressTask();
+
     const char* rstReason0 = getResetReason(rtc_get_reset_reason(0));
     const char* rstReason1 = getResetReason(rtc_get_reset_reason(1));
 
@@ -51,14 +70,19 @@ void setup() {
     log(resetMsg, ILog::INFO);
 
     startNtpSyncTask();
+    startMqttTask();
 
     // Set up bluettoth security and callbacks
     Aranet4::init();
     ar4.setConnectTimeout(CFG_BT_CONNECT_TIMEOUT);
+    ar4callbacks.disablePairing(); // enabled only while pairing from web
+    gattPoolBegin(GattTaskCode);
 
     pScan->setActiveScan(false); // active mode may cause `scan_evt timeout`
-    pScan->setInterval(97);
-    pScan->setWindow(37);
+    pScan->setInterval(scanInterval);
+    pScan->setWindow(scanWindow);
+    pScan->setMaxResults(0); // results are delivered through callbacks only
+    pScan->setAdvertisedDeviceCallbacks(&scanCallbacks, CFG_BT_SCAN_CONTINUOUS);
 
     delay(500);
 
@@ -69,35 +93,50 @@ void setup() {
     setupWatchdog();
 
     setupWireguard();
+
+#if CFG_HISTORY_PIPELINED
+    startHistoryUploadTask();
+#endif
+}
+
+/*
+    Store and publish new current reading of device.
+    Called by loop task for beacon readings and by GATT workers.
+    @param ring egress ring owned by calling task
+*/
+void readingDone(AranetDevice* d, EgressRing* ring, uint8_t kind, int8_t rssi) {
+    d->kind = kind;
+    d->updated = millis();
+    markChanged(d, CHANGED_DATA);
+    if (ntpOk) tsAppend(d, &d->data, time(nullptr) - d->data.ago);
+    if (kind == MEAS_KIND_ARANET) schedReadingDone(d->data.ago); // Airvalent has no ago
+
+    if (!sendReading(ring, d, &d->data, kind, rssi)) {
+        Serial.println(" Upload failed.");
+    } else if (kind == MEAS_KIND_ARANET && ntpOk && d->pending == 0) {
+        // Check how many records might have been skipped since last upload (including reboots)
+        uint32_t measuredAt = time(nullptr) - d->data.ago;
+        int missing = cursorMissingRecords(d, measuredAt);
+        if (d->history && missing > 0) {
+            Serial.printf("[HIST] %i records missing since last upload\n", missing);
+            d->pending = missing;
+        } else {
+            cursorUpdate(d, measuredAt);
+        }
+    }
+    mqttQueueReading(d, &d->data);
 }
 
-bool processAranet(AranetDevice* d, NimBLEAdvertisedDevice* adv, uint8_t* cManufacturerData, int cLength) {
+bool processAranet(AranetDevice* d, AdvRecord* adv, uint8_t* cManufacturerData, int cLength) {
+    // worker owns device data until its job is done
+    if (d->gattBusy) return false;
+
     bool dataOk = false;
-    uint8_t type = cManufacturerData[2];
+    uint8_t type = cLength > 2 ? cManufacturerData[2] : 0;
     bool hasManufacturerData = cLength >= 9;
 
     long expectedUpdateAt = d->updated + ((d->data.interval - d->data.ago) * 1000);
     bool readCurrent = !(millis() < expectedUpdateAt && d->updated > 0);
-    bool readHistory = d->history && d->pending > 0;
-
-    if (d->history && d->pending) {
-        if (ntpOk) {
-            long mStart = millis();
-            int newRecords = d->pending;
-            if (newRecords == 0) newRecords = (((mStart - d->updated) / 1000) / d->data.interval) - 1;
-
-            if (d->updated != 0 && newRecords > 0) {
-                int result = downloadHistory(&ar4, d, newRecords);
-                if (result >= 0) {
-                    Serial.printf("[HIST] Dwonlaoded %d logs\n", result);
-                } else {
-                    Serial.println("[HIST] Couldn't read history");
-                }
-            }
-        } else {
-            Serial.println("[HIST] NTP Not synced.");
-        }
-    }
 
     if (hasManufacturerData) {
         // read from beacon
@@ -113,210 +152,326 @@ bool processAranet(AranetDevice* d, NimBLEAdvertisedDevice* adv, uint8_t* cManuf
 
         uint8_t counter = d->data.counter;
         dataOk = d->data.parseFromAdvertisement(cManufacturerData + 2, cLength - 2, d->data.type);
-        if (dataOk) readCurrent = counter != d->data.counter;
+        if (dataOk) {
+            readCurrent = counter != d->data.counter;
+            scanTuneReading(d, counter);
+        }
     }
 
-    if (!readCurrent) return false;
+    if (readCurrent && dataOk) {
+        readingDone(d, &egressLive, MEAS_KIND_ARANET, adv->rssi);
+    }
 
-    if (readCurrent && !dataOk && d->gatt) { // gatt must be enabled to allow reading by cinencting
-        startWatchdog(30);
+    // gatt must be enabled to allow reading by connecting
+    bool readGatt = readCurrent && !dataOk && d->gatt;
+    bool readHistory = d->history && d->pending > 0 && d->updated != 0;
+    if (readHistory && !ntpOk) {
+        Serial.println("[HIST] NTP Not synced.");
+        readHistory = false;
+    }
 
-        // disconenct from old
-        long disconnectTimeout = millis() + 1000;
-        while (ar4.isConnected() && disconnectTimeout > millis()) task_sleep(10);
+    if (readGatt || readHistory) {
+        GattJob job = { GATT_JOB_ARANET, d, adv->address(), adv->rssi, readGatt, readHistory };
+        gattDispatch(&job);
+    } else if (readCurrent && !dataOk) {
+        Serial.print("Read failed.");
+    }
 
-        // read from gatt
-        Serial.print("[Aranet4] Connecting to ");
-        Serial.print(d->name);
+    return readCurrent && dataOk;
+}
+
+/*
+    Connect with slot client, connects are serialized
+*/
+ar4_err_t gattConnectAranet(GattSlot* s, AranetDevice* d, NimBLEAddress addr) {
+    gattSlotConnectLock(s, 30);
+    long start = millis();
+    TRACE_BEGIN("gatt.connect");
+    ar4_err_t status = s->ar4->connect(addr, d->state == STATE_PAIRED);
+    TRACE_END("gatt.connect");
+    bleStatRecord(macKey(d->addr.getNative()), BLE_OP_CONNECT, millis() - start, status);
+    if (status != AR4_OK && s->callbacks.pairWasdenied()) {
+        // clear paired flag.
+        d->state = STATE_NOT_PAIRED;
+        markChanged(d, CHANGED_DEVICES);
+        Serial.printf("[Aranet4] clear paired flag\n");
+    }
+    gattConnectUnlock();
+    return status;
+}
 
-        ar4_err_t status = ar4.connect(adv->getAddress(), d->state == STATE_PAIRED);
+void gattRunAranet(GattSlot* s, GattJob* job) {
+    AranetDevice* d = job->device;
 
-        if (status == AR4_OK) {
-            d->data = ar4.getCurrentReadings();
-            dataOk = ar4.getStatus() == AR4_OK;
+    if (job->history) {
+        int result = downloadHistory(s, d, d->pending);
+        if (result >= 0) {
+            Serial.printf("[HIST] Dwonlaoded %d logs\n", result);
         } else {
-            // Try insecure
-            if (ar4callbacks.pairWasdenied()) {
-                // clear paired flag.
-                d->state = STATE_NOT_PAIRED;
-                Serial.printf("[Aranet4] clear paired flag\n");
-            }
-            Serial.printf("[Aranet4] connect failed: (%i)\n", status);
+            Serial.println("[HIST] Couldn't read history");
         }
-        cancelWatchdog();
     }
 
-    if (dataOk) {
-        // Check how many records might have been skipped
-        d->updated = millis();
+    if (!job->current) return;
 
-        Point pt = influxCreatePoint(&prefs, d, &d->data);
-        pt.addField("rssi", adv->getRSSI());
-        if (!influxSendPoint(influxClient, pt)) {
-            Serial.println(" Upload failed.");
-        }
-        if (!d->mqttReported) {
-            mqttSendConfig(&mqttClient, &prefs, d);
-            d->mqttReported = true;
-        }
-        mqttSendPoint(&mqttClient, &prefs, d, &d->data);
-    } else {
-        Serial.print("Read failed.");
-    }
+    gattSlotWatchdog(s, 30);
+    Serial.printf("[Aranet4] Connecting to %s\n", d->name);
 
-    if (ar4.isConnected()) {
-        ar4.disconnect();
-        Serial.println("Disconnected.");
+    ar4_err_t status = s->ar4->isConnected() ? AR4_OK : gattConnectAranet(s, d, job->addr);
+    if (status != AR4_OK) {
+        Serial.printf("[Aranet4] connect failed: (%i)\n", status);
+        return;
     }
 
-    return dataOk;
+    long start = millis();
+    TRACE_BEGIN("gatt.read");
+    AranetData data = s->ar4->getCurrentReadings();
+    TRACE_END("gatt.read");
+    bleStatRecord(macKey(d->addr.getNative()), BLE_OP_READ, millis() - start, s->ar4->getStatus());
+    if (s->ar4->getStatus() == AR4_OK) {
+        d->data = data;
+        readingDone(d, &s->ring, MEAS_KIND_ARANET, job->rssi);
+    } else {
+        Serial.printf("[Aranet4] %s: Read failed.\n", d->name);
+    }
 }
 
-bool processMikrotik(AranetDevice* d, NimBLEAdvertisedDevice* adv, uint8_t* cManufacturerData, int cLength) {
+bool processMikrotik(AranetDevice* d, AdvRecord* adv, uint8_t* cManufacturerData, int cLength) {
     MikroTikBeacon beacon;
     beacon.unpack(cManufacturerData, cLength);
     if (!beacon.isValid()) return false;
 
-    // send beacon data
-    Point point("bt5-tag");
-    point.addTag("device", prefs.getString(PREF_K_SYS_NAME));
-    point.addTag("name", adv->getAddress().toString().c_str());
-    if (beacon.hasTemperature()) {
-        point.addField("temperature", beacon.temperature);
-    }
-
-    point.addField("accel_x", beacon.acceleration.x);
-    point.addField("accel_y", beacon.acceleration.y);
-    point.addField("accel_z", beacon.acceleration.z);
+    if (influxClient == nullptr) return true;
 
-    point.addField("battery", beacon.battery);
-    point.addField("flags", beacon.flags);
-    point.addField("uptime", beacon.flags);
-
-    point.addField("rssi", adv->getRSSI());
-
-    if (!influxSendPoint(influxClient, point)) {
+    // send beacon data
+    Measurement m;
+    memset(&m, 0, sizeof(m));
+    m.kind = MEAS_KIND_MIKROTIK;
+    m.type = beacon.flags;
+    m.battery = beacon.battery;
+    memcpy(m.mac, adv->addr, 6);
+    m.rssi = adv->rssi;
+    m.timestamp = ntpOk ? time(nullptr) : 0;
+    m.tag.temperature = beacon.hasTemperature() ? (int16_t) lroundf(beacon.temperature * 100) : MEAS_NO_TEMPERATURE;
+    m.tag.accel[0] = lroundf(beacon.acceleration.x * 1000);
+    m.tag.accel[1] = lroundf(beacon.acceleration.y * 1000);
+    m.tag.accel[2] = lroundf(beacon.acceleration.z * 1000);
+
+    if (!egressPush(&egressLive, &m, 0)) {
         Serial.println(" Upload failed.");
     }
     return true;
 }
 
-bool processAirvalent(AranetDevice* d, NimBLEAdvertisedDevice* adv, uint8_t* cManufacturerData, int cLength) {
+bool processAirvalent(AranetDevice* d, AdvRecord* adv, uint8_t* cManufacturerData, int cLength) {
     if (d && d->enabled && d->state == STATE_PAIRED && d->gatt) {
+        if (d->gattBusy) return false;
+
         long expectedUpdateAt = d->updated + ((d->data.interval) * 1000);
         bool readCurrent = !(millis() < expectedUpdateAt && d->updated > 0);
 
         if (!readCurrent) return false;
 
-        Serial.println("[Airvalent] Connecting");
-        startWatchdog(30);
-
-        // disconenct from old
-        long disconnectTimeout = millis() + 1000;
-        while (ar4.isConnected() && disconnectTimeout > millis()) task_sleep(10);
-
-        if(airv.connect(adv) != AIRV_OK) {
-            if (ar4callbacks.pairWasdenied()) {
-                // clear paired flag.
-                d->state = STATE_NOT_PAIRED;
-                Serial.printf("[Airvalent] clear paired flag\n");
-            }
-            Serial.println("[Airvalent] Failed.");
-            airv.disconnect();
-            return false;
-        }
+        GattJob job = { GATT_JOB_AIRVALENT, d, adv->address(), adv->rssi, true, false };
+        gattDispatch(&job);
+    }
+    return true;
+}
 
-        Serial.println("[Airvalent] Connected!");
-        AirvalentData data = airv.getCurrentReadings();
+void gattRunAirvalent(GattSlot* s, GattJob* job) {
+    AranetDevice* d = job->device;
+    Airvalent* airv = s->airv;
+
+    Serial.println("[Airvalent] Connecting");
+    gattSlotConnectLock(s, 30);
+    long start = millis();
+    TRACE_BEGIN("gatt.connect");
+    airv_err_t status = airv->connect(job->addr);
+    TRACE_END("gatt.connect");
+    bleStatRecord(macKey(d->addr.getNative()), BLE_OP_CONNECT, millis() - start, status);
+    bool connected = status == AIRV_OK;
+    if (!connected && s->callbacks.pairWasdenied()) {
+        // clear paired flag.
+        d->state = STATE_NOT_PAIRED;
+        markChanged(d, CHANGED_DEVICES);
+        Serial.printf("[Airvalent] clear paired flag\n");
+    }
+    gattConnectUnlock();
 
-        d->data.type = ARANET4; // same as aranet4
-        d->data.co2 = data.co2;
-        d->data.temperature = data.temperature;
-        d->data.humidity = data.humidity;
-        d->data.pressure = data.pressure;
-        d->data.interval = airv.getInterval();
-        d->data.battery = airv.getBattery() & 0x7F;
+    if (!connected) {
+        Serial.println("[Airvalent] Failed.");
+        return;
+    }
 
-        if (data.co2 > 0 && data.co2 < 0xFFFF && data.temperature < 1000) {
-            d->updated = millis();
+    Serial.println("[Airvalent] Connected!");
+    start = millis();
+    TRACE_BEGIN("gatt.read");
+    AirvalentData data = airv->getCurrentReadings();
+    TRACE_END("gatt.read");
+    bleStatRecord(macKey(d->addr.getNative()), BLE_OP_READ, millis() - start, airv->getStatus());
+
+    d->data.type = ARANET4; // same as aranet4
+    d->data.co2 = data.co2;
+    d->data.temperature = data.temperature;
+    d->data.humidity = data.humidity;
+    d->data.pressure = data.pressure;
+    d->data.interval = airv->getInterval();
+    d->data.battery = airv->getBattery() & 0x7F;
+    d->data.ago = 0;
+
+    if (data.co2 > 0 && data.co2 < 0xFFFF && data.temperature < 1000) {
+        readingDone(d, &s->ring, MEAS_KIND_AIRVALENT, job->rssi);
+    }
+}
 
-            Point pt = influxCreateAirvalentPoint(&prefs, d, &d->data);
-            pt.addField("rssi", adv->getRSSI());
-            if (!influxSendPoint(influxClient, pt)) {
-                Serial.println(" Upload failed.");
-            }
-            if (!d->mqttReported) {
-                mqttSendConfig(&mqttClient, &prefs, d);
-                d->mqttReported = true;
-            }
-            mqttSendPoint(&mqttClient, &prefs, d, &d->data);
+/*
+    GATT worker, runs one job at a time from its slot queue
+*/
+void GattTaskCode(void* p) {
+    GattSlot* s = (GattSlot*) p;
+    GattJob job;
+
+    for (;;) {
+        if (xQueueReceive(s->jobs, &job, portMAX_DELAY) != pdTRUE) continue;
+        TRACE_SCOPE("gatt.job");
+        long start = millis();
+
+        if (job.kind == GATT_JOB_AIRVALENT) {
+            gattRunAirvalent(s, &job);
+            s->airv->disconnect();
+        } else if (job.kind == GATT_JOB_HISTORY_PROXY) {
+            gattRunHistoryProxy(s);
+            if (s->ar4->isConnected()) s->ar4->disconnect();
+        } else {
+            gattRunAranet(s, &job);
+            if (s->ar4->isConnected()) s->ar4->disconnect();
         }
 
-        airv.disconnect();
-        cancelWatchdog();
+        s->deadline = 0;
+        s->busyMs += millis() - start;
+        s->jobsDone++;
+
+        if (job.device) job.device->gattBusy = false;
+        s->busy = false;
     }
-    return true;
 }
 
 
-bool processAdvertisement(NimBLEAdvertisedDevice* adv, AranetDevice* d) {
-    std::string strManufacturerData = adv->getManufacturerData();
-
-    uint16_t manufacturerId = 0;
-    uint8_t cManufacturerData[100];
-    int cLength = strManufacturerData.length();
+bool processAdvertisement(AdvRecord* adv, AranetDevice* d) {
+    // points into ring slot, valid until advertisement is popped
+    AdSpan mfr = adv->mfr();
+    uint8_t* cManufacturerData = (uint8_t*) mfr.data;
+    int cLength = mfr.len;
 
-    strManufacturerData.copy((char *)cManufacturerData, cLength, 0);
-    memcpy(&manufacturerId, (void*) cManufacturerData, sizeof(manufacturerId));
-
-    bool isMikrotik = manufacturerId == MIKROTIK_MANUFACTURER_ID;
-    bool isAirvalent = adv->isAdvertisingService(UUID_Airvalent);
-    bool isAranet = adv->isAdvertisingService(UUID_Aranet4)
-        || manufacturerId == ARANET4_MANUFACTURER_ID
-        || adv->getName().find("Aranet") != std::string::npos;
-    bool hasName = !adv->getName().empty();
     bool prcessed = false;
     const char* defname = nullptr;
 
-    if (isAranet) {
+    switch (adv->info.vendor) {
+    case ADV_VENDOR_ARANET:
         defname = defname_aranet;
         prcessed = d && d->enabled && processAranet(d, adv, cManufacturerData, cLength);
-    } else if (isMikrotik) {
+        break;
+    case ADV_VENDOR_MIKROTIK:
         defname = defname_mikrotik;
         prcessed = d && d->enabled && processMikrotik(d, adv, cManufacturerData, cLength);
-    } else if (isAirvalent) {
+        break;
+    case ADV_VENDOR_AIRVALENT:
         defname = defname_airvalent;
         prcessed =  d && d->enabled && processAirvalent(d, adv, cManufacturerData, cLength);
-    } else {
+        break;
+    default:
         return false;
     }
 
-    if (hasName) defname = nullptr;
+    if (adv->hasName()) defname = nullptr;
     registerScannedDevice(adv, defname);
 
     return prcessed;
 }
 
 void loop() {
+    TRACE_SCOPE("loop");
     ws.cleanupClients();
     if (nextReport < millis()) {
         nextReport = millis() + 10000; // 10s
-        Point pt = influxCreateStatusPoint(&prefs);
-        pt.addField("wifi_uptime", millis() - wifiConnectedAt);
-        influxSendPoint(influxClient, pt);
+        long reportPeriod = millis() - lastReport;
+        lastReport = millis();
+        char buf[CFG_INFLUX_LINE_SIZE];
+        LineWriter lw(buf, sizeof(buf));
+        influxWriteStatus(&lw, &config);
+        lw.fieldUInt("wifi_uptime", millis() - wifiConnectedAt);
+        lw.fieldUInt("nvs_ops", nvsAccesses - reportedNvsAccesses); // since last report
+        reportedNvsAccesses = nvsAccesses;
+        if (influxQueueOk) {
+            lw.fieldUInt("queue_depth", influxQueue.depth());
+            lw.fieldUInt("queue_stored", influxQueue.stored);
+            lw.fieldUInt("queue_replayed", influxQueue.replayed);
+            lw.fieldUInt("queue_dropped", influxQueue.dropped);
+        }
+        lw.fieldUInt("egress_depth", egressDepth());
+        lw.fieldUInt("egress_max_depth", egressMaxDepth.exchange(0)); // since last report
+        lw.fieldUInt("egress_dropped", egressDropped);
+        lw.fieldUInt("egress_stall_ms", egressStallMs);
+        uint32_t latencyAvg, latencyMax;
+        if (schedTakeLatency(&latencyAvg, &latencyMax)) {
+            lw.fieldUInt("read_latency_avg", latencyAvg); // ms since measurement
+            lw.fieldUInt("read_latency_max", latencyMax);
+        }
+        lw.fieldFloat("radio_duty", schedRadioMs * 100.0 / reportPeriod); // % of time scanning
+        lw.fieldUInt("sched_missed", schedMissed);
+        lw.fieldUInt("scan_interval", scanInterval);
+        lw.fieldUInt("scan_window", scanWindow);
+        lw.fieldFloat("scan_miss_rate", scanMissRate);
+        lw.fieldFloat("scan_miss_max", scanMissRateMax);
+        lw.fieldInt("scan_wifi_busy", scanWifiBusy);
+        schedRadioMs = 0;
+        lw.fieldUInt("gatt_busy", gattBusySlots());
+        lw.fieldUInt("gatt_no_slot", gattNoSlot);
+        lw.fieldUInt("mqtt_dropped", mqttDropped);
+        lw.fieldUInt("mqtt_reconnects", mqttReconnects);
+        xSemaphoreTake(influxClientMutex, portMAX_DELAY);
+        if (influxClient) {
+            lw.fieldUInt("influx_batches", influxClient->batches);
+            lw.fieldUInt("influx_failures", influxClient->failures);
+            lw.fieldUInt("influx_rejected", influxClient->rejected);
+            lw.fieldUInt("influx_raw_bytes", influxClient->bytesRaw);
+            lw.fieldUInt("influx_sent_bytes", influxClient->bytesSent);
+        }
+        lw.end();
+        influxSendLine(influxClient, &lw);
+        xSemaphoreGive(influxClientMutex);
+
+        static char statsBuf[CFG_BLESTATS_LINE_SIZE];
+        BleDeviceStats stats;
+        for (AranetDevice* d : ar4devices) {
+            if (!bleStatsTake(macKey(d->addr.getNative()), &stats)) continue;
+            LineWriter sw(statsBuf, sizeof(statsBuf));
+            influxWriteBleStats(&sw, &config, d->name, &stats);
+            influxSubmit(&sw);
+        }
     }
 
 
-    // We don't want to do unexpected pairing here...
-    ar4callbacks.enablePairing();
     for (AranetDevice* d : ar4devices) {
         if (d->state == STATE_BEGIN_PAIR) {
             d->state = STATE_PAIRING;
+            markChanged(d, CHANGED_DEVICES);
+            // workers don't connect while pairing, so PIN request is ours
+            gattConnectLock();
+            ar4callbacks.enablePairing();
             ar4.disconnect();
             ar4callbacks.providePin(-1);
-            if (ar4.connect(d->addr, false) == AR4_OK) {
+            uint64_t key = macKey(d->addr.getNative());
+            long start = millis();
+            ar4_err_t status = ar4.connect(d->addr, false);
+            bleStatRecord(key, BLE_OP_CONNECT, millis() - start, status);
+            if (status == AR4_OK) {
                 ws.textAll("PAIR_PIN");
-                if (ar4.secureConnection() == AR4_OK) {
+                start = millis();
+                status = ar4.secureConnection();
+                // includes waiting for PIN from web
+                bleStatRecord(key, BLE_OP_SECURE, millis() - start, status);
+                if (status == AR4_OK) {
                     String name = ar4.getName();
                     ws.textAll("SUCCESS:Connected to " + name);
                     d->state = STATE_PAIRED;
@@ -330,49 +485,163 @@ void loop() {
                 ws.textAll("ERROR:Device not found");
                 d->state = STATE_NOT_PAIRED;
             }
+            ar4callbacks.disablePairing();
+            gattConnectUnlock();
+            markChanged(d, CHANGED_DEVICES);
         }
     }
 
+    serviceHistoryProxy();
+
+    GattSlot* stuck = gattStuckSlot();
+    if (stuck) {
+        Serial.printf("[GATT] Slot %u stuck\n", stuck->id);
+        restart(WatchdogTimer);
+    }
+
     // Scan devices, then compare with saved devices and read data.
-    // do scan and read
+#if CFG_BT_SCAN_CONTINUOUS
+#if CFG_BT_SCAN_SCHEDULED
+    bool wantScan = schedWantScan(ar4devices, savedGeneration, millis());
+#else
+    bool wantScan = true;
+#endif
+    // GATT connections stop scan, restart it when radio is free again
+    if (wantScan && !pScan->isScanning() && !gattConnecting()) {
+        TRACE_BEGIN("scan.start");
+        pScan->start(0, nullptr, false);
+        TRACE_END("scan.start");
+        scanCallbacks.lastResultAt = millis();
+    } else if (!wantScan && pScan->isScanning()) {
+        pScan->stop();
+    }
+    schedRadioTick(pScan->isScanning(), millis());
+
+    if (processScanResults() == 0) {
+        task_sleep(10);
+    }
+    wsPushUpdates();
+
+    // long GATT reads stop scan, don't count them as stall
+    if (pScan->isScanning() && (millis() - scanCallbacks.lastResultAt) > (CFG_BT_SCAN_STALL_TIMEOUT * 1000)) {
+        Serial.println("Scan failed.");
+        log("Scan stalled. Rebooting.", ERROR);
+        restartAfterFlush();
+    }
 
+    // housekeeping runs at old scan cycle rate
+    if (nextCycle > millis()) return;
+    nextCycle = millis() + (CFG_BT_SCAN_DURATION * 1000);
+#else
     Serial.print("Scanning BT devices...");
     long procStart = millis();
+    TRACE_BEGIN("scan.start");
     pScan->start(CFG_BT_SCAN_DURATION);
+    TRACE_END("scan.start");
+    schedRadioMs += millis() - procStart;
 
-    NimBLEScanResults results = pScan->getResults();
+    int count = processScanResults();
+    Serial.printf(" Found %u devices\n", count);
+    wsPushUpdates();
 
-    Serial.printf(" Found %u devices\n", results.getCount());
+    if ((millis() - procStart) < (CFG_BT_SCAN_DURATION * 900)) {
+        Serial.println("Scan failed.");
+        log("Scan failed. Rebooting.", ERROR);
+        restartAfterFlush();
+    }
+#endif
 
-    ar4callbacks.disablePairing();
+    cleanupScannedDevices();
+    xSemaphoreTake(influxClientMutex, portMAX_DELAY);
+    uint32_t bytesSent = influxClient ? influxClient->bytesSent : 0;
+    xSemaphoreGive(influxClientMutex);
+    scanTune(pScan, &config, ar4devices, bytesSent, egressDepth() > CFG_EGRESS_RING_SIZE / 2);
+
+    if (nextCursorSave < millis()) {
+        nextCursorSave = millis() + (CFG_CURSOR_SAVE_INTERVAL * 60000);
+        cursorSave(ar4devices);
+        tsFlush(ar4devices);
+    }
+}
 
-    for (int i = 0; i < results.getCount(); i++) {
-        NimBLEAdvertisedDevice adv = results.getDevice(i);
-        AranetDevice* d = findSavedDevice(&adv);
-        if (processAdvertisement(&adv, d)) {
+/*
+    Process all advertisements queued by scan callbacks
+    @return number of processed advertisements
+*/
+int processScanResults() {
+    int count = 0;
+    AdvRecord* adv;
+
+    while ((adv = advRing.front()) != nullptr) {
+        TRACE_SCOPE("processAdvertisement");
+        AranetDevice* d = findSavedDevice(adv);
+        if (processAdvertisement(adv, d)) {
             Serial.printf("[SCAN] Processed %s\n", d->name);
         }
+        if (d) schedUpdate(d, millis());
+        advRing.pop();
+        count++;
     }
-    ar4callbacks.enablePairing();
 
-    if ((millis() - procStart) < (CFG_BT_SCAN_DURATION * 900)) {
-        Serial.println("Scan failed.");
-        log("Scan failed. Rebooting.", ERROR);
-        influxFlushBuffer(influxClient);
-        long to = millis() + 10000;
-        while (!influxClient->isBufferEmpty() && to < millis()) {
-            task_sleep(1000);
-        }
-        ESP.restart();
-    }
+    return count;
+}
 
-    pScan->clearResults();
-    cleanupScannedDevices();
+void restartAfterFlush() {
+    // let egress task encode queued measurements
+    for (uint8_t i = 0; i < 20 && egressDepth(); i++) task_sleep(100);
 
+    cursorSave(ar4devices);
+    tsFlush(ar4devices);
+    xSemaphoreTake(influxClientMutex, portMAX_DELAY);
     influxFlushBuffer(influxClient);
+    long to = millis() + 10000;
+    while (influxClient && !influxClient->isBufferEmpty() && to < millis()) {
+        task_sleep(1000);
+    }
+    ESP.restart();
+}
+
+/*
+    Convert and upload one chunk of history records
+    @param ring egress ring owned by calling task
+*/
+void historyUploadChunk(HistoryChunk* chunk, EgressRing* ring) {
+    AranetDevice* d = chunk->device;
+    AranetData adata = chunk->base;
+    long timestamp = chunk->timestamp;
+
+    for (uint16_t k = 0; k < chunk->count; k++) {
+        if (k % 10 == 0) {
+            Serial.print(k/10);
+        } else {
+            Serial.print(".");
+        }
+
+        AranetDataCompact* log = &chunk->logs[k];
+        if (adata.type == ARANET_RADIATION) {
+            adata.radiation_pulses = log->aranetr.rad_pulses;
+            adata.radiation_rate = log->aranetr.rad_dose_rate * 10;
+            adata.radiation_total = log->aranetr.rad_dose_integral;
+        } else {
+            adata.co2 = log->aranet4.co2;
+            adata.temperature = log->aranet4.temperature;
+            adata.pressure = log->aranet4.pressure;
+            adata.humidity = log->aranet4.humidity;
+        }
+
+        Measurement m;
+        measurementFromData(&m, MEAS_KIND_ARANET, d->addr.getNative(), &adata, timestamp, 0);
+        egressPush(ring, &m, CFG_EGRESS_HISTORY_WAIT);
+        tsAppend(d, &adata, timestamp); // records stored live are skipped
+        timestamp += adata.interval;
+    }
+    Serial.println();
+    cursorUpdate(d, timestamp - adata.interval, chunk->lastIndex);
 }
 
-int downloadHistory(Aranet4* ar4, AranetDevice* d, int newRecords) {
+int downloadHistory(GattSlot* s, AranetDevice* d, int newRecords) {
+    TRACE_SCOPE("downloadHistory");
+    Aranet4* ar4 = s->ar4;
     int result = 0;
     AranetData adata;
     adata.ago = 0;
@@ -380,9 +649,9 @@ int downloadHistory(Aranet4* ar4, AranetDevice* d, int newRecords) {
     adata.interval = d->data.interval;
     adata.type = d->data.type;
 
-    // if info was received from beacon, ar4 will be disconencted
+    gattSlotWatchdog(s, 30);
     if (!ar4->isConnected()) {
-        if (ar4->connect(d->addr) != AR4_OK) {
+        if (gattConnectAranet(s, d, d->addr) != AR4_OK) {
             return -1;
         }
     }
@@ -395,41 +664,39 @@ int downloadHistory(Aranet4* ar4, AranetDevice* d, int newRecords) {
 
     time_t tnow = time(nullptr); // should be seconds
     long timestamp = tnow - (d->data.interval * newRecords);
+    long dlStart = millis();
+    uint8_t chunkNo = 0;
 
     while (newRecords > 0 && ar4->isConnected()) {
         uint16_t logCount = CFG_HISTORY_CHUNK_SIZE;
         if (newRecords < CFG_HISTORY_CHUNK_SIZE) logCount = newRecords;
 
         // reset watchdog (1s per log, at least 30s)
-        cancelWatchdog();
-        startWatchdog(max((int) logCount, 30));
+        gattSlotWatchdog(s, max((int) logCount, 30));
 
-        uint16_t params = 0;
         AranetType type = ar4->getType();
+        uint16_t params = historyParams(type);
 
-        switch (type) {
-        case ARANET4:
-            params = AR4_PARAM_FLAGS;
-            break;
-        case ARANET2:
-            params = AR2_PARAM_FLAGS;
-            break;
-        case ARANET_RADIATION:
-            params = ARR_PARAM_FLAGS;
-            params |= AR4_PARAM_RADIATION_PULSES_FLAG;
-            break;
-        default:
-            params = 0;
-            break;
-        }
+#if CFG_HISTORY_PIPELINED
+        // wait until uploader is done with chunk, that used this buffer before
+        xSemaphoreTake(s->historyFree, portMAX_DELAY);
+#endif
+        AranetDataCompact* buf = s->logs[chunkNo++ % CFG_HISTORY_BUFFERS];
 
         Serial.printf("[HIST] Read params %i results from %i..%i [%u]\n", logCount, start, start + logCount, params);
 
-        int count = ar4->getHistory(start, logCount, logs, params);
+        long readStart = millis();
+        TRACE_BEGIN("getHistory");
+        int count = ar4->getHistory(start, logCount, buf, params);
+        TRACE_END("getHistory");
+        bleStatRecord(macKey(d->addr.getNative()), BLE_OP_HISTORY, millis() - readStart, ar4->getStatus());
 
         // Sometimes aranet might disconect, before full history is received
         // Set last update time to latest received timestamp;
         if (!ar4->isConnected()) {
+#if CFG_HISTORY_PIPELINED
+            xSemaphoreGive(s->historyFree);
+#endif
             break;
         } else {
             start += logCount;
@@ -441,32 +708,149 @@ int downloadHistory(Aranet4* ar4, AranetDevice* d, int newRecords) {
 
         result += logCount;
 
-        for (uint16_t k = 0; k < logCount; k++) {
-            if (k % 10 == 0) {
-                Serial.print(k/10);
-            } else {
-                Serial.print(".");
-            }
+        adata.type = type;
+        HistoryChunk chunk = { d, buf, s->historyFree, logCount, (uint16_t) (start - 1), timestamp, adata };
+        timestamp += d->data.interval * logCount;
 
-            adata.type = type;
-            if (type == ARANET_RADIATION) {
-                adata.radiation_pulses = logs[k].aranetr.rad_pulses;
-                adata.radiation_rate = logs[k].aranetr.rad_dose_rate * 10;
-                adata.radiation_total = logs[k].aranetr.rad_dose_integral;
-            } else {
-                adata.co2 = logs[k].aranet4.co2;
-                adata.temperature = logs[k].aranet4.temperature;
-                adata.pressure = logs[k].aranet4.pressure;
-                adata.humidity = logs[k].aranet4.humidity;
+#if CFG_HISTORY_PIPELINED
+        // wait time counts against slot watchdog, when uploader is stuck
+        xQueueSend(historyQueue, &chunk, portMAX_DELAY);
+#else
+        historyUploadChunk(&chunk, &s->ring);
+#endif
+    }
+
+#if CFG_HISTORY_PIPELINED
+    // wait for uploads in flight
+    for (uint8_t i = 0; i < CFG_HISTORY_BUFFERS; i++) xSemaphoreTake(s->historyFree, portMAX_DELAY);
+    for (uint8_t i = 0; i < CFG_HISTORY_BUFFERS; i++) xSemaphoreGive(s->historyFree);
+#endif
+
+    long elapsed = millis() - dlStart;
+    bleStatHistory(macKey(d->addr.getNative()), result, elapsed);
+    if (result > 0 && elapsed > 0) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "[HIST] %s: %i records in %li ms (%.1f rec/s, %s)",
+            d->name, result, elapsed, result * 1000.0 / elapsed,
+            CFG_HISTORY_PIPELINED ? "pipelined" : "serial");
+        log(msg, ILog::INFO);
+    }
+
+    return result;
+}
+
+uint16_t historyParams(AranetType type) {
+    switch (type) {
+    case ARANET4:
+        return AR4_PARAM_FLAGS;
+    case ARANET2:
+        return AR2_PARAM_FLAGS;
+    case ARANET_RADIATION:
+        return ARR_PARAM_FLAGS | AR4_PARAM_RADIATION_PULSES_FLAG;
+    default:
+        return 0;
+    }
+}
+
+/*
+    Hand history request over HTTP to free GATT slot, BLE transfer does
+    not block loop task. Request is dropped if response is closed or
+    device is removed before slot is free.
+*/
+void serviceHistoryProxy() {
+    std::shared_ptr<HistoryProxyJob> job = std::atomic_load(&historyProxy);
+    if (!job || job->dispatched) return;
+
+    // only global and local reference left, response is gone
+    AranetDevice* d = findSavedDevice(job->key);
+    if (job.use_count() <= 2 || !d) {
+        job->state = PROXY_DONE;
+        std::atomic_store(&historyProxy, std::shared_ptr<HistoryProxyJob>());
+        return;
+    }
+
+    GattJob g = { GATT_JOB_HISTORY_PROXY, nullptr, d->addr, 0, false, false };
+    job->dispatched = gattDispatch(&g); // else next loop, when slot is free
+}
+
+/*
+    Serve history request, one chunk at a time. Next chunk is read when
+    response has sent previous one. Job ends when response is closed,
+    chunk is not taken in time or device is removed.
+*/
+void gattRunHistoryProxy(GattSlot* s) {
+    std::shared_ptr<HistoryProxyJob> job = std::atomic_load(&historyProxy);
+    if (!job) return;
+    Aranet4* ar4 = s->ar4;
+
+    for (;;) {
+        // only global and own reference left, response is gone
+        bool aborted = job.use_count() <= 2;
+        bool timeout = job->state == PROXY_READY && millis() - job->readyAt > CFG_HISTORY_PROXY_TIMEOUT;
+        AranetDevice* d = findSavedDevice(job->key);
+
+        if (aborted || timeout || !d || (job->state == PROXY_WAIT && job->remaining == 0)) {
+            if (timeout) Serial.println("[PROXY] Timeout, job dropped");
+            break;
+        }
+        if (job->state != PROXY_WAIT) {
+            s->deadline = 0; // waiting for client, response has own timeout
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        if (!job->connected) {
+            gattSlotConnectLock(s, 30);
+            long start = millis();
+            ar4_err_t status = ar4->connect(d->addr, d->state == STATE_PAIRED);
+            bleStatRecord(job->key, BLE_OP_CONNECT, millis() - start, status);
+            gattConnectUnlock();
+            if (status != AR4_OK) {
+                Serial.printf("[PROXY] connect failed: (%i)\n", status);
+                job->remaining = 0;
+                continue;
+            }
+            job->connected = true;
+
+            uint16_t total = ar4->getTotalReadings();
+            if (job->remaining > total) job->remaining = total;
+            if (job->first == 0 || job->first > total) job->first = total - job->remaining + 1;
+            if (job->first + job->remaining > total + 1) job->remaining = total + 1 - job->first;
+            job->next = job->first;
+
+            job->type = ar4->getType();
+            job->interval = d->data.interval;
+            if (ntpOk && d->updated) {
+                // latest record was measured "ago" seconds before last reading
+                uint32_t latest = time(nullptr) - d->data.ago - (millis() - d->updated) / 1000;
+                job->firstTimestamp = latest - (uint32_t) (total - job->first) * job->interval;
             }
 
-            Point pt = influxCreatePointWithTimestamp(&prefs, d, &adata, timestamp);
-            influxSendPoint(influxClient, pt);
-            timestamp += d->data.interval;
+            Serial.printf("[PROXY] %s: records %u..%u\n", d->name, job->first, job->first + job->remaining - 1);
+            continue;
+        }
+
+        uint16_t count = job->remaining < CFG_HISTORY_CHUNK_SIZE ? job->remaining : CFG_HISTORY_CHUNK_SIZE;
+        gattSlotWatchdog(s, max((int) count, 30));
+        long start = millis();
+        TRACE_BEGIN("gatt.proxy");
+        ar4->getHistory(job->next, count, job->logs, historyParams(job->type));
+        TRACE_END("gatt.proxy");
+        bleStatRecord(job->key, BLE_OP_HISTORY, millis() - start, ar4->getStatus());
+
+        if (!ar4->isConnected()) {
+            job->remaining = 0;
+            continue;
         }
-        Serial.println();
-        influxFlushBuffer(influxClient);
+
+        job->chunkStart = job->next;
+        job->chunkCount = count;
+        job->next += count;
+        job->remaining -= count;
+        job->readyAt = millis();
+        job->state = PROXY_READY;
     }
 
-    return result;
+    job->state = PROXY_DONE;
+    std::atomic_store(&historyProxy, std::shared_ptr<HistoryProxyJob>());
 }
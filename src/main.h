@@ -15,9 +15,20 @@
 
 #include "vector"
 #include "config.h"
+#include "trace.h"
 #include "utils.h"
 #include "types.h"
 #include "bt.h"
+#include "scan.h"
+#include "registry.h"
+#include "settings.h"
+#include "cursor.h"
+#include "tsstore.h"
+#include "histproxy.h"
+#include "gattpool.h"
+#include "schedule.h"
+#include "scantune.h"
+#include "metrics.h"
 #include "html.h"
 #include "Aranet4.h"
 #include "include/airvalent.h"
@@ -30,13 +41,17 @@
 
 const char compile_date[] = __DATE__ " " __TIME__;
 
-char* www_username;
-char* www_password;
 
 // ---------------------------------------------------
 //                 Global variables
 // ---------------------------------------------------
-Preferences prefs;
+NodeConfig config;
+SemaphoreHandle_t settingsMutex; // held while config is written or copied
+
+// settings copies of tasks, refreshed when settingsGeneration changes
+NodeConfig egressConfig;
+NodeConfig mqttConfig;
+uint32_t influxClientGeneration = 0; // settings influxClient was created from
 
 AsyncWebServer server(80);
 AsyncWebSocket ws("/ws");
@@ -45,25 +60,54 @@ MyAranet4Callbacks ar4callbacks;
 std::vector<AranetDevice*> ar4devices;
 std::vector<AranetDevice*> newDevices;
 
-Aranet4 ar4(&ar4callbacks);
-Airvalent airv(&ar4callbacks);
-InfluxDBClient* influxClient = nullptr;
+// MAC lookup for ar4devices and newDevices
+DeviceIndex<AranetDevice, CFG_SAVED_INDEX_SIZE> savedIndex;
+DeviceIndex<AranetDevice, CFG_SCANNED_INDEX_SIZE> scannedIndex;
+// indexes and newDevices, devices are looked up by web server and egress tasks
+portMUX_TYPE devicesMux = portMUX_INITIALIZER_UNLOCKED;
+
+Aranet4 ar4(&ar4callbacks); // pairing, jobs use gattSlots
+InfluxWriter* influxClient = nullptr; // replaced only by egress task
+SemaphoreHandle_t influxClientMutex;   // held by other tasks while using influxClient
+
+// loop task for current readings, history upload task for history records,
+// GATT workers have own rings
+EgressRing egressLive;
+EgressRing egressHistory;
+std::atomic<uint32_t> egressDropped{0};
+std::atomic<uint32_t> egressStallMs{0};  // producers waiting for free slot
+std::atomic<uint32_t> egressMaxDepth{0};
+
+PartitionStorage queueStorage;
+FlashQueue influxQueue;
+bool influxQueueOk = false;
 
 WiFiClient espClient;
-MqttClient mqttClient(espClient);
+MqttClient mqttClient(espClient); // owned by MQTT task
+QueueHandle_t mqttQueue;
+uint32_t mqttDropped = 0;
+uint32_t mqttReconnects = 0;
+
+QueueHandle_t historyQueue;
 
-AranetDataCompact logs[CFG_HISTORY_CHUNK_SIZE];
+// history requested over HTTP, serviced by loop task
+std::shared_ptr<HistoryProxyJob> historyProxy;
 
 // RTOS
 TaskHandle_t BtScanTask;
 TaskHandle_t WiFiTask;
 TaskHandle_t NtpSyncTask;
+TaskHandle_t HistoryUploadTask;
+TaskHandle_t MqttTask;
+TaskHandle_t EgressTask = nullptr;
 TimerHandle_t WatchdogTimer;
 
 bool wifiTaskRunning = false;
 
 // Blue
 NimBLEScan *pScan = NimBLEDevice::getScan();
+AdvRing advRing;
+MyScanCallbacks scanCallbacks(&advRing);
 
 bool isAp = true;
 long wifiConnectedAt = 0;
@@ -74,6 +118,23 @@ bool ntpOk = false;
 
 static WireGuard wg;
 
+// Web UI change counters, see markChanged()
+#define CHANGED_DATA    1 // /data
+#define CHANGED_DEVICES 2 // /devices_list
+
+typedef struct {
+    uint32_t generation = 0xFFFFFFFF;
+    String text;
+} CachedText;
+
+uint32_t dataGeneration = 0;
+uint32_t devicesGeneration = 0;
+uint32_t savedGeneration = 0; // saved devices added, removed or edited
+uint32_t etagSalt = esp_random(); // etags from before reboot don't match
+CachedText dataCache;
+CachedText devicesCache;
+uint32_t wsFrameSeq = 0;
+
 // ---------------------------------------------------
 //                 Function declarations
 // ---------------------------------------------------
@@ -82,6 +143,8 @@ void devicesLoad();
 void devicesSave();
 
 int createInfluxClient();
+bool sendReading(EgressRing* ring, AranetDevice* d, AranetData* data, uint8_t kind, int8_t rssi);
+void replayInfluxQueue();
 bool getBootWiFiMode();
 bool startWebserver();
 bool webAuthenticate(AsyncWebServerRequest *request);
@@ -99,21 +162,37 @@ bool cancelWatchdog();
 
 void WiFiTaskCode(void* pvParameters);
 void NtpSyncTaskCode(void* pvParameters);
+void HistoryUploadTaskCode(void* pvParameters);
+void MqttTaskCode(void* pvParameters);
+void historyUploadChunk(HistoryChunk* chunk, EgressRing* ring);
+
+void markChanged(AranetDevice* d, uint8_t what);
+void wsPushUpdates();
 
 AranetDevice* findScannedDevice(NimBLEAddress macaddr);
+AranetDevice* findSavedDevice(uint64_t key);
 AranetDevice* findSavedDevice(NimBLEAddress macaddr);
-AranetDevice* findSavedDevice(NimBLEAdvertisedDevice adv);
+AranetDevice* findSavedDevice(AdvRecord* adv);
+bool addSavedDevice(AranetDevice* d);
+bool saveScannedDevice(AranetDevice* d);
 
 // ---------------------------------------------------
 //                 Function definitions
 // ---------------------------------------------------
 
 bool isManualIp() {
-    return (prefs.getBool(PREF_K_WIFI_IP_STATIC));
+    return config.wifiIpStatic;
 }
 
 void wipeStoredDevices() {
+    portENTER_CRITICAL(&devicesMux);
+    savedIndex.clear();
+    portEXIT_CRITICAL(&devicesMux);
+    savedGeneration++;
+
     for (AranetDevice* d : ar4devices) {
+        tsClose(d);
+        bleStatsRemove(macKey(d->addr.getNative()));
         delete d;
     }
     ar4devices.clear();
@@ -122,7 +201,14 @@ void wipeStoredDevices() {
 }
 
 void devicesLoad() {
+    portENTER_CRITICAL(&devicesMux);
+    savedIndex.clear();
+    portEXIT_CRITICAL(&devicesMux);
+    savedGeneration++;
+
     for (AranetDevice* d : ar4devices) {
+        tsClose(d);
+        bleStatsRemove(macKey(d->addr.getNative()));
         delete d;
     }
     ar4devices.clear();
@@ -163,7 +249,10 @@ void devicesLoad() {
                     d->addr = NimBLEAddress(mac, BLE_ADDR_RANDOM);
                     strcpy(d->name, name);
 
-                    ar4devices.push_back(d);
+                    if (!addSavedDevice(d)) {
+                        Serial.printf("Device %s already loaded or too many devices\n", mac);
+                        delete d;
+                    }
                 }
             }
             file.close();
@@ -171,9 +260,14 @@ void devicesLoad() {
     } else {
         Serial.println("config file not exist!");
     }
+
+    cursorLoad(ar4devices);
 }
 
 void devicesSave() {
+    markChanged(nullptr, CHANGED_DATA | CHANGED_DEVICES);
+    savedGeneration++;
+
     File cfg = SPIFFS.open("/devices.json");
     if (!cfg) return;
 
@@ -207,33 +301,234 @@ void devicesSave() {
    @return 1 on success or 0 on failure
 */
 int configLoad() {
-    if (!prefs.begin("nodeCfg")) {
+    if (!settingsLoad(&config, "nodeCfg")) {
         Serial.println("failed to read node config");
         return 0;
     }
 
-    if (!prefs.getBool(PREF_K_CFG_INIT, false)) {
+    if (!config.cfgInit) {
         wipeStoredDevices();
-        prefs.putBool(PREF_K_CFG_INIT, true);
+        config.cfgInit = true;
+        settingsSave(&config);
     }
+    // saved by older firmware without checks
+    if (scanSettingsFix(&config)) settingsSave(&config);
 
     return 1;
 }
 
 /*
-   Create influxdb client
+    Copy config for task, never torn by /settings update
+*/
+void settingsSnapshot(NodeConfig* cfg) {
+    xSemaphoreTake(settingsMutex, portMAX_DELAY);
+    *cfg = config;
+    xSemaphoreGive(settingsMutex);
+}
+
+/*
+    (Re)create upload client from config. After boot only egress task
+    calls this, buffered lines of old client are dropped.
 */
 int createInfluxClient() {
+    influxClientGeneration = settingsGeneration;
+    settingsSnapshot(&egressConfig);
+
+    xSemaphoreTake(influxClientMutex, portMAX_DELAY);
     if (influxClient != nullptr) {
         delete influxClient;
     }
-    influxClient = influxCreateClient(&prefs);
+    influxClient = influxCreateClient(&egressConfig);
+    influxTagsReset(); // node name may have changed
+    xSemaphoreGive(influxClientMutex);
     return 1;
 }
 
+/*
+    Add line to upload buffer, for tasks other than egress task
+*/
+bool influxSubmit(LineWriter* lw) {
+    xSemaphoreTake(influxClientMutex, portMAX_DELAY);
+    bool ok = influxSendLine(influxClient, lw);
+    xSemaphoreGive(influxClientMutex);
+    return ok;
+}
+
+/*
+    Queue measurement for egress task, producer side
+    @param wait max time to wait for free slot, ms
+    @return false if measurement was dropped
+*/
+bool egressPush(EgressRing* ring, Measurement* m, uint32_t wait) {
+    bool ok = ring->push(*m);
+    if (!ok && wait) {
+        uint32_t start = millis();
+        while (!ok && millis() - start < wait) {
+            task_sleep(1);
+            ok = ring->push(*m);
+        }
+        egressStallMs += millis() - start;
+    }
+
+    if (!ok) {
+        egressDropped++;
+        return false;
+    }
+
+    uint32_t depth = ring->size();
+    uint32_t max = egressMaxDepth.load();
+    while (depth > max && !egressMaxDepth.compare_exchange_weak(max, depth)) {}
+    if (EgressTask) xTaskNotifyGive(EgressTask);
+    return true;
+}
+
+/*
+    Measurements waiting in all rings
+*/
+uint16_t egressDepth() {
+    uint16_t depth = egressLive.size() + egressHistory.size();
+    for (GattSlot &s : gattSlots) depth += s.ring.size();
+    return depth;
+}
+
+/*
+    Queue current reading for upload, never waits
+    @param ring ring of calling task
+    @return false if reading was lost
+*/
+bool sendReading(EgressRing* ring, AranetDevice* d, AranetData* data, uint8_t kind, int8_t rssi) {
+    if (influxClient == nullptr) return false;
+
+    Measurement m;
+    measurementFromData(&m, kind, d->addr.getNative(), data, ntpOk ? time(nullptr) : 0, rssi);
+    return egressPush(ring, &m, 0);
+}
+
+/*
+    Copy name of saved device, safe to call from other tasks
+*/
+bool savedDeviceName(uint64_t key, char* name, size_t size) {
+    portENTER_CRITICAL(&devicesMux);
+    AranetDevice* d = savedIndex.find(key);
+    if (d) strlcpy(name, d->name, size);
+    portEXIT_CRITICAL(&devicesMux);
+    return d != nullptr;
+}
+
+/*
+    Encode measurement into upload buffer. If buffer is full (server
+    unreachable), measurement is stored in flash queue and sent later.
+    Runs in egress task.
+*/
+bool egressWrite(Measurement* m) {
+    if (influxClient == nullptr) return false;
+
+    char name[24] = "";
+    if (m->kind != MEAS_KIND_MIKROTIK && !savedDeviceName(macKey(m->mac), name, sizeof(name))) {
+        return false; // device removed
+    }
+
+    if (!influxClient->isBufferFull()) {
+        char buf[CFG_INFLUX_LINE_SIZE];
+        LineWriter lw(buf, sizeof(buf));
+        if (!influxWriteMeasurement(&lw, &egressConfig, name, m)) return false;
+        return influxSendLine(influxClient, &lw);
+    }
+
+    if (!influxQueueOk || m->kind == MEAS_KIND_MIKROTIK || !m->timestamp) return false;
+    return influxQueue.push(m);
+}
+
+/*
+    Send readings stored in flash queue, while server accepts them.
+    Runs in egress task.
+*/
+void replayInfluxQueue() {
+    static Measurement batch[CFG_QUEUE_REPLAY_BATCH];
+    char buf[CFG_INFLUX_LINE_SIZE];
+    char name[24];
+
+    if (!influxQueueOk || influxClient == nullptr) return;
+
+    for (uint8_t b = 0; b < CFG_QUEUE_REPLAY_BATCHES && !influxQueue.empty(); b++) {
+        // previous points must be delivered first, server is not retried early
+        if (!influxClient->isBufferEmpty() || influxClient->isRetryPending()) return;
+
+        uint16_t count = influxQueue.peek(batch, CFG_QUEUE_REPLAY_BATCH);
+        if (count == 0) return;
+
+        for (uint16_t i = 0; i < count; i++) {
+            Measurement* m = &batch[i];
+            if (!influxQueue.validate(m)) continue;
+
+            // skip readings of removed devices
+            if (!savedDeviceName(macKey(m->mac), name, sizeof(name))) continue;
+
+            LineWriter lw(buf, sizeof(buf));
+            if (influxWriteMeasurement(&lw, &egressConfig, name, m)) influxSendLine(influxClient, &lw);
+        }
+        influxFlushBuffer(influxClient);
+
+        if (!influxClient->isBufferEmpty()) {
+            // failed, flash keeps the only copy, or lines would be sent twice
+            influxClient->clear();
+            return;
+        }
+        influxQueue.consume(count);
+        Serial.printf("[QUEUE] Replayed %u points, %u remaining\n", count, influxQueue.depth());
+    }
+}
+
+/*
+    Ships measurements queued by BLE side. Owns InfluxDB uploads and
+    flash queue, so HTTP requests never block scanning.
+*/
+void EgressTaskCode(void * pvParameters) {
+    Measurement m;
+    EgressRing* rings[2 + CFG_GATT_POOL_SIZE] = { &egressLive, &egressHistory };
+    for (uint8_t i = 0; i < CFG_GATT_POOL_SIZE; i++) rings[2 + i] = &gattSlots[i].ring;
+
+    for (;;) {
+        // server or credentials may have changed, client is not in use here
+        if (influxClientGeneration != settingsGeneration) {
+            createInfluxClient();
+        }
+
+        bool idle = true;
+        for (EgressRing* ring : rings) {
+            for (uint8_t i = 0; i < MAX_BATCH_SIZE && ring->pop(&m); i++) {
+                TRACE_SCOPE("egress.write");
+                egressWrite(&m);
+                idle = false;
+            }
+        }
+
+        if (influxClient && (influxClient->isBatchFull() || (idle && !influxClient->isBufferEmpty()))) {
+            influxClient->flushBuffer();
+        }
+
+        if (idle) {
+            replayInfluxQueue();
+            ulTaskNotifyTake(pdTRUE, CFG_EGRESS_IDLE_WAIT / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+void startEgressTask() {
+    xTaskCreatePinnedToCore(
+        EgressTaskCode, /* Task function. */
+        "EgressTask",   /* name of task. */
+        6144,           /* Stack size of task */
+        NULL,           /* parameter of the task */
+        1,              /* priority of the task */
+        &EgressTask,    /* Task handle to keep track of created task */
+        0               /* pin task to core 0 */
+    );
+}
+
 bool getBootWiFiMode() {
     bool isAp = false;
-    if (prefs.getString(PREF_K_WIFI_SSID).length() == 0) return true;
+    if (!config.wifiSsid[0]) return true;
 
     long timeout = millis() + 3000;
 
@@ -269,39 +564,92 @@ bool getBootWiFiMode() {
     return isAp;
 }
 
+/*
+    One device line of /data, same return value as snprintf
+*/
+int printDataLine(char* buf, size_t size, int index, AranetDevice* d) {
+    return snprintf(buf, size, "%i;%s;%s;%s;%u;%i;%.1f;%.1f;%.1f;%lu;%llu;%llu;%i;%i;%i;%li\n",
+            index,
+            d->enabled ? "e" : "",
+            d->name,
+            d->addr.toString().c_str(),
+            d->data.type,
+            d->data.getCO2(),
+            d->data.getTemperature(),
+            d->data.getPressure(),
+            d->data.getHumidity(),
+            d->data.getRadiationRate(),
+            d->data.getRadiationTotal(),
+            d->data.getRadiationDuration(),
+            d->data.battery,
+            d->data.interval,
+            d->data.ago,
+            d->updated // uptime, age is calculated by client
+    );
+}
+
 String printData() {
-    char buf[100];
+    char buf[160];
     String page = String("");
 
-    long tnow = millis();
-
     int index = 0;
     for (AranetDevice* d : ar4devices) {
-        page += String(index++) + ";";
-        page += d->enabled ? "e;" : ";";
-
-        page += String(d->name);
-        page += ";" + String(d->addr.toString().c_str()) + ";";
-
-        sprintf(buf, "%u;%i;%.1f;%.1f;%.1f;%lu;%llu;%llu;%i;%i;%i;%i\n",
-                d->data.type,
-                d->data.getCO2(),
-                d->data.getTemperature(),
-                d->data.getPressure(),
-                d->data.getHumidity(),
-                d->data.getRadiationRate(),
-                d->data.getRadiationTotal(),
-                d->data.getRadiationDuration(),
-                d->data.battery,
-                d->data.interval,
-                d->data.ago,
-                (tnow - d->updated) / 1000
-        );
+        printDataLine(buf, sizeof(buf), index++, d);
         page += String(buf);
     }
     return page;
 }
 
+/*
+    Push lines of devices changed since last push to WebSocket clients.
+    Frame is built once and shared by all clients. Library drops frames for
+    clients with full queue, they notice gap in sequence and reload /data.
+    Generations are taken once, so change made while frame is built
+    is pushed next time.
+*/
+void wsPushUpdates() {
+    uint32_t pushing[CFG_SAVED_INDEX_SIZE];
+    bool clients = ws.count() > 0;
+    size_t len = 0;
+    int index = 0;
+
+    for (AranetDevice* d : ar4devices) {
+        if (index >= CFG_SAVED_INDEX_SIZE) break;
+        pushing[index] = d->generation;
+        if (clients && pushing[index] != d->pushedGeneration) len += printDataLine(nullptr, 0, index, d);
+        index++;
+    }
+    int count = index;
+
+    if (len > 0) {
+        char head[24];
+        int headLen = snprintf(head, sizeof(head), "DATA:%u;%lu\n", ++wsFrameSeq, millis());
+
+        AsyncWebSocketMessageBuffer* buffer = ws.makeBuffer(headLen + len);
+        if (buffer) {
+            char* p = (char*) buffer->get();
+            size_t left = headLen + len;
+            memcpy(p, head, headLen);
+            p += headLen;
+            left -= headLen;
+
+            for (index = 0; index < count; index++) {
+                AranetDevice* d = ar4devices[index];
+                if (pushing[index] != d->pushedGeneration && left > 0) {
+                    int n = printDataLine(p, left + 1, index, d);
+                    n = min((size_t) n, left);
+                    p += n;
+                    left -= n;
+                }
+            }
+            memset(p, '\n', left); // in case line got shorter
+            ws.textAll(buffer);
+        }
+    }
+
+    for (index = 0; index < count; index++) ar4devices[index]->pushedGeneration = pushing[index];
+}
+
 // Deprecated!
 String printNewDevices() {
     String page = "#new";
@@ -338,6 +686,41 @@ String printDevices() {
     return page;
 }
 
+/*
+    Count change of data shown in web UI, device may be null
+    when device list itself changes.
+*/
+void markChanged(AranetDevice* d, uint8_t what) {
+    if (d && (what & CHANGED_DATA)) d->generation++;
+    if (what & CHANGED_DATA) dataGeneration++;
+    if (what & CHANGED_DEVICES) devicesGeneration++;
+}
+
+/*
+    Send text rendered only when generation changes.
+    Client with current version gets 304.
+*/
+void sendCached(AsyncWebServerRequest *request, CachedText* cache, uint32_t generation, String (*render)()) {
+    char etag[20];
+    sprintf(etag, "\"%08x%08x\"", etagSalt, generation);
+
+    AsyncWebServerResponse *response;
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+        response = request->beginResponse(304);
+    } else {
+        if (cache->generation != generation) {
+            cache->text = render();
+            cache->generation = generation;
+        }
+        response = request->beginResponse(200, "text/plain", cache->text);
+    }
+
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    response->addHeader("X-Uptime", String(millis()));
+    request->send(response);
+}
+
 bool setupWiFi() {
     if (WiFi.status() == WL_CONNECTED) {
         return true;
@@ -348,18 +731,18 @@ bool setupWiFi() {
         WiFi.mode(WIFI_AP_STA);
         WiFi.softAP(ssid, password);
     } else {
-        Serial.printf("Starting STATION: %s\n", prefs.getString(PREF_K_WIFI_SSID).c_str());
+        Serial.printf("Starting STATION: %s\n", config.wifiSsid);
         WiFi.mode(WIFI_STA);
-        WiFi.setHostname(prefs.getString(PREF_K_SYS_NAME).c_str());
+        WiFi.setHostname(config.sysName);
 
         // manual ip
         if (isManualIp()) {
-        if (!WiFi.config(prefs.getUInt(PREF_K_WIFI_IP_ADDR), prefs.getUInt(PREF_K_WIFI_IP_GW), prefs.getUInt(PREF_K_WIFI_IP_MASK), prefs.getUInt(PREF_K_WIFI_IP_DNS))) {
+        if (!WiFi.config(config.wifiIpAddr, config.wifiIpGw, config.wifiIpMask, config.wifiIpDns)) {
             Serial.println("STA Failed to configure");
         }
         }
 
-        WiFi.begin(prefs.getString(PREF_K_WIFI_SSID).c_str(), prefs.getString(PREF_K_WIFI_PASSWORD).c_str(), 0, NULL);
+        WiFi.begin(config.wifiSsid, config.wifiPassword, 0, NULL);
 
         long timeout = millis() + 15000;
         while (WiFi.status() != WL_CONNECTED) {
@@ -453,6 +836,7 @@ void onWsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventT
 
                         ar4callbacks.providePin(-1); // reset pin
                         d->state = STATE_BEGIN_PAIR;
+                        markChanged(d, CHANGED_DEVICES);
                     } else {
                         client->text("ERROR:Invalid device");
                     }
@@ -496,6 +880,8 @@ void onWsEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventT
 
                     if (d) {
                         strcpy(d->name, newname.c_str());
+                        mqttBuildTopic(d);
+                        d->mqttReported = false;
                         // save state
                         devicesSave();
                         client->text("RENAME:OK");
@@ -539,153 +925,155 @@ bool setupWifiAndWebserver(bool restart = false) {
 }
 
 bool webAuthenticate(AsyncWebServerRequest *request) {
-    if (!www_username) {
-        String str = prefs.getString(PREF_K_LOGIN_USER, CFG_DEF_LOGIN_USER);
-        int len = str.length() + 1;
-        if (www_username) {
-            free(www_username);
-        }
-        www_username = (char*) malloc(len);
-        memcpy(www_username, str.c_str(), len);
-    }
-
-    if (!www_password) {
-        String str = prefs.getString(PREF_K_LOGIN_PASSWORD, CFG_DEF_LOGIN_PASSWORD);
-        int len = str.length() + 1;
-        if (www_password) {
-            free(www_password);
-        }
-        www_password = (char*) malloc(len);
-        memcpy(www_password, str.c_str(), len);
-    }
-
-    return request->authenticate(www_username, www_password);
+    return request->authenticate(config.loginUser, config.loginPassword);
 }
 
 bool startWebserver() {
     // setup webserver handles
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (!webAuthenticate(request)) return request->requestAuthentication();
-        request->send(200, "text/html", printHtmlIndex(ar4devices));
+        request->send(beginHtmlResponse(request, [](HtmlWriter* w) { printHtmlIndex(w); }));
     });
 
     server.on("/settings", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (!webAuthenticate(request)) return request->requestAuthentication();
-        request->send(200, "text/html", printHtmlConfig(&prefs));
+        request->send(beginHtmlResponse(request, [](HtmlWriter* w) { printHtmlConfig(w, &config); }));
     });
 
     server.on("/settings", HTTP_POST, [](AsyncWebServerRequest *request) {
         if (!webAuthenticate(request)) return request->requestAuthentication();
 
         // process data...
+        NodeConfig cfg = config;
 
         // Generic
         if (request->hasArg(PREF_K_SYS_NAME))     {
-            prefs.putString(PREF_K_SYS_NAME, request->arg(PREF_K_SYS_NAME));
+            strlcpy(cfg.sysName, request->arg(PREF_K_SYS_NAME).c_str(), sizeof(cfg.sysName));
         }
         if (request->hasArg(PREF_K_SCAN_REBOOT))     {
-            prefs.putUShort(PREF_K_SCAN_REBOOT, request->arg(PREF_K_SCAN_REBOOT).toInt());
+            cfg.scanReboot = request->arg(PREF_K_SCAN_REBOOT).toInt();
+        }
+        if (request->hasArg(PREF_K_SCAN_INTERVAL))   {
+            cfg.scanInterval = constrain(request->arg(PREF_K_SCAN_INTERVAL).toInt(), 0, SCAN_PARAM_MAX);
+        }
+        if (request->hasArg(PREF_K_SCAN_WINDOW))     {
+            cfg.scanWindow = constrain(request->arg(PREF_K_SCAN_WINDOW).toInt(), 0, SCAN_PARAM_MAX);
         }
+        scanSettingsFix(&cfg);
         if (request->hasArg(PREF_K_NTP_URL))      {
-            prefs.putString(PREF_K_NTP_URL, request->arg(PREF_K_NTP_URL));
+            strlcpy(cfg.ntpUrl, request->arg(PREF_K_NTP_URL).c_str(), sizeof(cfg.ntpUrl));
         }
 
         // Wireless
         if (request->hasArg(PREF_K_WIFI_SSID))     {
-            prefs.putString(PREF_K_WIFI_SSID, request->arg(PREF_K_WIFI_SSID));
+            strlcpy(cfg.wifiSsid, request->arg(PREF_K_WIFI_SSID).c_str(), sizeof(cfg.wifiSsid));
         }
         if (request->hasArg(PREF_K_WIFI_PASSWORD)) {
-            prefs.putString(PREF_K_WIFI_PASSWORD, request->arg(PREF_K_WIFI_PASSWORD));
+            strlcpy(cfg.wifiPassword, request->arg(PREF_K_WIFI_PASSWORD).c_str(), sizeof(cfg.wifiPassword));
         }
 
         // IP
-        prefs.putBool(PREF_K_WIFI_IP_STATIC, request->hasArg(PREF_K_WIFI_IP_STATIC));
+        cfg.wifiIpStatic = request->hasArg(PREF_K_WIFI_IP_STATIC);
         if (request->hasArg(PREF_K_WIFI_IP_ADDR)) {
-            prefs.putUInt(PREF_K_WIFI_IP_ADDR, str2ip(request->arg(PREF_K_WIFI_IP_ADDR)));
+            cfg.wifiIpAddr = str2ip(request->arg(PREF_K_WIFI_IP_ADDR));
         }
         if (request->hasArg(PREF_K_WIFI_IP_MASK)) {
-            prefs.putUInt(PREF_K_WIFI_IP_MASK, str2ip(request->arg(PREF_K_WIFI_IP_MASK)));
+            cfg.wifiIpMask = str2ip(request->arg(PREF_K_WIFI_IP_MASK));
         }
         if (request->hasArg(PREF_K_WIFI_IP_GW)) {
-            prefs.putUInt(PREF_K_WIFI_IP_GW, str2ip(request->arg(PREF_K_WIFI_IP_GW)));
+            cfg.wifiIpGw = str2ip(request->arg(PREF_K_WIFI_IP_GW));
         }
         if (request->hasArg(PREF_K_WIFI_IP_DNS)) {
-            prefs.putUInt(PREF_K_WIFI_IP_DNS, str2ip(request->arg(PREF_K_WIFI_IP_DNS)));
+            cfg.wifiIpDns = str2ip(request->arg(PREF_K_WIFI_IP_DNS));
         }
 
         // Wireguard
-        prefs.putBool(PREF_K_WG_ENABLED, request->hasArg(PREF_K_WG_ENABLED));
+        cfg.wgEnabled = request->hasArg(PREF_K_WG_ENABLED);
         if (request->hasArg(PREF_K_WG_ENDPOINT))     {
-            prefs.putString(PREF_K_WG_ENDPOINT, request->arg(PREF_K_WG_ENDPOINT));
+            strlcpy(cfg.wgEndpoint, request->arg(PREF_K_WG_ENDPOINT).c_str(), sizeof(cfg.wgEndpoint));
         }
         if (request->hasArg(PREF_K_WG_PORT))     {
-            prefs.putUShort(PREF_K_WG_PORT, request->arg(PREF_K_WG_PORT).toInt());
+            cfg.wgPort = request->arg(PREF_K_WG_PORT).toInt();
         }
         if (request->hasArg(PREF_K_WG_PUB_KEY))     {
-            prefs.putString(PREF_K_WG_PUB_KEY, request->arg(PREF_K_WG_PUB_KEY));
+            strlcpy(cfg.wgPubKey, request->arg(PREF_K_WG_PUB_KEY).c_str(), sizeof(cfg.wgPubKey));
         }
         if (request->hasArg(PREF_K_WG_PRIVATE_KEY))     {
-            prefs.putString(PREF_K_WG_PRIVATE_KEY, request->arg(PREF_K_WG_PRIVATE_KEY));
+            strlcpy(cfg.wgPrivateKey, request->arg(PREF_K_WG_PRIVATE_KEY).c_str(), sizeof(cfg.wgPrivateKey));
         }
         if (request->hasArg(PREF_K_WG_LOCAL_IP)) {
-            prefs.putUInt(PREF_K_WG_LOCAL_IP, str2ip(request->arg(PREF_K_WG_LOCAL_IP)));
+            cfg.wgLocalIp = str2ip(request->arg(PREF_K_WG_LOCAL_IP));
         }
 
         // Influx
         if (request->hasArg(PREF_K_INFLUX_URL)) {
-            prefs.putString(PREF_K_INFLUX_URL, request->arg(PREF_K_INFLUX_URL));
+            strlcpy(cfg.influxUrl, request->arg(PREF_K_INFLUX_URL).c_str(), sizeof(cfg.influxUrl));
         }
         if (request->hasArg(PREF_K_INFLUX_ORG)) {
-            prefs.putString(PREF_K_INFLUX_ORG, request->arg(PREF_K_INFLUX_ORG));
+            strlcpy(cfg.influxOrg, request->arg(PREF_K_INFLUX_ORG).c_str(), sizeof(cfg.influxOrg));
         }
         if (request->hasArg(PREF_K_INFLUX_TOKEN)) {
-            prefs.putString(PREF_K_INFLUX_TOKEN, request->arg(PREF_K_INFLUX_TOKEN));
+            strlcpy(cfg.influxToken, request->arg(PREF_K_INFLUX_TOKEN).c_str(), sizeof(cfg.influxToken));
         }
         if (request->hasArg(PREF_K_INFLUX_BUCKET)) {
-            prefs.putString(PREF_K_INFLUX_BUCKET, request->arg(PREF_K_INFLUX_BUCKET));
+            strlcpy(cfg.influxBucket, request->arg(PREF_K_INFLUX_BUCKET).c_str(), sizeof(cfg.influxBucket));
         }
         if (request->hasArg(PREF_K_INFLUX_LOG))     {
-            prefs.putUShort(PREF_K_INFLUX_LOG, request->arg(PREF_K_INFLUX_LOG).toInt());
+            cfg.influxLog = request->arg(PREF_K_INFLUX_LOG).toInt();
         }
-        prefs.putUChar(PREF_K_INFLUX_DBVER, request->hasArg(PREF_K_INFLUX_DBVER) ? 2 : 1);
+        cfg.influxDbVer = request->hasArg(PREF_K_INFLUX_DBVER) ? 2 : 1;
+        cfg.influxGzip = request->hasArg(PREF_K_INFLUX_GZIP);
 
         // MQTT
         if (request->hasArg(PREF_K_MQTT_SERVER)) {
-            prefs.putUInt(PREF_K_MQTT_SERVER, str2ip(request->arg(PREF_K_MQTT_SERVER)));
+            cfg.mqttServer = str2ip(request->arg(PREF_K_MQTT_SERVER));
         }
         if (request->hasArg(PREF_K_MQTT_PORT)) {
-            prefs.putUShort(PREF_K_MQTT_PORT, request->arg(PREF_K_MQTT_PORT).toInt());
+            cfg.mqttPort = request->arg(PREF_K_MQTT_PORT).toInt();
         }
         if (request->hasArg(PREF_K_MQTT_USER)) {
-            prefs.putString(PREF_K_MQTT_USER, request->arg(PREF_K_MQTT_USER));
+            strlcpy(cfg.mqttUser, request->arg(PREF_K_MQTT_USER).c_str(), sizeof(cfg.mqttUser));
         }
         if (request->hasArg(PREF_K_MQTT_PASSWORD)) {
-            prefs.putString(PREF_K_MQTT_PASSWORD, request->arg(PREF_K_MQTT_PASSWORD));
+            strlcpy(cfg.mqttPassword, request->arg(PREF_K_MQTT_PASSWORD).c_str(), sizeof(cfg.mqttPassword));
         }
+        cfg.mqttJson = request->hasArg(PREF_K_MQTT_JSON);
 
-        createInfluxClient();
+        // discovery config depends on publish mode
+        if (cfg.mqttJson != config.mqttJson) {
+            for (AranetDevice* d : ar4devices) d->mqttReported = false;
+        }
+
+        // only changed values are written, tasks copy config under same lock
+        xSemaphoreTake(settingsMutex, portMAX_DELAY);
+        config = cfg;
+        int changed = settingsSave(&config);
+        xSemaphoreGive(settingsMutex);
+        Serial.printf("[CFG] %i settings changed\n", changed);
+
+        if (changed && EgressTask) xTaskNotifyGive(EgressTask); // recreates client
         ntpSyncTime = 0; // sync now
         ntpSyncFails = 0;
 
-        request->send(200, "text/html", printHtmlConfig(&prefs, true));
+        request->send(beginHtmlResponse(request, [](HtmlWriter* w) { printHtmlConfig(w, &config, true); }));
     });
 
     server.on("/data", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (!webAuthenticate(request)) return request->requestAuthentication();
 
-        request->send(200, "text/plain", printData());
+        sendCached(request, &dataCache, dataGeneration, printData);
     });
 
     server.on("/devices", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (!webAuthenticate(request)) return request->requestAuthentication();
 
-        request->send(200, "text/html", printDevicesPage());
+        request->send(beginHtmlResponse(request, [](HtmlWriter* w) { printDevicesPage(w); }));
     });
 
     server.on("/devices_list", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (!webAuthenticate(request)) return request->requestAuthentication();
 
-        request->send(200, "text/plain", printDevices());
+        sendCached(request, &devicesCache, devicesGeneration, printDevices);
     });
 
     server.on("/devices_add", HTTP_POST, [](AsyncWebServerRequest *request) {
@@ -704,19 +1092,19 @@ bool startWebserver() {
         String devicemac = request->arg("devicemac");
         NimBLEAddress addr(devicemac.c_str());
         AranetDevice* d = findScannedDevice(addr);
-        strcpy(d->name, name.c_str());
 
         if (!d) {
             request->send(200, "text/html", "unknown mac");
             return;
         }
 
+        strncpy(d->name, name.c_str(), sizeof(d->name) - 1);
+
         // move to saved devices
-        ar4devices.push_back(d);
-        newDevices.erase(
-            std::remove(newDevices.begin(), newDevices.end(), d),
-            newDevices.end()
-        );
+        if (!saveScannedDevice(d)) {
+            request->send(200, "text/html", "too many devices");
+            return;
+        }
 
         devicesSave();
         request->send(200, "text/html", "OK");
@@ -784,6 +1172,8 @@ bool startWebserver() {
         if (!webAuthenticate(request)) return request->requestAuthentication();
 
         request->send(200, "text/html", "restarting...");
+        cursorSave(ar4devices);
+        tsFlush(ar4devices);
         delay(1000);
         ESP.restart();
     });
@@ -826,6 +1216,133 @@ bool startWebserver() {
         d->pending = count;
     });
 
+    server.on("/series", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!webAuthenticate(request)) return request->requestAuthentication();
+
+        String devicemac = request->arg("devicemac");
+        NimBLEAddress addr(devicemac.c_str());
+        AranetDevice* d = findSavedDevice(addr);
+
+        if (!d) {
+            request->send(200, "text/html", "invalid mac");
+            return;
+        }
+
+        uint32_t to = request->hasArg("to") ? request->arg("to").toInt() : 0xFFFFFFFF;
+        uint32_t from = request->hasArg("from") ? request->arg("from").toInt() : 0;
+        if (request->hasArg("hrs") && ntpOk) {
+            from = time(nullptr) - request->arg("hrs").toInt() * 3600;
+        }
+
+        // timestamp;type;co2;temperature;pressure;humidity;rad_rate;rad_total
+        std::shared_ptr<TsQuery> query = std::make_shared<TsQuery>(macKey(addr.getNative()), from, to);
+        request->send(request->beginChunkedResponse("text/plain", [query](uint8_t *buf, size_t maxLen, size_t index) -> size_t {
+            return query->read(buf, maxLen);
+        }));
+    });
+
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!webAuthenticate(request)) return request->requestAuthentication();
+
+        std::shared_ptr<MetricsWriter> metrics = std::make_shared<MetricsWriter>(&ar4devices);
+        metrics->add("aranet_bridge_uptime_seconds", "Time since boot", millis() / 1000);
+        metrics->add("aranet_bridge_heap_free_bytes", "Free heap", ESP.getFreeHeap());
+        metrics->add("aranet_bridge_heap_min_free_bytes", "Lowest free heap since boot", ESP.getMinFreeHeap());
+        metrics->add("aranet_bridge_wifi_rssi_dbm", "WiFi signal strength", WiFi.RSSI());
+        metrics->add("aranet_bridge_adv_received_total", "Advertisements queued for processing", scanCallbacks.received, true);
+        metrics->add("aranet_bridge_adv_ignored_total", "Advertisements of unknown vendors", scanCallbacks.ignored, true);
+        metrics->add("aranet_bridge_adv_dropped_total", "Advertisements lost, queue full", scanCallbacks.dropped, true);
+        metrics->add("aranet_bridge_saved_devices", "Saved devices", ar4devices.size());
+        metrics->add("aranet_bridge_scanned_devices", "Devices seen in last 5 minutes, not saved", newDevices.size());
+        metrics->add("aranet_bridge_scan_window", "BLE scan window, 0.625 ms units", scanWindow);
+        metrics->add("aranet_bridge_gatt_busy", "GATT workers with job", gattBusySlots());
+        metrics->add("aranet_bridge_egress_depth", "Measurements waiting for encoding", egressDepth());
+        metrics->add("aranet_bridge_egress_dropped_total", "Measurements lost, egress queue full", egressDropped, true);
+        if (influxQueueOk) {
+            metrics->add("aranet_bridge_flash_queue_depth", "Measurements stored in flash queue", influxQueue.depth());
+        }
+        if (mqttQueue) {
+            metrics->add("aranet_bridge_mqtt_queue_depth", "Messages waiting for MQTT task", uxQueueMessagesWaiting(mqttQueue));
+        }
+
+        request->send(request->beginChunkedResponse("text/plain; version=0.0.4", [metrics](uint8_t *buf, size_t maxLen, size_t index) -> size_t {
+            return metrics->read(buf, maxLen);
+        }));
+    });
+
+#if CFG_CAPTURE
+    server.on("/capture_start", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!webAuthenticate(request)) return request->requestAuthentication();
+
+        if (!captureStart()) {
+            request->send(409, "text/html", "download in progress");
+            return;
+        }
+        Serial.printf("[CAPTURE] started, %u bytes\n", CFG_CAPTURE_BUFFER);
+        request->send(200, "text/html", "ok");
+    });
+
+    server.on("/capture", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!webAuthenticate(request)) return request->requestAuthentication();
+
+        std::shared_ptr<CaptureWriter> capture = std::make_shared<CaptureWriter>();
+        if (!capture->begin()) {
+            request->send(409, "text/html", "download in progress");
+            return;
+        }
+        AsyncWebServerResponse* response = request->beginResponse("application/octet-stream", capture->size(), [capture](uint8_t *buf, size_t maxLen, size_t index) -> size_t {
+            return capture->read(buf, maxLen, index);
+        });
+        response->addHeader("Content-Disposition", "attachment; filename=\"capture.bin\"");
+        request->send(response);
+    });
+#endif
+
+#if CFG_TRACE
+    server.on("/trace", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!webAuthenticate(request)) return request->requestAuthentication();
+
+        std::shared_ptr<TraceWriter> trace = std::make_shared<TraceWriter>();
+        if (!trace->begin()) {
+            request->send(503, "text/html", "no memory");
+            return;
+        }
+        request->send(request->beginChunkedResponse("application/json", [trace](uint8_t *buf, size_t maxLen, size_t index) -> size_t {
+            return trace->read(buf, maxLen);
+        }));
+    });
+#endif
+
+    server.on("/sensor_history", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!webAuthenticate(request)) return request->requestAuthentication();
+
+        String devicemac = request->arg("devicemac");
+        NimBLEAddress addr(devicemac.c_str());
+        AranetDevice* d = findSavedDevice(addr);
+
+        if (!d) {
+            request->send(200, "text/html", "invalid mac");
+            return;
+        }
+
+        if (std::atomic_load(&historyProxy)) {
+            request->send(503, "text/html", "busy");
+            return;
+        }
+
+        // start - first record index (1 - oldest), 0 to read latest records
+        uint16_t start = request->hasArg("start") ? request->arg("start").toInt() : 0;
+        uint16_t count = request->hasArg("count") ? request->arg("count").toInt() : 2048;
+        bool json = request->arg("format") == "json";
+
+        std::shared_ptr<HistoryProxyJob> job = std::make_shared<HistoryProxyJob>(macKey(addr.getNative()), start, count, json);
+        std::atomic_store(&historyProxy, job);
+
+        request->send(request->beginChunkedResponse(json ? "application/json" : "text/plain", [job](uint8_t *buf, size_t maxLen, size_t index) -> size_t {
+            return job->read(buf, maxLen);
+        }));
+    });
+
     server.on("/devices_template", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (!webAuthenticate(request)) return request->requestAuthentication();
         request->send(200, "text/html", deviceCardHtml);
@@ -864,6 +1381,93 @@ void task_sleep(uint32_t ms) {
     vTaskDelay(ms / portTICK_PERIOD_MS);
 }
 
+void startMqttTask() {
+    mqttQueue = xQueueCreate(CFG_MQTT_QUEUE_LEN, sizeof(MqttMessage));
+
+    xTaskCreatePinnedToCore(
+        MqttTaskCode,   /* Task function. */
+        "MqttTask",     /* name of task. */
+        6144,           /* Stack size of task */
+        NULL,           /* parameter of the task */
+        1,              /* priority of the task */
+        &MqttTask,      /* Task handle to keep track of created task */
+        0               /* pin task to core 0 */
+    );
+}
+
+/*
+    Queue reading for MQTT task, never blocks
+*/
+void mqttQueueReading(AranetDevice* d, AranetData* data) {
+    if (!mqttQueue || !config.mqttServer) return;
+
+    MqttMessage msg;
+    strlcpy(msg.topic, d->mqttTopic, sizeof(msg.topic));
+
+    if (!d->mqttReported) {
+        msg.kind = MQTT_MSG_CONFIG;
+        if (xQueueSend(mqttQueue, &msg, 0) == pdTRUE) d->mqttReported = true;
+        else mqttDropped++;
+    }
+
+    msg.kind = MQTT_MSG_STATE;
+    msg.data = *data;
+    if (xQueueSend(mqttQueue, &msg, 0) != pdTRUE) mqttDropped++;
+}
+
+/*
+    Owns MQTT client: keeps connection alive, reconnects with backoff
+    and sends queued messages
+*/
+void MqttTaskCode(void * pvParameters) {
+    MqttMessage msg;
+    uint32_t retryAt = 0;
+    uint32_t retryDelay = 0;
+    uint32_t generation = settingsGeneration;
+    settingsSnapshot(&mqttConfig);
+
+    for (;;) {
+        // server or credentials may have changed
+        if (generation != settingsGeneration) {
+            generation = settingsGeneration;
+            settingsSnapshot(&mqttConfig);
+            mqttClient.stop();
+            retryDelay = 0;
+        }
+
+        if (!mqttConfig.mqttServer) {
+            xQueueReset(mqttQueue);
+            task_sleep(1000);
+            continue;
+        }
+
+        if (!mqttClient.connected()) {
+            if (WiFi.status() != WL_CONNECTED || (retryDelay && (int32_t) (millis() - retryAt) < 0)) {
+                task_sleep(100);
+                continue;
+            }
+
+            if (!mqttConnect(&mqttClient, &mqttConfig)) {
+                retryDelay = retryDelay ? retryDelay * 2 : CFG_MQTT_RETRY_INTERVAL;
+                if (retryDelay > CFG_MQTT_RETRY_MAX) retryDelay = CFG_MQTT_RETRY_MAX;
+                retryAt = millis() + retryDelay;
+                Serial.printf("[MQTT] Connect failed (%i), retry in %lu ms\n", mqttClient.connectError(), retryDelay);
+                continue;
+            }
+
+            Serial.println("[MQTT] Connected");
+            mqttReconnects++;
+            retryDelay = 0;
+        }
+
+        mqttClient.poll(); // keepalive
+
+        if (xQueueReceive(mqttQueue, &msg, 100 / portTICK_PERIOD_MS) == pdTRUE) {
+            mqttSendMessage(&mqttClient, &mqttConfig, &msg);
+        }
+    }
+}
+
 void startNtpSyncTask() {
     // Start NTP sync task
     xTaskCreatePinnedToCore(
@@ -877,10 +1481,33 @@ void startNtpSyncTask() {
     );
 }
 
+void startHistoryUploadTask() {
+    historyQueue = xQueueCreate(CFG_GATT_POOL_SIZE, sizeof(HistoryChunk));
+
+    xTaskCreatePinnedToCore(
+        HistoryUploadTaskCode,  /* Task function. */
+        "HistoryUploadTask",    /* name of task. */
+        8192,                   /* Stack size of task */
+        NULL,                   /* parameter of the task */
+        1,                      /* priority of the task */
+        &HistoryUploadTask,     /* Task handle to keep track of created task */
+        0                       /* pin task to core 0 */
+    );
+}
+
+void HistoryUploadTaskCode(void * pvParameters) {
+    HistoryChunk chunk;
+    for (;;) {
+        if (xQueueReceive(historyQueue, &chunk, portMAX_DELAY) == pdTRUE) {
+            historyUploadChunk(&chunk, &egressHistory);
+            xSemaphoreGive(chunk.release);
+        }
+    }
+}
+
 bool ntpSync() {
     Serial.println("NTP: sync time");
-    String ntpUrl = prefs.getString(PREF_K_NTP_URL);
-    configTime(0, 0, ntpUrl.c_str());
+    configTime(0, 0, config.ntpUrl);
     struct tm timeinfo;
 
     uint8_t loops = 0;
@@ -973,7 +1600,9 @@ bool cancelWatchdog() {
 }
 
 void log(String msg, ILog level) {
-    influxSendLog(influxClient, &prefs, msg, level);
+    xSemaphoreTake(influxClientMutex, portMAX_DELAY);
+    influxSendLog(influxClient, &config, msg, level);
+    xSemaphoreGive(influxClientMutex);
 }
 
 const char* rst_reasons[] = {
@@ -1017,84 +1646,132 @@ const char* getResetReason(RESET_REASON reason) {
 }
 
 AranetDevice* findScannedDevice(NimBLEAddress macaddr) {
-    AranetDevice* d = nullptr;
-
-    for (AranetDevice* d : newDevices) {
-        if (d->addr.equals(macaddr)) return d;
-    }
+    portENTER_CRITICAL(&devicesMux);
+    AranetDevice* d = scannedIndex.find(macKey(macaddr.getNative()));
+    portEXIT_CRITICAL(&devicesMux);
+    return d;
+}
 
-    return nullptr;
+AranetDevice* findSavedDevice(uint64_t key) {
+    portENTER_CRITICAL(&devicesMux);
+    AranetDevice* d = savedIndex.find(key);
+    portEXIT_CRITICAL(&devicesMux);
+    return d;
 }
 
 AranetDevice* findSavedDevice(NimBLEAddress macaddr) {
-    AranetDevice* d = nullptr;
-
-    for (AranetDevice* d : ar4devices) {
-        if (d->addr.equals(macaddr)) return d;
-    }
-
-    return nullptr;
+    return findSavedDevice(macKey(macaddr.getNative()));
 }
 
-AranetDevice* findSavedDevice(NimBLEAdvertisedDevice* adv) {
+AranetDevice* findSavedDevice(AdvRecord* adv) {
     // find matching aranet device
-    return findSavedDevice(adv->getAddress());
+    return findSavedDevice(macKey(adv->addr));
 }
 
-void registerScannedDevice(NimBLEAdvertisedDevice* adv, const char* name) {
-    // find existing
-    NimBLEAddress umac = adv->getAddress();
-    int rssi = adv->getRSSI();
+bool addSavedDevice(AranetDevice* d) {
+    uint64_t key = macKey(d->addr.getNative());
 
-    AranetDevice* dev = nullptr;
+    portENTER_CRITICAL(&devicesMux);
+    bool added = !savedIndex.find(key) && savedIndex.insert(key, d);
+    portEXIT_CRITICAL(&devicesMux);
+    if (!added) return false;
 
-    for (AranetDevice* d : ar4devices) {
-        if (d->equals(umac)) {
-            dev = d;
-            break;
-        }
-    }
+    mqttBuildTopic(d);
+    bleStatsAdd(key); // no stats if table is full
+    ar4devices.push_back(d);
+    savedGeneration++;
+    return true;
+}
 
-    if (!dev) {
-        // try scanned
-        for (AranetDevice* d : newDevices) {
-            NimBLEAddress dmac = NimBLEAddress(d->addr);
-            if (d->equals(umac)) {
-                dev = d;
-                if (name == nullptr) strcpy(dev->name, adv->getName().c_str());
-                break;
+/*
+    Move device from scanned to saved devices
+*/
+bool saveScannedDevice(AranetDevice* d) {
+    if (!addSavedDevice(d)) return false;
+
+    portENTER_CRITICAL(&devicesMux);
+    scannedIndex.remove(macKey(d->addr.getNative()));
+    newDevices.erase(
+        std::remove(newDevices.begin(), newDevices.end(), d),
+        newDevices.end()
+    );
+    portEXIT_CRITICAL(&devicesMux);
+    return true;
+}
+
+void registerScannedDevice(AdvRecord* adv, const char* name) {
+    uint64_t key = macKey(adv->addr);
+
+    // find existing, saved or scanned
+    portENTER_CRITICAL(&devicesMux);
+    AranetDevice* dev = savedIndex.find(key);
+    bool saved = dev != nullptr;
+    if (!saved) dev = scannedIndex.find(key);
+    bool full = scannedIndex.full();
+    portEXIT_CRITICAL(&devicesMux);
+
+    // device list is pushed to web UI only for new or renamed device
+    bool changed = false;
+
+    if (!saved) {
+        if (dev) {
+            char fresh[sizeof(dev->name)];
+            if (name == nullptr && adv->info.nameLen > 0) {
+                adv->copyName(fresh, sizeof(fresh));
+                changed = strcmp(fresh, dev->name) != 0;
+                if (changed) strcpy(dev->name, fresh);
             }
-        }
+        } else {
+            // make new, if there is space left
+            if (full) return;
 
-        // make new
-        if (!dev) {
             dev = new AranetDevice();
             if (name != nullptr) {
                 strcpy(dev->name, name);
             } else {
-                strcpy(dev->name, adv->getName().c_str());
+                adv->copyName(dev->name, sizeof(dev->name));
             }
-            dev->addr = umac;
+            dev->addr = adv->address();
+
+            // capacity is reserved, push_back does not allocate
+            portENTER_CRITICAL(&devicesMux);
+            scannedIndex.insert(key, dev);
             newDevices.push_back(dev);
+            portEXIT_CRITICAL(&devicesMux);
+            changed = true;
         }
     }
 
-    if (dev) {
-        dev->lastSeen = millis();
-        dev->rssi = rssi;
-    }
+    dev->lastSeen = millis();
+    dev->rssi = adv->rssi;
+    if (changed) markChanged(dev, CHANGED_DEVICES);
 }
 
+/*
+    Drop devices not seen for 5 minutes. Remaining devices keep
+    their order, so list in web UI does not jump.
+*/
 void cleanupScannedDevices() {
-    for (std::vector<AranetDevice*>::iterator it=newDevices.begin(); it!=newDevices.end(); ) {
-        AranetDevice* d = *it;
-        if ((millis() - d->lastSeen) > (5 * 60 * 1000)) {
-            it = newDevices.erase(it);
-            delete d;
+    AranetDevice* expired[16];
+    uint8_t count = 0;
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&devicesMux);
+    size_t kept = 0;
+    for (AranetDevice* d : newDevices) {
+        if (count < 16 && (now - d->lastSeen) > (5 * 60 * 1000)) {
+            scannedIndex.remove(macKey(d->addr.getNative()));
+            expired[count++] = d;
         } else {
-            ++it;
+            newDevices[kept++] = d;
         }
     }
+    newDevices.resize(kept);
+    portEXIT_CRITICAL(&devicesMux);
+
+    // rest is removed on next call
+    for (uint8_t i = 0; i < count; i++) delete expired[i];
+    if (count) markChanged(nullptr, CHANGED_DEVICES);
 }
 
 void printScannecDevices() {
@@ -1107,15 +1784,15 @@ void printScannecDevices() {
 }
 
 void setupWireguard() {
-    if (!isAp && prefs.getBool(PREF_K_WG_ENABLED)) {
+    if (!isAp && config.wgEnabled) {
         Serial.println("Initializing WireGuard...");
-        IPAddress local_ip(htobe32(prefs.getUInt(PREF_K_WG_LOCAL_IP)));
+        IPAddress local_ip(htobe32(config.wgLocalIp));
         wg.begin(
             local_ip,
-            prefs.getString(PREF_K_WG_PRIVATE_KEY).c_str(),
-            prefs.getString(PREF_K_WG_ENDPOINT).c_str(),
-            prefs.getString(PREF_K_WG_PUB_KEY).c_str(),
-            prefs.getUShort(PREF_K_WG_PORT, 13231));
+            config.wgPrivateKey,
+            config.wgEndpoint,
+            config.wgPubKey,
+            config.wgPort);
     }
 }
 
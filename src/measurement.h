@@ -0,0 +1,93 @@
+#ifndef __AR4BR_MEASUREMENT_H
+#define __AR4BR_MEASUREMENT_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define MEAS_KIND_ARANET     1
+#define MEAS_KIND_AIRVALENT  2
+#define MEAS_KIND_MIKROTIK   3 // not stored in flash queue
+
+#define MEAS_NO_TEMPERATURE  INT16_MIN
+
+/*
+    Fixed size binary reading, used where measurements are queued or stored
+    instead of being sent right away.
+*/
+typedef struct {
+    uint8_t  magic;        // used by storage
+    uint8_t  kind;         // MEAS_KIND_*
+    uint8_t  type;         // AranetType, beacon flags for MEAS_KIND_MIKROTIK
+    uint8_t  battery;
+    uint8_t  mac[6];       // native (little endian) order
+    int8_t   rssi;
+    uint8_t  crc;          // used by storage
+    uint32_t timestamp;    // unix time, 0 - not known
+    uint16_t interval;
+    uint16_t ago;
+    union {
+        struct {
+            uint16_t co2;
+            uint16_t temperature;
+            uint16_t pressure;
+            uint16_t humidity;
+        } env;
+        struct {
+            uint32_t rate;
+            uint32_t total;
+        } rad;
+        struct {
+            int16_t temperature; // 1/100 C, MEAS_NO_TEMPERATURE if not present
+            int16_t accel[3];    // 1/1000 g
+        } tag;
+    };
+    uint32_t reserved;
+} Measurement;
+
+static_assert(sizeof(Measurement) == 32, "Measurement must be 32 bytes");
+
+#ifdef ARDUINO
+#include "Aranet4.h"
+
+void measurementFromData(Measurement* m, uint8_t kind, const uint8_t* mac, AranetData* data, uint32_t timestamp, int8_t rssi) {
+    memset(m, 0, sizeof(Measurement));
+    m->kind = kind;
+    m->type = data->type;
+    m->battery = data->battery;
+    memcpy(m->mac, mac, 6);
+    m->rssi = rssi;
+    m->timestamp = timestamp;
+    m->interval = data->interval;
+    m->ago = data->ago;
+
+    if (data->type == AranetType::ARANET_RADIATION) {
+        m->rad.rate = data->radiation_rate;
+        m->rad.total = data->radiation_total;
+    } else {
+        m->env.co2 = data->co2;
+        m->env.temperature = data->temperature;
+        m->env.pressure = data->pressure;
+        m->env.humidity = data->humidity;
+    }
+}
+
+void measurementToData(Measurement* m, AranetData* data) {
+    data->type = (AranetType) m->type;
+    data->battery = m->battery;
+    data->interval = m->interval;
+    data->ago = m->ago;
+    data->radiation_duration = 0;
+
+    if (data->type == AranetType::ARANET_RADIATION) {
+        data->radiation_rate = m->rad.rate;
+        data->radiation_total = m->rad.total;
+    } else {
+        data->co2 = m->env.co2;
+        data->temperature = m->env.temperature;
+        data->pressure = m->env.pressure;
+        data->humidity = m->env.humidity;
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef __AR4BR_METRICS_H
+#define __AR4BR_METRICS_H
+
+#include <vector>
+#include "config.h"
+#include "types.h"
+
+/*
+    Prometheus text format for /metrics. Lines are generated one at a time
+    straight into response chunks, position is kept between chunks, so no
+    page buffer is needed. Bridge gauges are captured when request starts,
+    readings are read from devices as they are written. Runs in web server
+    task and takes no locks used by BLE side.
+*/
+
+typedef struct {
+    const char* name;
+    const char* help;
+    double value;
+    bool counter;
+} MetricGauge;
+
+typedef struct {
+    const char* name;
+    const char* help;
+    bool (*value)(AranetDevice* d, double* v); // false - not available
+} DeviceMetric;
+
+// Airvalent readings are stored as ARANET4 type, with own units
+inline bool metricsAirvalent(AranetDevice* d) {
+    return d->kind == MEAS_KIND_AIRVALENT;
+}
+
+// same scaling as InfluxDB fields, influxWriteAranet() and influxWriteAirvalent()
+static const DeviceMetric deviceMetrics[] = {
+    { "aranet_co2_ppm", "CO2 concentration", [](AranetDevice* d, double* v) {
+        *v = d->data.co2;
+        return d->data.type == AranetType::ARANET4;
+    } },
+    { "aranet_temperature_celsius", "Temperature", [](AranetDevice* d, double* v) {
+        *v = d->data.temperature / (metricsAirvalent(d) ? 10.0 : 20.0);
+        return d->data.type == AranetType::ARANET4 || d->data.type == AranetType::ARANET2;
+    } },
+    { "aranet_humidity_percent", "Relative humidity", [](AranetDevice* d, double* v) {
+        bool tenths = metricsAirvalent(d) || d->data.type == AranetType::ARANET2;
+        *v = tenths ? d->data.humidity / 10.0 : d->data.humidity;
+        return d->data.type == AranetType::ARANET4 || d->data.type == AranetType::ARANET2;
+    } },
+    { "aranet_pressure_hpa", "Atmospheric pressure", [](AranetDevice* d, double* v) {
+        *v = metricsAirvalent(d) ? d->data.pressure : d->data.pressure / 10.0;
+        return d->data.type == AranetType::ARANET4;
+    } },
+    { "aranet_radiation_rate", "Radiation dose rate", [](AranetDevice* d, double* v) {
+        *v = d->data.radiation_rate / 1000.0;
+        return d->data.type == AranetType::ARANET_RADIATION;
+    } },
+    { "aranet_radiation_total", "Radiation total dose", [](AranetDevice* d, double* v) {
+        *v = d->data.radiation_total / 1000.0;
+        return d->data.type == AranetType::ARANET_RADIATION;
+    } },
+    { "aranet_battery_percent", "Battery level", [](AranetDevice* d, double* v) {
+        *v = d->data.battery;
+        return true;
+    } },
+    { "aranet_reading_age_seconds", "Time since sensor measured latest reading", [](AranetDevice* d, double* v) {
+        *v = (millis() - d->updated) / 1000 + d->data.ago;
+        return true;
+    } },
+};
+
+#define METRICS_GAUGES_MAX 20
+#define METRICS_DEVICE_COUNT (sizeof(deviceMetrics) / sizeof(deviceMetrics[0]))
+
+class MetricsWriter {
+    std::vector<AranetDevice*>* devices;
+    MetricGauge gauges[METRICS_GAUGES_MAX];
+    uint8_t gaugeCount = 0;
+
+    // position in output
+    uint8_t gauge = 0;
+    uint8_t metric = 0;
+    size_t device = 0;
+    bool headerDone = false;
+
+    char line[256];
+    size_t lineLen = 0;
+    size_t linePos = 0;
+
+    void append(const char* fmt, ...) {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(line + lineLen, sizeof(line) - lineLen, fmt, args);
+        va_end(args);
+        if (n > 0) lineLen += min((size_t) n, sizeof(line) - lineLen - 1);
+    }
+
+    void appendHeader(const char* name, const char* help, bool counter) {
+        append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, counter ? "counter" : "gauge");
+    }
+
+    void appendLabel(const char* value) {
+        for (; *value && lineLen < sizeof(line) - 4; value++) {
+            char c = *value;
+            if (c == '\\' || c == '"') line[lineLen++] = '\\';
+            else if (c == '\n') { line[lineLen++] = '\\'; c = 'n'; }
+            line[lineLen++] = c;
+        }
+        line[lineLen] = 0;
+    }
+
+    /*
+        Generate next line(s)
+        @return false at end of output
+    */
+    bool next() {
+        lineLen = linePos = 0;
+        while (lineLen == 0) {
+            if (gauge < gaugeCount) {
+                MetricGauge* g = &gauges[gauge++];
+                appendHeader(g->name, g->help, g->counter);
+                append("%s %.10g\n", g->name, g->value);
+            } else if (metric < METRICS_DEVICE_COUNT) {
+                const DeviceMetric* m = &deviceMetrics[metric];
+                double v;
+                if (!headerDone) {
+                    appendHeader(m->name, m->help, false);
+                    headerDone = true;
+                } else if (device < devices->size()) {
+                    AranetDevice* d = (*devices)[device++];
+                    if (d->enabled && d->updated && m->value(d, &v)) {
+                        append("%s{name=\"", m->name);
+                        appendLabel(d->name);
+                        append("\",mac=\"%s\"} %.10g\n", d->addr.toString().c_str(), v);
+                    }
+                } else {
+                    metric++;
+                    device = 0;
+                    headerDone = false;
+                }
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    MetricsWriter(std::vector<AranetDevice*>* devices) : devices(devices) {}
+
+    void add(const char* name, const char* help, double value, bool counter = false) {
+        if (gaugeCount < METRICS_GAUGES_MAX) gauges[gaugeCount++] = { name, help, value, counter };
+    }
+
+    size_t read(uint8_t* buf, size_t maxLen) {
+        size_t len = 0;
+        while (len < maxLen) {
+            if (linePos == lineLen) {
+                if (!next()) break;
+            }
+            size_t n = min(lineLen - linePos, maxLen - len);
+            memcpy(buf + len, line + linePos, n);
+            linePos += n;
+            len += n;
+        }
+        return len;
+    }
+};
+
+#endif
@@ -1,8 +1,10 @@
 #ifndef __MQTT_H
 #define __MQTT_H
 
-#include "../main.h"
+#include <WiFi.h>
 #include "../types.h"
+#include "../settings.h"
+#include "../trace.h"
 
 // https://github.com/arduino-libraries/ArduinoMqttClient/
 #include <ArduinoMqttClient.h>
@@ -10,7 +12,8 @@
 #include "Aranet4.h"
 
 
-const char* mqttConfigTemplate = "{\"device_class\": \"%s\", \"name\": \"%s %s\", \"state_topic\": \"%s\", \"unit_of_measurement\": \"%s\", \"uniq_id\":\"sensor.%s\"}";
+// state_topic and value template are filled in by mqttSendConfig
+const char* mqttConfigTemplate = "{\"device_class\":\"%s\",\"name\":\"%s %s\",\"state_topic\":\"%s%s\",%s\"unit_of_measurement\":\"%s\",\"uniq_id\":\"sensor.%s.%s\"}";
 
 
 String mqttGetDeviceId() {
@@ -24,40 +27,59 @@ String mqttGetDeviceId() {
     return String(buf);
 }
 
-String mqttGetAranetName(AranetDevice* device) {
-    char devname[24];
-    memcpy(devname, device->name, 24);
-
-    for (uint8_t i=0; i < 24; i++) {
-        char c = devname[i];
-        if (c == 0) break;
-        else if (c == ' ') devname[i] = '-';
-        else if (c >= 'A' && c <= 'Z') {
-            devname[i] = c + 32;
-        }
+/*
+    Build device topic once, when device is added or renamed
+*/
+void mqttBuildTopic(AranetDevice* device) {
+    int len = snprintf(device->mqttTopic, sizeof(device->mqttTopic), "%s", CFG_MQTT_TOPIC_PREFIX);
+    char* p = device->mqttTopic + len;
+    char* end = device->mqttTopic + sizeof(device->mqttTopic) - 1;
+
+    for (const char* c = device->name; *c && p < end; c++) {
+        if (*c == ' ') *p++ = '-';
+        else if (*c >= 'A' && *c <= 'Z') *p++ = *c + 32;
+        else *p++ = *c;
     }
+    *p = 0;
+}
 
-    return String(devname);
+/*
+    Start message on "<device topic><suffix>"
+*/
+void mqttBeginMessage(MqttClient* client, const char* deviceTopic, const char* suffix) {
+    char topic[CFG_MQTT_TOPIC_SIZE + 16];
+    snprintf(topic, sizeof(topic), "%s%s", deviceTopic, suffix);
+    client->beginMessage(topic);
 }
 
+enum MqttMessageKind : uint8_t {
+    MQTT_MSG_STATE,
+    MQTT_MSG_CONFIG // Home Assistant discovery
+};
+
 /*
-   Connectto mqtt server
+    Publish request, queued by BLE side and sent by MQTT task
 */
-int mqttConnect(MqttClient* client, Preferences* prefs) {
-    String usr = prefs->getString(PREF_K_MQTT_USER);
-    String pwd = prefs->getString(PREF_K_MQTT_PASSWORD);
+typedef struct {
+    MqttMessageKind kind;
+    char topic[CFG_MQTT_TOPIC_SIZE];
+    AranetData data;
+} MqttMessage;
 
-    client->setUsernamePassword(usr,pwd);
+/*
+   Connectto mqtt server
+*/
+int mqttConnect(MqttClient* client, NodeConfig* cfg) {
+    client->setUsernamePassword(cfg->mqttUser, cfg->mqttPassword);
     client->setId(mqttGetDeviceId());
+    client->setConnectionTimeout(CFG_MQTT_CONNECT_TIMEOUT);
 
-    uint16_t port = prefs->getUShort(PREF_K_MQTT_PORT, CFG_DEF_MQTT_PORT);
-    uint32_t addr = prefs->getUInt(PREF_K_MQTT_SERVER);
+    uint16_t port = cfg->mqttPort;
+    uint32_t addr = cfg->mqttServer;
     if (addr != 0 && port != 0) {
-        if (addr != 0) {
-            char mqttIpAddr[16];
-            ip2str(addr, mqttIpAddr);
-            return client->connect(mqttIpAddr, port);
-        }
+        char mqttIpAddr[16];
+        ip2str(addr, mqttIpAddr);
+        return client->connect(mqttIpAddr, port);
     }
     return 0;
 }
@@ -65,38 +87,54 @@ int mqttConnect(MqttClient* client, Preferences* prefs) {
 /*
     Send point to mqtt server
 */
-void mqttSendPoint(MqttClient* client, Preferences *prefs, AranetDevice* device, AranetData *data) {
-    if (!client->connected()) mqttConnect(client, prefs);
+void mqttSendPoint(MqttClient* client, NodeConfig* cfg, const char* topic, AranetData *data) {
+    if (cfg->mqttJson) {
+        char buf[128];
+        int len = 0;
+        if (data->type == AranetType::ARANET2) {
+            len = snprintf(buf, sizeof(buf), "{\"temperature\":%.2f,\"humidity\":%.2f,",
+                data->temperature / 20.0, data->humidity / 10.0);
+        } else if (data->type == AranetType::ARANET4) {
+            len = snprintf(buf, sizeof(buf), "{\"co2\":%u,\"temperature\":%.2f,\"pressure\":%.2f,\"humidity\":%u,",
+                data->co2, data->temperature / 20.0, data->pressure / 10.0, data->humidity);
+        } else {
+            len = snprintf(buf, sizeof(buf), "{");
+        }
+        snprintf(buf + len, sizeof(buf) - len, "\"battery\":%u}", data->battery);
 
-    String topic = "aranet4bridge/sensor/" + mqttGetAranetName(device);
+        mqttBeginMessage(client, topic, "/state");
+        client->print(buf);
+        client->endMessage();
+        return;
+    }
 
     if (data->type == AranetType::ARANET2) {
-        client->beginMessage(topic + "/temperature");
+        mqttBeginMessage(client, topic, "/temperature");
         client->print(data->temperature / 20.0);
         client->endMessage();
 
-        client->beginMessage(topic + "/humidity");
+        mqttBeginMessage(client, topic, "/humidity");
         client->print(data->humidity / 10.0);
         client->endMessage();
     } else if (data->type == AranetType::ARANET4) {
-        client->beginMessage(topic + "/co2");
+        mqttBeginMessage(client, topic, "/co2");
         client->print(data->co2);
         client->endMessage();
 
-        client->beginMessage(topic + "/temperature");
+        mqttBeginMessage(client, topic, "/temperature");
         client->print(data->temperature / 20.0);
         client->endMessage();
 
-        client->beginMessage(topic + "/pressure");
+        mqttBeginMessage(client, topic, "/pressure");
         client->print(data->pressure / 10.0);
         client->endMessage();
 
-        client->beginMessage(topic + "/humidity");
+        mqttBeginMessage(client, topic, "/humidity");
         client->print(data->humidity);
         client->endMessage();
     }
 
-    client->beginMessage(topic + "/battery");
+    mqttBeginMessage(client, topic, "/battery");
     client->print(data->battery);
     client->endMessage();
 }
@@ -104,42 +142,54 @@ void mqttSendPoint(MqttClient* client, Preferences *prefs, AranetDevice* device,
 /*
     Send home asssistant compatible config to mqtt server
 */
+void mqttSendConfig(MqttClient* client, NodeConfig* cfg, const char* topic) {
+    static const struct {
+        const char* deviceClass;
+        const char* label;
+        const char* field;
+        const char* unit;
+        const char* suffix;
+    } sensors[] = {
+        { "carbon_dioxide", "CO2",         "co2",         "ppm", "-co2/config" },
+        { "temperature",    "Temperature", "temperature", "C",   "-t/config" },
+        { "pressure",       "Pressure",    "pressure",    "hPa", "-p/config" },
+        { "humidity",       "Humidity",    "humidity",    "%",   "-h/config" },
+        { "battery",        "Battery",     "battery",     "%",   "-b/config" },
+    };
+
+    // device name part of topic
+    const char* deviceName = topic + strlen(CFG_MQTT_TOPIC_PREFIX);
+
+    char buf[384];
+    char state[20];
+    char tmpl[48];
+
+    for (auto &s : sensors) {
+        if (cfg->mqttJson) {
+            strcpy(state, "/state");
+            snprintf(tmpl, sizeof(tmpl), "\"value_template\":\"{{ value_json.%s }}\",", s.field);
+        } else {
+            snprintf(state, sizeof(state), "/%s", s.field);
+            tmpl[0] = 0;
+        }
 
-void mqttSendConfig(MqttClient* client, Preferences *prefs, AranetDevice* device) {
-    if (!client->connected()) mqttConnect(client, prefs);
-
-    String deviceNameStr = mqttGetAranetName(device);
-    String topic = "aranet4bridge/sensor/" + deviceNameStr;
-    const char* deviceName = deviceNameStr.c_str();
-
-
-    char buf[256];
-
-    sprintf(buf, mqttConfigTemplate, "carbon_dioxide", deviceName, "CO2", (topic + "/co2").c_str(), "ppm", (deviceNameStr + ".co2").c_str(),(deviceNameStr + ".co2").c_str());
-    client->beginMessage(topic + "-co2/config");
-    client->print(buf);
-    client->endMessage();
-
-    sprintf(buf, mqttConfigTemplate, "temperature", deviceName, "Temperature", (topic + "/temperature").c_str(), "C", (deviceNameStr + ".temperature").c_str(),(deviceNameStr + ".temperature").c_str());
-    client->beginMessage(topic + "-t/config");
-    client->print(buf);
-    client->endMessage();
-
-    sprintf(buf, mqttConfigTemplate, "pressure", deviceName, "Pressure", (topic + "/pressure").c_str(), "hPa", (deviceNameStr + ".pressure").c_str(),(deviceNameStr + ".pressure").c_str());
-    client->beginMessage(topic + "-p/config");
-    client->print(buf);
-    client->endMessage();
+        snprintf(buf, sizeof(buf), mqttConfigTemplate, s.deviceClass, deviceName, s.label,
+            topic, state, tmpl, s.unit, deviceName, s.field);
 
-    sprintf(buf, mqttConfigTemplate, "humidity", deviceName, "Humidity", (topic + "/humidity").c_str(), "%", (deviceNameStr + ".humidity").c_str(),(deviceNameStr + ".humidity").c_str());
-    client->beginMessage(topic + "-h/config");
-    client->print(buf);
-    client->endMessage();
+        mqttBeginMessage(client, topic, s.suffix);
+        client->print(buf);
+        client->endMessage();
+    }
+}
 
-    sprintf(buf, mqttConfigTemplate, "battery", deviceName, "Battery", (topic + "/battery").c_str(), "%", (deviceNameStr + ".battery").c_str(), (deviceNameStr + ".battery").c_str());
-    client->beginMessage(topic + "-b/config");
-    client->print(buf);
-    client->endMessage();
+void mqttSendMessage(MqttClient* client, NodeConfig* cfg, MqttMessage* msg) {
+    TRACE_SCOPE("mqtt.send");
+    if (msg->kind == MQTT_MSG_CONFIG) {
+        mqttSendConfig(client, cfg, msg->topic);
+    } else {
+        mqttSendPoint(client, cfg, msg->topic, &msg->data);
+    }
 }
 
 
-#endif
\ No newline at end of file
+#endif
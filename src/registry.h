@@ -0,0 +1,115 @@
+#ifndef __AR4BR_REGISTRY_H
+#define __AR4BR_REGISTRY_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+    48-bit MAC address packed in integer. Bit 48 is always set,
+    so valid key is never 0 (empty slot marker).
+*/
+inline uint64_t macKey(const uint8_t* addr) {
+    uint64_t key = 1ULL << 48;
+    for (uint8_t i = 0; i < 6; i++) {
+        key |= ((uint64_t) addr[i]) << (i * 8);
+    }
+    return key;
+}
+
+/*
+    Fixed size open-addressing hash table: MAC -> device pointer.
+    Linear probing with backward shift deletion, so there are no tombstones
+    and lookups stay short after many insert/remove cycles.
+    N must be power of two. Table refuses inserts above 3/4 load.
+*/
+template <typename T, uint16_t N>
+class DeviceIndex {
+    static_assert(N >= 4 && (N & (N - 1)) == 0, "index size must be power of two");
+
+    typedef struct {
+        uint64_t key;
+        T* value;
+    } Slot;
+
+    Slot slots[N];
+    uint16_t count = 0;
+
+    static uint16_t home(uint64_t key) {
+        return (uint16_t) ((key * 0x9E3779B97F4A7C15ULL) >> 48) & (N - 1);
+    }
+
+public:
+    DeviceIndex() {
+        clear();
+    }
+
+    void clear() {
+        memset(slots, 0, sizeof(slots));
+        count = 0;
+    }
+
+    T* find(uint64_t key) {
+        for (uint16_t i = home(key);; i = (i + 1) & (N - 1)) {
+            if (slots[i].key == key) return slots[i].value;
+            if (slots[i].key == 0) return nullptr;
+        }
+    }
+
+    /*
+        Insert or replace value
+        @return false if table is full
+    */
+    bool insert(uint64_t key, T* value) {
+        uint16_t i = home(key);
+        for (;; i = (i + 1) & (N - 1)) {
+            if (slots[i].key == key) {
+                slots[i].value = value;
+                return true;
+            }
+            if (slots[i].key == 0) break;
+        }
+
+        if (full()) return false;
+
+        slots[i].key = key;
+        slots[i].value = value;
+        count++;
+        return true;
+    }
+
+    bool remove(uint64_t key) {
+        uint16_t i = home(key);
+        for (;; i = (i + 1) & (N - 1)) {
+            if (slots[i].key == 0) return false;
+            if (slots[i].key == key) break;
+        }
+
+        // shift following entries back, if it does not move them before their home slot
+        uint16_t j = i;
+        for (;;) {
+            j = (j + 1) & (N - 1);
+            if (slots[j].key == 0) break;
+
+            uint16_t h = home(slots[j].key);
+            if (((j - h) & (N - 1)) >= ((j - i) & (N - 1))) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+
+        slots[i].key = 0;
+        slots[i].value = nullptr;
+        count--;
+        return true;
+    }
+
+    bool full() {
+        return count >= (N - (N >> 2));
+    }
+
+    uint16_t size() {
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __AR4BR_RING_H
+#define __AR4BR_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+/*
+    Bounded lock-free single-producer/single-consumer ring.
+    Producer fills a slot returned by claim() and publishes it with push(),
+    consumer reads front() in place and releases it with pop().
+    push(item) and pop(&item) copy, for small items.
+    N must be a power of two.
+*/
+template <typename T, uint32_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be power of two");
+
+    T slots[N];
+    std::atomic<uint32_t> head{0}; // next slot to write (producer)
+    std::atomic<uint32_t> tail{0}; // next slot to read (consumer)
+
+public:
+    // producer side
+    T* claim() {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N) return nullptr;
+        return &slots[h & (N - 1)];
+    }
+
+    void push() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool push(const T& item) {
+        T* slot = claim();
+        if (!slot) return false;
+        *slot = item;
+        push();
+        return true;
+    }
+
+    // consumer side
+    T* front() {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) return nullptr;
+        return &slots[t & (N - 1)];
+    }
+
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool pop(T* item) {
+        T* slot = front();
+        if (!slot) return false;
+        *item = *slot;
+        pop();
+        return true;
+    }
+
+    uint32_t size() {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() {
+        return size() == 0;
+    }
+
+    constexpr uint32_t capacity() const {
+        return N;
+    }
+};
+
+#endif
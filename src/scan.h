@@ -0,0 +1,107 @@
+#ifndef __AR4BR_SCAN_H
+#define __AR4BR_SCAN_H
+
+#include "config.h"
+#include "ring.h"
+#include "adparser.h"
+#include "capture.h"
+#include "Aranet4.h"
+#include "MikroTikBT5.h"
+
+// Vendors recognized by advertisement classifier
+static const AdvMatch advMatchTable[] = {
+    { ADV_VENDOR_ARANET,    ADV_MATCH_COMPANY, ARANET4_MANUFACTURER_ID },
+    { ADV_VENDOR_ARANET,    ADV_MATCH_UUID16,  0xFCE0 },
+    // f0cd1400-95da-4f4b-9ac8-aa55d312af0c
+    { ADV_VENDOR_ARANET,    ADV_MATCH_UUID128, 0, { 0x0C, 0xAF, 0x12, 0xD3, 0x55, 0xAA, 0xC8, 0x9A, 0x4B, 0x4F, 0xDA, 0x95, 0x00, 0x14, 0xCD, 0xF0 } },
+    { ADV_VENDOR_ARANET,    ADV_MATCH_NAME,    0, {}, "Aranet" },
+    { ADV_VENDOR_MIKROTIK,  ADV_MATCH_COMPANY, MIKROTIK_MANUFACTURER_ID },
+    // b81c94a4-6b2b-4d41-9357-0c8229ea02df
+    { ADV_VENDOR_AIRVALENT, ADV_MATCH_UUID128, 0, { 0xDF, 0x02, 0xEA, 0x29, 0x82, 0x0C, 0x57, 0x93, 0x41, 0x4D, 0x2B, 0x6B, 0xA4, 0x94, 0x1C, 0xB8 } },
+};
+
+// Raw advertisement, detached from NimBLE scan results
+typedef struct {
+    uint8_t  addr[6];      // native (little endian) order
+    uint8_t  addrType;
+    int8_t   rssi;
+    uint32_t seenAt;
+    AdvInfo  info;
+    uint8_t  len;
+    uint8_t  payload[CFG_ADV_PAYLOAD_MAX_LEN];
+
+    NimBLEAddress address() {
+        return NimBLEAddress(addr, addrType);
+    }
+
+    AdSpan mfr() {
+        return { payload + info.mfrOff, info.mfrLen };
+    }
+
+    AdSpan name() {
+        return { payload + info.nameOff, info.nameLen };
+    }
+
+    bool hasName() {
+        return info.nameLen > 0;
+    }
+
+    // copy name as C string, truncated to buffer size
+    void copyName(char* buf, size_t size) {
+        size_t len = info.nameLen < size ? info.nameLen : size - 1;
+        memcpy(buf, payload + info.nameOff, len);
+        buf[len] = 0;
+    }
+} AdvRecord;
+
+typedef SpscRing<AdvRecord, CFG_ADV_RING_SIZE> AdvRing;
+
+/*
+    Runs in NimBLE host task. Classifies raw payload and queues only
+    advertisements of known vendors, all processing is done by consumer.
+*/
+class MyScanCallbacks: public NimBLEAdvertisedDeviceCallbacks {
+    AdvRing* ring;
+
+    void onResult(NimBLEAdvertisedDevice* adv) {
+        size_t len = adv->getPayloadLength();
+        if (len > CFG_ADV_PAYLOAD_MAX_LEN) len = CFG_ADV_PAYLOAD_MAX_LEN;
+
+        lastResultAt = millis();
+        CAPTURE_ADV(adv->getAddress().getNative(), adv->getAddress().getType(), adv->getRSSI(), adv->getPayload(), len, lastResultAt);
+
+        AdvInfo info;
+        if (!adClassify(adv->getPayload(), len, advMatchTable, &info) || info.vendor == ADV_VENDOR_NONE) {
+            ignored++;
+            return;
+        }
+
+        AdvRecord* rec = ring->claim();
+        if (!rec) {
+            dropped++;
+            return;
+        }
+
+        NimBLEAddress addr = adv->getAddress();
+        memcpy(rec->addr, addr.getNative(), 6);
+        rec->addrType = addr.getType();
+        rec->rssi = adv->getRSSI();
+        rec->seenAt = lastResultAt;
+        rec->info = info;
+        rec->len = len;
+        memcpy(rec->payload, adv->getPayload(), len);
+
+        ring->push();
+        received++;
+    }
+
+public:
+    uint32_t received = 0;
+    uint32_t ignored = 0;
+    uint32_t dropped = 0;
+    uint32_t lastResultAt = 0;
+
+    MyScanCallbacks(AdvRing* ring) : ring(ring) {}
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef __AR4BR_SCANTUNE_H
+#define __AR4BR_SCANTUNE_H
+
+#include <vector>
+#include <NimBLEDevice.h>
+#include "config.h"
+#include "types.h"
+#include "settings.h"
+
+/*
+    Adaptive scan window. Aranet beacon counter is incremented once per
+    measurement, when it jumps by more than one, all beacons of skipped
+    measurements were lost. Window grows while misses are high and shrinks
+    while they are low or WiFi is busy with uploads, scan interval is kept.
+    Non-zero scan interval/window in settings override tuning.
+    Used only by loop task.
+*/
+
+#define SCAN_PARAM_MIN 0x0004 // 2.5 ms
+#define SCAN_PARAM_MAX 0x4000 // 10.24 s
+
+uint16_t scanInterval = CFG_SCAN_INTERVAL; // 0.625 ms units
+uint16_t scanWindow = CFG_SCAN_WINDOW;
+uint32_t scanTuneAt = 0;
+uint32_t scanEgressBytes = 0; // uploaded bytes at last tune
+
+// last period, reported in status
+float scanMissRate = 0;    // % of measurements missed, all devices
+float scanMissRateMax = 0; // % of worst device
+bool scanWifiBusy = false;
+
+/*
+    Count received and missed measurements of device
+    @param prev beacon counter before this advertisement
+*/
+void scanTuneReading(AranetDevice* d, uint8_t prev) {
+    if (d->updated == 0) return; // first reading since boot
+    uint8_t delta = d->data.counter - prev;
+    if (delta == 0) return;
+
+    d->beaconsSeen++;
+    // long gaps are outages, not scan quality
+    if (delta <= CFG_SCAN_MISS_GAP) d->beaconsMissed += delta - 1;
+}
+
+/*
+    Keep scan settings in range accepted by controller, window not longer
+    than interval. 0 stays default/adaptive.
+    @return true if any value was changed
+*/
+bool scanSettingsFix(NodeConfig* cfg) {
+    uint16_t interval = cfg->scanInterval;
+    uint16_t window = cfg->scanWindow;
+    if (cfg->scanInterval) cfg->scanInterval = constrain(cfg->scanInterval, SCAN_PARAM_MIN, SCAN_PARAM_MAX);
+    if (cfg->scanWindow) {
+        uint16_t limit = cfg->scanInterval ? cfg->scanInterval : CFG_SCAN_INTERVAL;
+        cfg->scanWindow = constrain(cfg->scanWindow, SCAN_PARAM_MIN, limit);
+    }
+    return interval != cfg->scanInterval || window != cfg->scanWindow;
+}
+
+void scanApply(NimBLEScan* scan, uint16_t interval, uint16_t window) {
+    if (interval == scanInterval && window == scanWindow) return;
+
+    Serial.printf("[SCAN] interval %u, window %u\n", interval, window);
+    scanInterval = interval;
+    scanWindow = window;
+    scan->setInterval(interval);
+    scan->setWindow(window);
+    // new parameters are used from next start
+    if (scan->isScanning()) scan->stop();
+}
+
+/*
+    Adjust window from miss rate of last period
+    @param egressBytes bytes uploaded since boot
+    @param backlog egress queues are filling up
+*/
+void scanTune(NimBLEScan* scan, NodeConfig* cfg, std::vector<AranetDevice*> &devices, uint32_t egressBytes, bool backlog) {
+    if ((int32_t) (millis() - scanTuneAt) < 0) return;
+    scanTuneAt = millis() + CFG_SCAN_TUNE_PERIOD * 1000;
+
+    uint32_t seen = 0;
+    uint32_t missed = 0;
+    scanMissRateMax = 0;
+    for (AranetDevice* d : devices) {
+        uint32_t total = d->beaconsSeen + d->beaconsMissed;
+        if (total > 0) {
+            float rate = d->beaconsMissed * 100.0 / total;
+            if (rate > scanMissRateMax) scanMissRateMax = rate;
+        }
+        seen += d->beaconsSeen;
+        missed += d->beaconsMissed;
+        d->beaconsSeen = d->beaconsMissed = 0;
+    }
+    scanMissRate = seen + missed ? missed * 100.0 / (seen + missed) : 0;
+
+    // counters restart with new client after settings change
+    uint32_t sent = egressBytes >= scanEgressBytes ? egressBytes - scanEgressBytes : egressBytes;
+    scanEgressBytes = egressBytes;
+    scanWifiBusy = backlog || sent > CFG_SCAN_WIFI_BUSY_BYTES;
+
+    if (cfg->scanInterval || cfg->scanWindow) {
+        uint16_t interval = cfg->scanInterval ? cfg->scanInterval : CFG_SCAN_INTERVAL;
+        uint16_t window = cfg->scanWindow ? cfg->scanWindow : CFG_SCAN_WINDOW;
+        scanApply(scan, interval, window < interval ? window : interval);
+        return;
+    }
+
+    uint16_t window = scanWindow;
+    if (seen + missed == 0) {
+        // nothing to measure
+    } else if (scanMissRate > CFG_SCAN_MISS_HIGH && !scanWifiBusy) {
+        window += CFG_SCAN_WINDOW_STEP;
+    } else if (scanMissRate < CFG_SCAN_MISS_LOW || scanWifiBusy) {
+        window = window > CFG_SCAN_WINDOW_MIN + CFG_SCAN_WINDOW_STEP ? window - CFG_SCAN_WINDOW_STEP : CFG_SCAN_WINDOW_MIN;
+    }
+    if (window > CFG_SCAN_INTERVAL) window = CFG_SCAN_INTERVAL;
+    scanApply(scan, CFG_SCAN_INTERVAL, window);
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef __AR4BR_SCHEDULE_H
+#define __AR4BR_SCHEDULE_H
+
+#include <vector>
+#include "config.h"
+#include "types.h"
+
+/*
+    Scan scheduler. Sensors measure at fixed interval, so next reading can
+    be predicted from `updated`, `interval` and `ago`. Deadlines of saved
+    devices are kept in min-heap, scan runs only from shortly before the
+    earliest deadline until reading arrives, plus short discovery scans for
+    new devices. While BLE is idle coexistence gives the radio to WiFi.
+    Devices without known interval (not read yet, MikroTik tags) are always
+    due, so with such devices saved the scan stays on.
+    Used only by loop task.
+*/
+
+typedef struct {
+    uint32_t due;  // millis, scan starts CFG_SCHED_LEAD before
+    uint32_t base; // due computed from readings, changes on new reading
+    AranetDevice* device;
+} SchedEntry;
+
+SchedEntry schedHeap[CFG_SAVED_INDEX_SIZE];
+uint8_t schedCount = 0;
+uint32_t schedBuiltFor = 0;    // savedGeneration of heap contents
+bool schedBuilt = false;
+uint32_t schedDiscoveryAt = 0;
+uint32_t schedDiscoveryUntil = 0;
+
+// stats, reset by reporter
+uint32_t schedMissed = 0;      // readings not received in window
+uint32_t schedLatencySum = 0;  // ms from measurement to received reading
+uint32_t schedLatencyMax = 0;
+uint32_t schedLatencyCount = 0;
+uint32_t schedRadioMs = 0;     // time with scan running
+uint32_t schedRadioTickAt = 0;
+portMUX_TYPE schedStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+inline bool schedBefore(SchedEntry* a, SchedEntry* b) {
+    return (int32_t) (a->due - b->due) < 0;
+}
+
+void schedSiftUp(uint8_t i) {
+    while (i > 0) {
+        uint8_t parent = (i - 1) / 2;
+        if (!schedBefore(&schedHeap[i], &schedHeap[parent])) break;
+        std::swap(schedHeap[i], schedHeap[parent]);
+        i = parent;
+    }
+}
+
+void schedSiftDown(uint8_t i) {
+    for (;;) {
+        uint8_t min = i;
+        uint8_t l = 2 * i + 1;
+        uint8_t r = l + 1;
+        if (l < schedCount && schedBefore(&schedHeap[l], &schedHeap[min])) min = l;
+        if (r < schedCount && schedBefore(&schedHeap[r], &schedHeap[min])) min = r;
+        if (min == i) break;
+        std::swap(schedHeap[i], schedHeap[min]);
+        i = min;
+    }
+}
+
+/*
+    Expected time of next reading, same rule processAranet uses to skip reads
+*/
+uint32_t schedNextDue(AranetDevice* d, uint32_t now) {
+    if (d->updated == 0 || d->data.interval == 0) return now;
+    if (d->history && d->pending) return now;
+    return d->updated + (d->data.interval - d->data.ago) * 1000;
+}
+
+void schedRebuild(std::vector<AranetDevice*> &devices, uint32_t now) {
+    schedCount = 0;
+    for (AranetDevice* d : devices) {
+        if (!d->enabled || schedCount >= CFG_SAVED_INDEX_SIZE) continue;
+        uint32_t due = schedNextDue(d, now);
+        schedHeap[schedCount++] = { due, due, d };
+    }
+    for (int i = schedCount / 2 - 1; i >= 0; i--) schedSiftDown(i);
+}
+
+/*
+    Move deadline of device after its advertisement was processed
+*/
+void schedUpdate(AranetDevice* d, uint32_t now) {
+    for (uint8_t i = 0; i < schedCount; i++) {
+        SchedEntry* e = &schedHeap[i];
+        if (e->device != d) continue;
+
+        uint32_t due = schedNextDue(d, now);
+        if (due == e->base) return; // no new reading, keep skipped deadline
+
+        bool later = (int32_t) (due - e->due) > 0;
+        e->due = e->base = due;
+        if (later) schedSiftDown(i);
+        else schedSiftUp(i);
+        return;
+    }
+}
+
+/*
+    Decide if scan should run now
+    @param generation changes when saved devices are added, removed or edited
+*/
+bool schedWantScan(std::vector<AranetDevice*> &devices, uint32_t generation, uint32_t now) {
+    if (!schedBuilt || schedBuiltFor != generation) {
+        schedRebuild(devices, now);
+        schedBuiltFor = generation;
+        schedBuilt = true;
+    }
+
+    if ((int32_t) (now - schedDiscoveryAt) >= 0) {
+        schedDiscoveryAt = now + CFG_SCHED_DISCOVERY_INTERVAL * 1000;
+        schedDiscoveryUntil = now + CFG_SCHED_DISCOVERY_SCAN * 1000;
+    }
+    bool discovery = (int32_t) (schedDiscoveryUntil - now) > 0;
+
+    while (schedCount > 0) {
+        SchedEntry* top = &schedHeap[0];
+        uint16_t interval = top->device->data.interval;
+
+        if (interval && (int32_t) (now - top->due) > CFG_SCHED_WINDOW * 1000) {
+            // reading did not arrive, try again at next measurement
+            top->due += interval * 1000;
+            schedMissed++;
+            schedSiftDown(0);
+            continue;
+        }
+        return discovery || (int32_t) (now - top->due) >= -CFG_SCHED_LEAD * 1000;
+    }
+    return discovery;
+}
+
+/*
+    Account scan time, called every loop iteration
+*/
+void schedRadioTick(bool scanning, uint32_t now) {
+    if (scanning) schedRadioMs += now - schedRadioTickAt;
+    schedRadioTickAt = now;
+}
+
+/*
+    Reading received, called from loop task and GATT workers
+    @param ago seconds since sensor measured it
+*/
+void schedReadingDone(uint16_t ago) {
+    uint32_t latency = ago * 1000;
+    portENTER_CRITICAL(&schedStatsMux);
+    schedLatencySum += latency;
+    schedLatencyCount++;
+    if (latency > schedLatencyMax) schedLatencyMax = latency;
+    portEXIT_CRITICAL(&schedStatsMux);
+}
+
+/*
+    Latency since last call, in ms
+    @return number of readings
+*/
+uint32_t schedTakeLatency(uint32_t* avg, uint32_t* max) {
+    portENTER_CRITICAL(&schedStatsMux);
+    uint32_t count = schedLatencyCount;
+    *avg = count ? schedLatencySum / count : 0;
+    *max = schedLatencyMax;
+    schedLatencySum = schedLatencyMax = schedLatencyCount = 0;
+    portEXIT_CRITICAL(&schedStatsMux);
+    return count;
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef __AR4BR_SETTINGS_H
+#define __AR4BR_SETTINGS_H
+
+#include <stddef.h>
+#include <string.h>
+#include <nvs.h>
+#include "config.h"
+
+/*
+    Node configuration, loaded from NVS once and kept in RAM.
+    Same keys and value types as used with Preferences before,
+    so existing configuration is kept.
+*/
+typedef struct {
+    char     sysName[33];
+    uint16_t scanReboot;
+    uint16_t scanInterval; // 0 - default
+    uint16_t scanWindow;   // 0 - adaptive
+    char     loginUser[33];
+    char     loginPassword[33];
+    char     ntpUrl[48];
+
+    char     wifiSsid[33];
+    char     wifiPassword[64];
+    bool     wifiIpStatic;
+    uint32_t wifiIpAddr;
+    uint32_t wifiIpMask;
+    uint32_t wifiIpGw;
+    uint32_t wifiIpDns;
+
+    bool     wgEnabled;
+    char     wgEndpoint[65];
+    uint16_t wgPort;
+    char     wgPubKey[46];
+    char     wgPrivateKey[46];
+    uint32_t wgLocalIp;
+
+    char     influxUrl[129];
+    char     influxOrg[17];
+    char     influxToken[129];
+    char     influxBucket[33];
+    uint8_t  influxDbVer;
+    uint16_t influxLog;
+    bool     influxGzip;
+
+    uint32_t mqttServer;
+    uint16_t mqttPort;
+    char     mqttUser[129];
+    char     mqttPassword[129];
+    bool     mqttJson;
+
+    bool     cfgInit;
+} NodeConfig;
+
+enum SettingType : uint8_t {
+    SETTING_STR,
+    SETTING_BOOL,
+    SETTING_U8,
+    SETTING_U16,
+    SETTING_U32
+};
+
+typedef struct {
+    const char* key;
+    SettingType type;
+    uint16_t offset;
+    uint16_t size;
+    uint32_t def;
+    const char* defStr;
+} SettingField;
+
+#define SETTING(key, type, member, def, defStr) { key, type, offsetof(NodeConfig, member), sizeof(NodeConfig::member), def, defStr }
+
+static const SettingField settingFields[] = {
+    SETTING(PREF_K_SYS_NAME,       SETTING_STR,  sysName,       0, ""),
+    SETTING(PREF_K_SCAN_REBOOT,    SETTING_U16,  scanReboot,    0, nullptr),
+    SETTING(PREF_K_SCAN_INTERVAL,  SETTING_U16,  scanInterval,  0, nullptr),
+    SETTING(PREF_K_SCAN_WINDOW,    SETTING_U16,  scanWindow,    0, nullptr),
+    SETTING(PREF_K_LOGIN_USER,     SETTING_STR,  loginUser,     0, CFG_DEF_LOGIN_USER),
+    SETTING(PREF_K_LOGIN_PASSWORD, SETTING_STR,  loginPassword, 0, CFG_DEF_LOGIN_PASSWORD),
+    SETTING(PREF_K_NTP_URL,        SETTING_STR,  ntpUrl,        0, ""),
+
+    SETTING(PREF_K_WIFI_SSID,      SETTING_STR,  wifiSsid,      0, ""),
+    SETTING(PREF_K_WIFI_PASSWORD,  SETTING_STR,  wifiPassword,  0, ""),
+    SETTING(PREF_K_WIFI_IP_STATIC, SETTING_BOOL, wifiIpStatic,  0, nullptr),
+    SETTING(PREF_K_WIFI_IP_ADDR,   SETTING_U32,  wifiIpAddr,    0, nullptr),
+    SETTING(PREF_K_WIFI_IP_MASK,   SETTING_U32,  wifiIpMask,    0, nullptr),
+    SETTING(PREF_K_WIFI_IP_GW,     SETTING_U32,  wifiIpGw,      0, nullptr),
+    SETTING(PREF_K_WIFI_IP_DNS,    SETTING_U32,  wifiIpDns,     0, nullptr),
+
+    SETTING(PREF_K_WG_ENABLED,     SETTING_BOOL, wgEnabled,     0, nullptr),
+    SETTING(PREF_K_WG_ENDPOINT,    SETTING_STR,  wgEndpoint,    0, ""),
+    SETTING(PREF_K_WG_PORT,        SETTING_U16,  wgPort,        13231, nullptr),
+    SETTING(PREF_K_WG_PUB_KEY,     SETTING_STR,  wgPubKey,      0, ""),
+    SETTING(PREF_K_WG_PRIVATE_KEY, SETTING_STR,  wgPrivateKey,  0, ""),
+    SETTING(PREF_K_WG_LOCAL_IP,    SETTING_U32,  wgLocalIp,     0, nullptr),
+
+    SETTING(PREF_K_INFLUX_URL,     SETTING_STR,  influxUrl,     0, ""),
+    SETTING(PREF_K_INFLUX_ORG,     SETTING_STR,  influxOrg,     0, ""),
+    SETTING(PREF_K_INFLUX_TOKEN,   SETTING_STR,  influxToken,   0, ""),
+    SETTING(PREF_K_INFLUX_BUCKET,  SETTING_STR,  influxBucket,  0, ""),
+    SETTING(PREF_K_INFLUX_DBVER,   SETTING_U8,   influxDbVer,   0, nullptr),
+    SETTING(PREF_K_INFLUX_LOG,     SETTING_U16,  influxLog,     0, nullptr),
+    SETTING(PREF_K_INFLUX_GZIP,    SETTING_BOOL, influxGzip,    0, nullptr),
+
+    SETTING(PREF_K_MQTT_SERVER,    SETTING_U32,  mqttServer,    0, nullptr),
+    SETTING(PREF_K_MQTT_PORT,      SETTING_U16,  mqttPort,      CFG_DEF_MQTT_PORT, nullptr),
+    SETTING(PREF_K_MQTT_USER,      SETTING_STR,  mqttUser,      0, ""),
+    SETTING(PREF_K_MQTT_PASSWORD,  SETTING_STR,  mqttPassword,  0, ""),
+    SETTING(PREF_K_MQTT_JSON,      SETTING_BOOL, mqttJson,      0, nullptr),
+
+    SETTING(PREF_K_CFG_INIT,       SETTING_BOOL, cfgInit,       0, nullptr),
+};
+
+nvs_handle_t settingsHandle = 0;
+NodeConfig settingsStored;       // values in NVS, to find changed fields
+uint32_t settingsGeneration = 0; // incremented on every saved change
+uint32_t nvsAccesses = 0;        // all NVS reads and writes, reported in status
+
+/*
+    Read all settings, missing ones get default value
+*/
+bool settingsLoad(NodeConfig* cfg, const char* ns) {
+    memset(cfg, 0, sizeof(NodeConfig));
+    bool ok = nvs_open(ns, NVS_READWRITE, &settingsHandle) == ESP_OK;
+
+    for (const SettingField &f : settingFields) {
+        uint8_t* value = (uint8_t*) cfg + f.offset;
+        esp_err_t err = ESP_FAIL;
+
+        if (ok) {
+            nvsAccesses++;
+            switch (f.type) {
+            case SETTING_STR: {
+                size_t len = f.size;
+                err = nvs_get_str(settingsHandle, f.key, (char*) value, &len);
+                break;
+            }
+            case SETTING_BOOL:
+            case SETTING_U8:
+                err = nvs_get_u8(settingsHandle, f.key, value);
+                break;
+            case SETTING_U16:
+                err = nvs_get_u16(settingsHandle, f.key, (uint16_t*) value);
+                break;
+            case SETTING_U32:
+                err = nvs_get_u32(settingsHandle, f.key, (uint32_t*) value);
+                break;
+            }
+        }
+
+        if (err != ESP_OK) {
+            if (f.type == SETTING_STR) {
+                strlcpy((char*) value, f.defStr, f.size);
+            } else {
+                memcpy(value, &f.def, f.size); // little endian
+            }
+        }
+    }
+
+    settingsStored = *cfg;
+    return ok;
+}
+
+/*
+    Write changed settings and commit them at once
+    @return number of changed settings
+*/
+int settingsSave(NodeConfig* cfg) {
+    if (!settingsHandle) return 0;
+
+    int changed = 0;
+    for (const SettingField &f : settingFields) {
+        uint8_t* value = (uint8_t*) cfg + f.offset;
+        uint8_t* stored = (uint8_t*) &settingsStored + f.offset;
+
+        if (f.type == SETTING_STR) {
+            value[f.size - 1] = 0;
+            if (strcmp((char*) value, (char*) stored) == 0) continue;
+        } else if (memcmp(value, stored, f.size) == 0) {
+            continue;
+        }
+
+        esp_err_t err = ESP_FAIL;
+        nvsAccesses++;
+        switch (f.type) {
+        case SETTING_STR:
+            err = nvs_set_str(settingsHandle, f.key, (char*) value);
+            break;
+        case SETTING_BOOL:
+        case SETTING_U8:
+            err = nvs_set_u8(settingsHandle, f.key, *value);
+            break;
+        case SETTING_U16:
+            err = nvs_set_u16(settingsHandle, f.key, *(uint16_t*) value);
+            break;
+        case SETTING_U32:
+            err = nvs_set_u32(settingsHandle, f.key, *(uint32_t*) value);
+            break;
+        }
+
+        if (err == ESP_OK) {
+            memcpy(stored, value, f.size);
+            changed++;
+        }
+    }
+
+    if (changed) {
+        nvsAccesses++;
+        nvs_commit(settingsHandle);
+        settingsGeneration++;
+    }
+    return changed;
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef __AR4BR_TRACE_H
+#define __AR4BR_TRACE_H
+
+#include "config.h"
+
+/*
+    Event tracer for hot paths. TRACE_SCOPE / TRACE_BEGIN / TRACE_END record
+    begin and end events with esp_timer time, core and task into fixed ring,
+    oldest events are overwritten. /trace dumps the ring as Chrome trace
+    JSON (chrome://tracing, ui.perfetto.dev), one process per core.
+    With CFG_TRACE 0 all instrumentation compiles out.
+    Names must be string literals, only pointer is stored.
+*/
+
+#if CFG_TRACE
+
+#include <memory>
+#include <esp_timer.h>
+
+typedef struct {
+    uint32_t ts; // us, low bits of esp_timer_get_time()
+    const char* name;
+    TaskHandle_t task;
+    uint8_t core;
+    char phase;  // 'B' or 'E'
+} TraceEvent;
+
+TraceEvent traceRing[CFG_TRACE_EVENTS];
+uint32_t traceHead = 0; // total events written
+portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+inline void traceEvent(const char* name, char phase) {
+    uint32_t ts = (uint32_t) esp_timer_get_time();
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    uint8_t core = xPortGetCoreID();
+
+    portENTER_CRITICAL(&traceMux);
+    TraceEvent* e = &traceRing[traceHead++ % CFG_TRACE_EVENTS];
+    e->ts = ts;
+    e->name = name;
+    e->task = task;
+    e->core = core;
+    e->phase = phase;
+    portEXIT_CRITICAL(&traceMux);
+}
+
+class TraceScope {
+    const char* name;
+public:
+    TraceScope(const char* name) : name(name) { traceEvent(name, 'B'); }
+    ~TraceScope() { traceEvent(name, 'E'); }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_BEGIN(name) traceEvent(name, 'B')
+#define TRACE_END(name)   traceEvent(name, 'E')
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+/*
+    Chrome trace JSON of ring copy taken when request starts,
+    written line by line into response chunks
+*/
+class TraceWriter {
+    std::unique_ptr<TraceEvent[]> events;
+    uint16_t count = 0;
+    uint32_t origin = 0; // ts of oldest event
+
+    TaskHandle_t tasks[16];
+    uint8_t taskCount = 0;
+
+    uint8_t stage = 0;
+    uint16_t pos = 0;
+
+    char line[256];
+    size_t lineLen = 0;
+    size_t linePos = 0;
+
+    bool next() {
+        lineLen = linePos = 0;
+        while (lineLen == 0) {
+            if (stage == 0) {
+                lineLen = snprintf(line, sizeof(line), "{\"traceEvents\":[\n");
+                stage = 1;
+            } else if (stage == 1 && pos < taskCount) {
+                // thread names, same task may show up under both cores
+                TaskHandle_t t = tasks[pos++];
+                for (uint8_t core = 0; core < portNUM_PROCESSORS && lineLen < sizeof(line); core++) {
+                    lineLen += snprintf(line + lineLen, sizeof(line) - lineLen,
+                        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n",
+                        core, (uint32_t) t, pcTaskGetName(t));
+                }
+            } else if (stage == 1) {
+                stage = 2;
+                pos = 0;
+            } else if (stage == 2 && pos < count) {
+                TraceEvent* e = &events[pos++];
+                lineLen = snprintf(line, sizeof(line),
+                    "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%u,\"pid\":%u,\"tid\":%u}%s\n",
+                    e->name, e->phase, e->ts - origin, e->core, (uint32_t) e->task, pos < count ? "," : "");
+            } else if (stage == 2) {
+                lineLen = snprintf(line, sizeof(line), "],\"displayTimeUnit\":\"ms\"}\n");
+                stage = 3;
+            } else {
+                return false;
+            }
+            if (lineLen >= sizeof(line)) lineLen = sizeof(line) - 1;
+        }
+        return true;
+    }
+
+public:
+    /*
+        Copy ring, oldest event first
+        @return false if there is no memory for copy
+    */
+    bool begin() {
+        events.reset(new (std::nothrow) TraceEvent[CFG_TRACE_EVENTS]);
+        if (!events) return false;
+
+        portENTER_CRITICAL(&traceMux);
+        uint32_t head = traceHead;
+        count = head < CFG_TRACE_EVENTS ? head : CFG_TRACE_EVENTS;
+        for (uint16_t i = 0; i < count; i++) {
+            events[i] = traceRing[(head - count + i) % CFG_TRACE_EVENTS];
+        }
+        portEXIT_CRITICAL(&traceMux);
+
+        if (count) origin = events[0].ts;
+        for (uint16_t i = 0; i < count; i++) {
+            uint8_t t = 0;
+            while (t < taskCount && tasks[t] != events[i].task) t++;
+            if (t == taskCount && taskCount < sizeof(tasks) / sizeof(tasks[0])) tasks[taskCount++] = events[i].task;
+        }
+        return true;
+    }
+
+    size_t read(uint8_t* buf, size_t maxLen) {
+        size_t len = 0;
+        while (len < maxLen) {
+            if (linePos == lineLen) {
+                if (!next()) break;
+            }
+            size_t n = min(lineLen - linePos, maxLen - len);
+            memcpy(buf + len, line + linePos, n);
+            linePos += n;
+            len += n;
+        }
+        return len;
+    }
+};
+
+#else
+
+#define TRACE_BEGIN(name) do {} while (0)
+#define TRACE_END(name)   do {} while (0)
+#define TRACE_SCOPE(name) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,516 @@
+#ifndef __AR4BR_TSSTORE_H
+#define __AR4BR_TSSTORE_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+    Compressed time series of recent readings.
+    Samples are stored in fixed size blocks. Each block is self contained:
+    first sample keeps absolute values, following samples keep
+    delta-of-delta of timestamp and delta of each value as zigzag varints.
+    With regular interval and slowly changing values most samples take 5 bytes.
+*/
+
+#define TS_BLOCK_MAGIC 0x53545241 // "ARTS"
+#define TS_CHANNELS    4
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t firstTs;
+    uint32_t lastTs;
+    uint16_t count;
+    uint16_t used;     // data bytes after header
+    uint8_t  type;     // AranetType of all samples in block
+    uint8_t  reserved[3];
+} TsBlockHeader;
+
+typedef struct {
+    uint32_t timestamp;
+    int32_t  value[TS_CHANNELS];
+} TsSample;
+
+inline uint8_t tsPutVarint(uint8_t* out, int32_t value) {
+    uint32_t v = ((uint32_t) value << 1) ^ (uint32_t) (value >> 31); // zigzag
+    uint8_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+inline uint8_t tsGetVarint(const uint8_t* in, uint16_t avail, int32_t* value) {
+    uint32_t v = 0;
+    uint8_t n = 0;
+    for (uint8_t shift = 0; n < avail && shift < 35; shift += 7) {
+        uint8_t b = in[n++];
+        v |= (uint32_t) (b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *value = (int32_t) (v >> 1) ^ -(int32_t) (v & 1);
+            return n;
+        }
+    }
+    return 0; // truncated
+}
+
+/*
+    Appends samples to block buffer
+*/
+class TsBlockWriter {
+    uint8_t* block;
+    uint16_t size;
+    int32_t  prevDelta = 0;
+    TsSample prev;
+
+public:
+    TsBlockWriter(uint8_t* block, uint16_t size) : block(block), size(size) {}
+
+    TsBlockHeader* header() {
+        return (TsBlockHeader*) block;
+    }
+
+    void begin(uint32_t seq, uint8_t type) {
+        memset(block, 0, size);
+        TsBlockHeader* hdr = header();
+        hdr->magic = TS_BLOCK_MAGIC;
+        hdr->seq = seq;
+        hdr->type = type;
+        prevDelta = 0;
+    }
+
+    /*
+        Restore encoder state of partially filled block
+    */
+    void resume();
+
+    /*
+        @return false if sample does not fit in block
+    */
+    bool append(TsSample* s) {
+        TsBlockHeader* hdr = header();
+        uint8_t tmp[5 * (TS_CHANNELS + 1)];
+        uint8_t len = 0;
+
+        if (hdr->count == 0) {
+            for (uint8_t i = 0; i < TS_CHANNELS; i++) len += tsPutVarint(tmp + len, s->value[i]);
+        } else {
+            int32_t delta = s->timestamp - prev.timestamp;
+            len += tsPutVarint(tmp, delta - prevDelta);
+            for (uint8_t i = 0; i < TS_CHANNELS; i++) len += tsPutVarint(tmp + len, s->value[i] - prev.value[i]);
+            prevDelta = delta;
+        }
+
+        if (sizeof(TsBlockHeader) + hdr->used + len > size) return false;
+
+        memcpy(block + sizeof(TsBlockHeader) + hdr->used, tmp, len);
+        hdr->used += len;
+        if (hdr->count == 0) hdr->firstTs = s->timestamp;
+        hdr->lastTs = s->timestamp;
+        hdr->count++;
+        prev = *s;
+        return true;
+    }
+};
+
+/*
+    Decodes samples from block
+*/
+class TsBlockReader {
+    const uint8_t* block;
+    uint16_t pos = 0;
+    uint16_t index = 0;
+    int32_t  prevDelta = 0;
+    TsSample prev;
+
+public:
+    TsBlockReader(const uint8_t* block = nullptr) {
+        reset(block);
+    }
+
+    void reset(const uint8_t* b) {
+        block = b;
+        pos = 0;
+        index = 0;
+        prevDelta = 0;
+        memset(&prev, 0, sizeof(prev));
+    }
+
+    const TsBlockHeader* header() {
+        return (const TsBlockHeader*) block;
+    }
+
+    bool valid() {
+        return block && header()->magic == TS_BLOCK_MAGIC && header()->count > 0;
+    }
+
+    bool next(TsSample* s) {
+        if (!valid() || index >= header()->count) return false;
+
+        const uint8_t* data = block + sizeof(TsBlockHeader);
+        uint16_t used = header()->used;
+        int32_t v;
+        uint8_t n;
+
+        if (index == 0) {
+            prev.timestamp = header()->firstTs;
+        } else {
+            if (!(n = tsGetVarint(data + pos, used - pos, &v))) return false;
+            pos += n;
+            prevDelta += v;
+            prev.timestamp += prevDelta;
+        }
+
+        for (uint8_t i = 0; i < TS_CHANNELS; i++) {
+            if (!(n = tsGetVarint(data + pos, used - pos, &v))) return false;
+            pos += n;
+            prev.value[i] = index == 0 ? v : prev.value[i] + v;
+        }
+
+        index++;
+        *s = prev;
+        return true;
+    }
+};
+
+inline void TsBlockWriter::resume() {
+    TsBlockReader reader(block);
+    TsSample s;
+    bool first = true;
+    prevDelta = 0;
+    while (reader.next(&s)) {
+        if (!first) prevDelta = s.timestamp - prev.timestamp;
+        first = false;
+        prev = s;
+    }
+}
+
+#ifdef ARDUINO
+#include "FS.h"
+#include "SPIFFS.h"
+#include "types.h"
+
+AranetDevice* findSavedDevice(uint64_t key);
+
+/*
+    Ring of blocks in one file per device.
+    Current block is kept in RAM and written when full or on flush.
+*/
+struct TsSeries {
+    uint8_t  block[CFG_TS_BLOCK_SIZE];
+    uint16_t blockNo = 0;
+    bool     dirty = false;
+    uint32_t newestTs = 0; // of all blocks, backfill block may be current
+    uint32_t gapFrom = 0;  // last gap in readings, open for backfill
+    uint32_t gapTo = 0;
+    TsBlockWriter writer;
+
+    TsSeries() : writer(block, CFG_TS_BLOCK_SIZE) {
+        memset(block, 0, sizeof(block));
+    }
+};
+
+SemaphoreHandle_t tsMutex = nullptr;
+
+void tsPath(AranetDevice* d, char* path) {
+    const uint8_t* mac = d->addr.getNative();
+    sprintf(path, "/ts/%02x%02x%02x%02x%02x%02x.bin", mac[5], mac[4], mac[3], mac[2], mac[1], mac[0]);
+}
+
+bool tsWriteBlock(AranetDevice* d) {
+    char path[24];
+    tsPath(d, path);
+
+    File f = SPIFFS.open(path, "r+");
+    if (!f) return false;
+    f.seek(d->series->blockNo * CFG_TS_BLOCK_SIZE);
+    bool ok = f.write(d->series->block, CFG_TS_BLOCK_SIZE) == CFG_TS_BLOCK_SIZE;
+    f.close();
+
+    if (ok) d->series->dirty = false;
+    return ok;
+}
+
+/*
+    Load newest block, or create series file
+*/
+TsSeries* tsOpen(AranetDevice* d) {
+    char path[24];
+    tsPath(d, path);
+
+    TsSeries* series = new TsSeries();
+    TsBlockHeader* hdr = series->writer.header();
+
+    if (!SPIFFS.exists(path)) {
+        File f = SPIFFS.open(path, FILE_WRITE);
+        if (!f) {
+            delete series;
+            return nullptr;
+        }
+        for (uint16_t i = 0; i < CFG_TS_BLOCKS; i++) f.write(series->block, CFG_TS_BLOCK_SIZE);
+        f.close();
+        return series;
+    }
+
+    // find block with highest sequence number
+    File f = SPIFFS.open(path);
+    TsBlockHeader tmp;
+    uint32_t maxSeq = 0;
+    for (uint16_t i = 0; i < CFG_TS_BLOCKS; i++) {
+        f.seek(i * CFG_TS_BLOCK_SIZE);
+        if (f.read((uint8_t*) &tmp, sizeof(tmp)) != sizeof(tmp)) break;
+        if (tmp.magic != TS_BLOCK_MAGIC) continue;
+        if (tmp.seq >= maxSeq) {
+            maxSeq = tmp.seq;
+            series->blockNo = i;
+        }
+        if (tmp.count > 0 && tmp.lastTs > series->newestTs) series->newestTs = tmp.lastTs;
+    }
+    f.seek(series->blockNo * CFG_TS_BLOCK_SIZE);
+    f.read(series->block, CFG_TS_BLOCK_SIZE);
+    f.close();
+
+    if (hdr->magic == TS_BLOCK_MAGIC) {
+        series->writer.resume();
+    } else {
+        memset(series->block, 0, CFG_TS_BLOCK_SIZE);
+    }
+    return series;
+}
+
+void tsSampleFromData(TsSample* s, AranetData* data, uint32_t timestamp) {
+    s->timestamp = timestamp;
+    if (data->type == AranetType::ARANET_RADIATION) {
+        s->value[0] = data->radiation_rate;
+        s->value[1] = data->radiation_total;
+        s->value[2] = 0;
+        s->value[3] = 0;
+    } else {
+        s->value[0] = data->co2;
+        s->value[1] = data->temperature;
+        s->value[2] = data->humidity;
+        s->value[3] = data->pressure;
+    }
+}
+
+void tsDataFromSample(TsSample* s, uint8_t type, AranetData* data) {
+    data->type = (AranetType) type;
+    if (data->type == AranetType::ARANET_RADIATION) {
+        data->radiation_rate = s->value[0];
+        data->radiation_total = s->value[1];
+    } else {
+        data->co2 = s->value[0];
+        data->temperature = s->value[1];
+        data->humidity = s->value[2];
+        data->pressure = s->value[3];
+    }
+}
+
+/*
+    Continue in next block of ring, current one is written
+*/
+void tsNextBlock(AranetDevice* d, uint8_t type) {
+    TsSeries* series = d->series;
+    TsBlockHeader* hdr = series->writer.header();
+    if (hdr->count > 0) {
+        if (series->dirty) tsWriteBlock(d);
+        series->blockNo = (series->blockNo + 1) % CFG_TS_BLOCKS;
+    }
+    series->writer.begin(hdr->seq + 1, type);
+}
+
+/*
+    Store reading. Readings newer than newest stored are appended. Older
+    ones are history backfill, kept only if they fall into not yet filled
+    part of last gap of readings, so records are not duplicated. Samples in block
+    must be ascending, so each backfill run starts its own block, blocks
+    are then not ordered by time.
+*/
+bool tsAppend(AranetDevice* d, AranetData* data, uint32_t timestamp) {
+    if (!tsMutex) tsMutex = xSemaphoreCreateMutex();
+    xSemaphoreTake(tsMutex, portMAX_DELAY);
+
+    if (!d->series) d->series = tsOpen(d);
+    TsSeries* series = d->series;
+    bool ok = false;
+
+    if (series) {
+        TsBlockWriter &writer = series->writer;
+        TsBlockHeader* hdr = writer.header();
+        uint32_t interval = data->interval ? data->interval : 60;
+        uint32_t slack = interval / 2; // live and history timestamps differ by seconds
+        TsSample s;
+        tsSampleFromData(&s, data, timestamp);
+
+        if (hdr->magic != TS_BLOCK_MAGIC) {
+            writer.begin(1, data->type);
+        } else if (timestamp <= series->newestTs) {
+            if (timestamp <= series->gapFrom + slack || timestamp + slack >= series->gapTo) {
+                xSemaphoreGive(tsMutex);
+                return false;
+            }
+            if (hdr->count > 0 && timestamp <= hdr->lastTs) tsNextBlock(d, data->type);
+            series->gapFrom = timestamp; // history is ascending, not stored again
+        } else if (series->newestTs && timestamp - series->newestTs > interval + slack) {
+            // readings missed
+            series->gapFrom = series->newestTs;
+            series->gapTo = timestamp;
+        }
+
+        if (hdr->type != data->type || !writer.append(&s)) {
+            // block full, continue in next one
+            tsNextBlock(d, data->type);
+            writer.append(&s);
+        }
+        if (timestamp > series->newestTs) series->newestTs = timestamp;
+        series->dirty = true;
+        ok = true;
+    }
+
+    xSemaphoreGive(tsMutex);
+    return ok;
+}
+
+/*
+    Release RAM of device series, before device is deleted
+*/
+void tsClose(AranetDevice* d) {
+    // always taken, so query holding it can still use device found in index
+    if (!tsMutex) return;
+    xSemaphoreTake(tsMutex, portMAX_DELAY);
+    if (d->series) {
+        if (d->series->dirty) tsWriteBlock(d);
+        delete d->series;
+        d->series = nullptr;
+    }
+    xSemaphoreGive(tsMutex);
+}
+
+/*
+    Write current blocks of all devices
+*/
+void tsFlush(std::vector<AranetDevice*> &devices) {
+    if (!tsMutex) return;
+    xSemaphoreTake(tsMutex, portMAX_DELAY);
+    for (AranetDevice* d : devices) {
+        if (d->series && d->series->dirty) tsWriteBlock(d);
+    }
+    xSemaphoreGive(tsMutex);
+}
+
+/*
+    Range query state, used by chunked HTTP response.
+    Device may be removed while response is sent, so it is looked up
+    by MAC key for each block.
+*/
+class TsQuery {
+    uint64_t key;
+    uint32_t from;
+    uint32_t to;
+    File file;
+    uint16_t blocksLeft;
+    uint16_t blockNo;
+    uint8_t block[CFG_TS_BLOCK_SIZE];
+    TsBlockReader reader;
+    char line[96];
+    uint8_t lineLen = 0;
+    uint8_t linePos = 0;
+
+    // load next block overlapping with range, oldest first
+    bool nextBlock() {
+        while (blocksLeft > 0) {
+            blocksLeft--;
+            blockNo = (blockNo + 1) % CFG_TS_BLOCKS;
+
+            xSemaphoreTake(tsMutex, portMAX_DELAY);
+            AranetDevice* d = findSavedDevice(key);
+            TsSeries* series = d ? d->series : nullptr;
+            if (!series) {
+                // removed
+            } else if (blockNo == series->blockNo) {
+                // newest, may not be written yet
+                memcpy(block, series->block, CFG_TS_BLOCK_SIZE);
+            } else {
+                file.seek(blockNo * CFG_TS_BLOCK_SIZE);
+                file.read(block, CFG_TS_BLOCK_SIZE);
+            }
+            xSemaphoreGive(tsMutex);
+
+            if (!series) {
+                blocksLeft = 0;
+                return false;
+            }
+
+            reader.reset(block);
+            if (reader.valid() && reader.header()->lastTs >= from && reader.header()->firstTs <= to) return true;
+        }
+        return false;
+    }
+
+public:
+    TsQuery(uint64_t key, uint32_t from, uint32_t to) : key(key), from(from), to(to) {
+        blocksLeft = 0;
+        reader.reset(nullptr);
+        if (!tsMutex) return;
+
+        char path[24];
+        xSemaphoreTake(tsMutex, portMAX_DELAY);
+        AranetDevice* d = findSavedDevice(key);
+        if (d && d->series) {
+            tsPath(d, path);
+            file = SPIFFS.open(path);
+            blocksLeft = file ? CFG_TS_BLOCKS : 0;
+            blockNo = d->series->blockNo; // next after newest is oldest
+        }
+        xSemaphoreGive(tsMutex);
+    }
+
+    ~TsQuery() {
+        if (file) file.close();
+    }
+
+    /*
+        Fill buffer with CSV lines
+        @return bytes written, 0 when done
+    */
+    size_t read(uint8_t* buf, size_t maxLen) {
+        size_t len = 0;
+        while (len < maxLen) {
+            if (linePos < lineLen) {
+                size_t n = lineLen - linePos;
+                if (n > maxLen - len) n = maxLen - len;
+                memcpy(buf + len, line + linePos, n);
+                len += n;
+                linePos += n;
+                continue;
+            }
+
+            TsSample s;
+            if (!reader.next(&s)) {
+                if (!nextBlock()) break;
+                continue;
+            }
+            if (s.timestamp < from || s.timestamp > to) continue;
+
+            AranetData data;
+            tsDataFromSample(&s, reader.header()->type, &data);
+            lineLen = snprintf(line, sizeof(line), "%u;%u;%i;%.1f;%.1f;%.1f;%lu;%llu\n",
+                (unsigned) s.timestamp,
+                data.type,
+                data.getCO2(),
+                data.getTemperature(),
+                data.getPressure(),
+                data.getHumidity(),
+                data.getRadiationRate(),
+                data.getRadiationTotal()
+            );
+            linePos = 0;
+        }
+        return len;
+    }
+};
+#endif
+
+#endif
@@ -1,9 +1,12 @@
 #ifndef __AR4BR_TYPES_H
 #define __AR4BR_TYPES_H
 
+#include <ArduinoJson.h>
 #include "config.h"
 #include "Aranet4.h"
 #include "utils.h"
+#include "measurement.h"
+#include "ring.h"
 
 enum PairState {
     STATE_NOT_PAIRED,
@@ -12,6 +15,13 @@ enum PairState {
     STATE_PAIRED
 };
 
+typedef struct {
+    uint32_t timestamp; // unix time of last uploaded record
+    uint16_t index;     // history index of last uploaded record, 0 if unknown
+} __attribute__((packed)) HistoryCursor;
+
+struct TsSeries;
+
 typedef struct { 
     NimBLEAddress addr;
     char name[24];
@@ -26,14 +36,34 @@ typedef struct {
 
     // moved from status struct
     AranetData data;
+    uint8_t kind = MEAS_KIND_ARANET; // MEAS_KIND_* of latest reading, Airvalent uses own scaling
     long updated = 0;
     uint16_t pending = 0;
     bool mqttReported = false;
+    char mqttTopic[CFG_MQTT_TOPIC_SIZE] = ""; // built by mqttBuildTopic
+
+    // last uploaded record, persisted in NVS
+    HistoryCursor cursor = {0, 0};
+    bool cursorDirty = false;
+
+    // stored time series, opened on first reading
+    TsSeries* series = nullptr;
+
+    // measurements received and missed since last scan tuning
+    uint16_t beaconsSeen = 0;
+    uint16_t beaconsMissed = 0;
+
+    // GATT job running in pool, set by loop task, cleared by worker
+    volatile bool gattBusy = false;
 
     // extra data
     int rssi;
     long lastSeen;
 
+    // incremented on every change of readings shown in web UI
+    uint32_t generation = 0;
+    uint32_t pushedGeneration = 0; // last sent over WebSocket
+
     void saveConfig(DynamicJsonDocument &doc) {
         JsonArray devices;
 
@@ -65,7 +95,7 @@ typedef struct {
         page += ";";
         page += String(rssi);
         page +=";";
-        page += String(millis() - lastSeen);
+        page += String(lastSeen); // uptime, age is calculated by client
         page += ";";
 
         // flags
@@ -81,4 +111,18 @@ typedef struct {
     }
 } AranetDevice;
 
+// measurements from BLE side to egress task, exactly one producer per ring
+typedef SpscRing<Measurement, CFG_EGRESS_RING_SIZE> EgressRing;
+
+// History records received in one request
+typedef struct {
+    AranetDevice* device;
+    AranetDataCompact* logs;
+    SemaphoreHandle_t release; // given back when logs buffer is free
+    uint16_t count;
+    uint16_t lastIndex;
+    long timestamp;    // first record
+    AranetData base;   // type, battery and interval
+} HistoryChunk;
+
 #endif
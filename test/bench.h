@@ -0,0 +1,118 @@
+#ifndef __TEST_BENCH_H
+#define __TEST_BENCH_H
+
+/*
+    Benchmark helpers for native env. bench() repeats a call until enough
+    time has passed and prints time and heap allocations per call.
+    Global operator new and delete are replaced to count allocations,
+    so this header is included once per test program, before other code.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+typedef struct {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> bytes;
+    std::atomic<int64_t> live;
+    std::atomic<int64_t> peak;
+} AllocStats;
+
+inline AllocStats allocStats;
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // malloc/free below are intended
+#pragma GCC diagnostic ignored "-Warray-bounds"          // size header in front of block
+#endif
+
+// size is kept in front of block, so live heap can be tracked
+static const size_t allocHeader = alignof(max_align_t);
+
+void* operator new(size_t n) {
+    uint8_t* p = (uint8_t*) malloc(n + allocHeader);
+    if (!p) throw std::bad_alloc();
+    *(size_t*) p = n;
+    allocStats.count++;
+    allocStats.bytes += n;
+    int64_t live = allocStats.live += n;
+    int64_t peak = allocStats.peak;
+    while (live > peak && !allocStats.peak.compare_exchange_weak(peak, live)) {}
+    return p + allocHeader;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    uint8_t* block = (uint8_t*) p - allocHeader;
+    allocStats.live -= *(size_t*) block;
+    free(block);
+}
+
+void* operator new[](size_t n) { return operator new(n); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { try { return operator new(n); } catch (...) { return nullptr; } }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { try { return operator new(n); } catch (...) { return nullptr; } }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+/*
+    Peak heap above current level, for one measured section
+*/
+inline void allocPeakReset() {
+    allocStats.peak = allocStats.live.load();
+}
+
+inline int64_t allocPeakAbove(int64_t base) {
+    return allocStats.peak - base;
+}
+
+typedef struct {
+    uint64_t ops;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+} BenchResult;
+
+inline double benchNow() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+    Run fn until minMs elapsed, batch size doubles so clock overhead stays low
+    @param opsPerCall items handled by one call, results are per item
+*/
+template <typename F>
+BenchResult bench(const char* name, F fn, uint32_t opsPerCall = 1, uint32_t minMs = 200) {
+    fn(); // warm up caches and lazy allocations
+
+    uint64_t calls = 0;
+    uint64_t batch = 1;
+    uint64_t allocs = allocStats.count;
+    uint64_t bytes = allocStats.bytes;
+    double start = benchNow();
+    double elapsed = 0;
+    while (elapsed * 1000 < minMs) {
+        for (uint64_t i = 0; i < batch; i++) fn();
+        calls += batch;
+        batch *= 2;
+        elapsed = benchNow() - start;
+    }
+
+    BenchResult r;
+    r.ops = calls * opsPerCall;
+    r.nsPerOp = elapsed * 1e9 / r.ops;
+    r.allocsPerOp = (double) (allocStats.count - allocs) / r.ops;
+    r.bytesPerOp = (double) (allocStats.bytes - bytes) / r.ops;
+    printf("%-44s %12.1f ns %10.0f /s %8.2f allocs %9.1f B\n", name, r.nsPerOp, 1e9 / r.nsPerOp, r.allocsPerOp, r.bytesPerOp);
+    return r;
+}
+
+inline void benchTitle(const char* title) {
+    printf("\n%s\n%-44s %15s %12s %15s %11s\n", title, "per item", "time", "rate", "heap allocs", "heap bytes");
+}
+
+#endif
@@ -0,0 +1,153 @@
+#include "bench.h"
+#include <Arduino.h>
+#include <unity.h>
+#include "config.h"
+#include "scan.h"
+
+/*
+    Scan callback cost per advertisement: NimBLE getters used before
+    single-pass classifier (adparser.h) vs adClassify() and payload copy
+*/
+
+static const NimBLEUUID uuidAranet("f0cd1400-95da-4f4b-9ac8-aa55d312af0c");
+static const NimBLEUUID uuidAirvalent("b81c94a4-6b2b-4d41-9357-0c8229ea02df");
+
+// Aranet4: flags, manufacturer data
+static const uint8_t advAranet[] = {
+    0x02, 0x01, 0x06,
+    0x18, 0xFF, 0x02, 0x07, 0x21, 0x13, 0x04, 0x01, 0x00, 0x0F, 0x01, 0x00, 0xE0, 0x01, 0x9A, 0x01,
+    0x93, 0x27, 0x2A, 0x5F, 0x01, 0x2C, 0x01, 0x1E, 0x00
+};
+
+// Aranet4 scan response: complete name
+static const uint8_t advAranetName[] = {
+    0x0E, 0x09, 'A', 'r', 'a', 'n', 'e', 't', '4', ' ', '1', '2', '3', '4', '5'
+};
+
+// MikroTik tag
+static const uint8_t advMikrotik[] = {
+    0x02, 0x01, 0x06,
+    0x15, 0xFF, 0x4F, 0x09, 0x01, 0x00, 0x12, 0x34, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x17, 0x10, 0x27, 0x00, 0x00, 0x00, 0x5A
+};
+
+// Airvalent: 128-bit service
+static const uint8_t advAirvalent[] = {
+    0x02, 0x01, 0x06,
+    0x11, 0x07, 0xDF, 0x02, 0xEA, 0x29, 0x82, 0x0C, 0x57, 0x93, 0x41, 0x4D, 0x2B, 0x6B, 0xA4, 0x94, 0x1C, 0xB8
+};
+
+// iBeacon, most common unrelated traffic
+static const uint8_t advBeacon[] = {
+    0x02, 0x01, 0x06,
+    0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60,
+    0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5
+};
+
+// record and classification before adparser.h
+typedef struct {
+    uint8_t  addr[6];
+    uint8_t  addrType;
+    int8_t   rssi;
+    uint8_t  flags;
+    uint8_t  mfrLen;
+    uint32_t seenAt;
+    uint8_t  mfr[24];
+    char     name[24];
+} OldRecord;
+
+static void oldCallback(NimBLEAdvertisedDevice* adv, OldRecord* rec) {
+    NimBLEAddress addr = adv->getAddress();
+    memcpy(rec->addr, addr.getNative(), 6);
+    rec->addrType = addr.getType();
+    rec->rssi = adv->getRSSI();
+    rec->seenAt = millis();
+
+    rec->flags = 0;
+    if (adv->isAdvertisingService(uuidAranet))    rec->flags |= 1;
+    if (adv->isAdvertisingService(uuidAirvalent)) rec->flags |= 2;
+
+    std::string mfr = adv->getManufacturerData();
+    rec->mfrLen = mfr.copy((char*) rec->mfr, sizeof(rec->mfr));
+
+    std::string name = adv->getName();
+    size_t len = name.copy(rec->name, sizeof(rec->name) - 1);
+    rec->name[len] = 0;
+}
+
+static AdvVendor oldClassify(OldRecord* rec) {
+    uint16_t id = 0;
+    if (rec->mfrLen >= 2) memcpy(&id, rec->mfr, 2);
+    if ((rec->flags & 1) || id == ARANET4_MANUFACTURER_ID || strstr(rec->name, "Aranet")) return ADV_VENDOR_ARANET;
+    if (id == MIKROTIK_MANUFACTURER_ID) return ADV_VENDOR_MIKROTIK;
+    if (rec->flags & 2) return ADV_VENDOR_AIRVALENT;
+    return ADV_VENDOR_NONE;
+}
+
+static std::vector<NimBLEAdvertisedDevice> samples;
+
+void setUp() {
+    if (!samples.empty()) return;
+    NimBLEAddress addr(std::string("c0:3c:5a:00:00:01"), BLE_ADDR_RANDOM);
+    samples.emplace_back(addr, -60, advAranet, sizeof(advAranet));
+    samples.emplace_back(addr, -70, advMikrotik, sizeof(advMikrotik));
+    samples.emplace_back(addr, -80, advAirvalent, sizeof(advAirvalent));
+    samples.emplace_back(addr, -50, advBeacon, sizeof(advBeacon));
+    samples.emplace_back(addr, -60, advAranetName, sizeof(advAranetName));
+}
+
+void tearDown() {}
+
+void test_same_result() {
+    const AdvVendor expected[] = { ADV_VENDOR_ARANET, ADV_VENDOR_MIKROTIK, ADV_VENDOR_AIRVALENT, ADV_VENDOR_NONE, ADV_VENDOR_ARANET };
+    for (size_t i = 0; i < samples.size(); i++) {
+        OldRecord rec;
+        oldCallback(&samples[i], &rec);
+        TEST_ASSERT_EQUAL(expected[i], oldClassify(&rec));
+
+        AdvInfo info;
+        TEST_ASSERT_TRUE(adClassify(samples[i].getPayload(), samples[i].getPayloadLength(), advMatchTable, &info));
+        TEST_ASSERT_EQUAL(expected[i], info.vendor);
+    }
+}
+
+void bench_callback() {
+    static OldRecord oldRec;
+    static AdvRing ring;
+    static MyScanCallbacks callbacks(&ring);
+    size_t next = 0;
+    volatile AdvVendor vendor;
+
+    benchTitle("advertisement mix: Aranet4, MikroTik, Airvalent, iBeacon, Aranet4 name");
+
+    bench("NimBLE getters + classify", [&] {
+        NimBLEAdvertisedDevice* adv = &samples[next++ % samples.size()];
+        oldCallback(adv, &oldRec);
+        vendor = oldClassify(&oldRec);
+    });
+
+    bench("adClassify", [&] {
+        NimBLEAdvertisedDevice* adv = &samples[next++ % samples.size()];
+        AdvInfo info;
+        adClassify(adv->getPayload(), adv->getPayloadLength(), advMatchTable, &info);
+        vendor = info.vendor;
+    });
+
+    bench("MyScanCallbacks::onResult + ring pop", [&] {
+        NimBLEDevice::getScan()->setAdvertisedDeviceCallbacks(&callbacks);
+        NimBLEDevice::getScan()->mockResult(&samples[next++ % samples.size()]);
+        AdvRecord* rec = ring.front();
+        if (rec) {
+            vendor = rec->info.vendor;
+            ring.pop();
+        }
+    });
+    (void) vendor;
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_same_result);
+    RUN_TEST(bench_callback);
+    return UNITY_END();
+}
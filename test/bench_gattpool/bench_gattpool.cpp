@@ -0,0 +1,148 @@
+#include "bench.h"
+#define CFG_GATT_POOL_SIZE 4
+#include <Arduino.h>
+#include <unity.h>
+#include <thread>
+#include "config.h"
+#include "types.h"
+#include "gattpool.h"
+#include "airvalent_stub.h"
+
+/*
+    GATT pool (gattpool.h): time to read all devices once vs number of
+    slots. Worker follows GattTaskCode() and gattConnectAranet(), connects
+    are serialized, reads run in parallel. Sensors are simulated, times are
+    scaled down 1:20 from connect and read of Aranet4 over secure link.
+    Smaller pools are emulated by keeping extra slots busy.
+*/
+
+#define DEVICES    8
+#define CONNECT_MS 30
+#define READ_MS    100
+
+static AranetDevice devices[DEVICES];
+static std::atomic<uint32_t> denied;
+
+void setUp() {}
+
+void tearDown() {}
+
+static void benchGattTask(void* p) {
+    GattSlot* s = (GattSlot*) p;
+    GattJob job;
+
+    for (;;) {
+        if (xQueueReceive(s->jobs, &job, portMAX_DELAY) != pdTRUE) continue;
+        long start = millis();
+
+        gattSlotConnectLock(s, 30);
+        ar4_err_t status = s->ar4->connect(job.addr);
+        if (status != AR4_OK && s->callbacks.pairWasdenied()) denied++;
+        gattConnectUnlock();
+        if (status == AR4_OK) job.device->data = s->ar4->getCurrentReadings();
+        if (s->ar4->isConnected()) s->ar4->disconnect();
+
+        s->deadline = 0;
+        s->busyMs += millis() - start;
+        s->jobsDone++;
+        job.device->gattBusy = false;
+        s->busy = false;
+    }
+}
+
+/*
+    Dispatch every device once, as scan loop does when readings are due
+    @return ms until last job is done
+*/
+static uint32_t cycle() {
+    uint32_t start = millis();
+    uint8_t next = 0;
+    while (next < DEVICES) {
+        AranetDevice* d = &devices[next];
+        GattJob job = { GATT_JOB_ARANET, d, d->addr, -70, true, false };
+        if (gattDispatch(&job)) next++;
+        else delay(1);
+    }
+    for (AranetDevice &d : devices) {
+        while (d.gattBusy) delay(1);
+    }
+    return millis() - start;
+}
+
+void bench_pool_size() {
+    printf("\n%u devices, connect %u ms, read %u ms\n", DEVICES, CONNECT_MS, READ_MS);
+    uint32_t serial = 0;
+    for (uint8_t size = 1; size <= CFG_GATT_POOL_SIZE; size++) {
+        for (uint8_t i = 0; i < CFG_GATT_POOL_SIZE; i++) gattSlots[i].busy = i >= size;
+
+        uint32_t ms = 0;
+        for (uint8_t r = 0; r < 3; r++) ms += cycle();
+        ms /= 3;
+        if (size == 1) serial = ms;
+        printf("  %u slots %6u ms/cycle  %.2fx\n", size, ms, (double) serial / ms);
+        // connect is serialized, so pool can not beat it
+        TEST_ASSERT_TRUE(ms >= DEVICES * CONNECT_MS);
+        if (size > 1) TEST_ASSERT_TRUE(ms < serial);
+    }
+    for (GattSlot &s : gattSlots) s.busy = false;
+}
+
+/*
+    Pairing denied on one slot is not reported by other slots
+*/
+void test_slot_callbacks() {
+    uint8_t mac[6] = { 0x0F, 0x23, 0x45, 0x67, 0x89, 0xC0 };
+    NimBLEAddress addr(mac, BLE_ADDR_RANDOM);
+    MockAranet sensor;
+    sensor.askPin = true;
+    mockAranetAdd(addr, sensor);
+
+    TEST_ASSERT_FALSE(gattSlots[0].ar4->connect(addr) == AR4_OK);
+    TEST_ASSERT_FALSE(gattSlots[1].callbacks.pairWasdenied());
+    TEST_ASSERT_TRUE(gattSlots[0].callbacks.pairWasdenied());
+    TEST_ASSERT_FALSE(gattSlots[0].callbacks.pairWasdenied());
+}
+
+/*
+    Slot waiting for connect lock held by pairing is not reported stuck
+*/
+void test_wait_not_stuck() {
+    GattSlot* s = &gattSlots[0];
+    std::atomic<bool> locked(false);
+    gattSlotWatchdog(s, 1); // left from previous step of job
+    gattConnectLock();
+    std::thread worker([&] {
+        gattSlotConnectLock(s, 1);
+        locked = true;
+        gattConnectUnlock();
+    });
+    delay(1200); // PIN entry
+    TEST_ASSERT_NULL(gattStuckSlot());
+    TEST_ASSERT_FALSE(locked);
+    gattConnectUnlock();
+    worker.join();
+    TEST_ASSERT_TRUE(locked);
+    TEST_ASSERT_TRUE(s->deadline != 0);
+    s->deadline = 0;
+}
+
+int main() {
+    for (uint8_t i = 0; i < DEVICES; i++) {
+        uint8_t mac[6] = { i, 0x23, 0x45, 0x67, 0x89, 0xC0 };
+        devices[i].addr = NimBLEAddress(mac, BLE_ADDR_RANDOM);
+        MockAranet sensor;
+        sensor.data.type = ARANET4;
+        sensor.data.co2 = 600 + i;
+        sensor.connectMs = CONNECT_MS;
+        sensor.readMs = READ_MS;
+        mockAranetAdd(devices[i].addr, sensor);
+    }
+    gattPoolBegin(benchGattTask);
+
+    UNITY_BEGIN();
+    RUN_TEST(bench_pool_size);
+    RUN_TEST(test_slot_callbacks);
+    RUN_TEST(test_wait_not_stuck);
+    TEST_ASSERT_EQUAL(0, denied);
+    return UNITY_END();
+}
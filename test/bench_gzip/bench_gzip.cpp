@@ -0,0 +1,161 @@
+#include "bench.h"
+#include <Arduino.h>
+#include <unity.h>
+#include "config.h"
+#include "types.h"
+#include "settings.h"
+#include "influx/influx.h"
+
+/*
+    Upload batch compression (gzip.h) and InfluxWriter connection reuse.
+    Batch is MAX_BATCH_SIZE Aranet4 lines of 4 devices, as encoded by
+    influxWriteMeasurement().
+*/
+
+static NodeConfig cfg;
+static char batch[CFG_INFLUX_BATCH_BYTES];
+static size_t batchLen = 0;
+
+void setUp() {
+    mockHttp().requests.clear();
+    mockHttp().code = 204;
+}
+
+void tearDown() {}
+
+static void makeMeasurement(Measurement* m, uint32_t i) {
+    uint8_t mac[6] = { (uint8_t) (i % 4), 0x23, 0x45, 0x67, 0x89, 0xC0 };
+    AranetData data;
+    data.type = ARANET4;
+    data.co2 = 600 + (i * 37) % 500;
+    data.temperature = 440 + i % 17;
+    data.pressure = 10120 + i % 9;
+    data.humidity = 38 + i % 5;
+    data.battery = 90 - i % 4;
+    data.interval = 60;
+    data.ago = i % 60;
+    measurementFromData(m, MEAS_KIND_ARANET, mac, &data, 1700000000 + i * 15, -60 - i % 20);
+}
+
+static void writeLines(InfluxWriter* writer, uint32_t first, uint32_t count) {
+    static const char* names[4] = { "Office", "Kitchen", "Bedroom", "Lab, 2nd floor" };
+    char buf[CFG_INFLUX_LINE_SIZE];
+    Measurement m;
+    for (uint32_t i = first; i < first + count; i++) {
+        makeMeasurement(&m, i);
+        LineWriter lw(buf, sizeof(buf));
+        TEST_ASSERT_TRUE(influxWriteMeasurement(&lw, &cfg, names[i % 4], &m));
+        if (writer) {
+            TEST_ASSERT_TRUE(influxSendLine(writer, &lw));
+        } else {
+            size_t n = lw.length();
+            memcpy(batch + batchLen, buf, n);
+            batchLen += n;
+            batch[batchLen++] = '\n';
+        }
+    }
+    if (!writer) batchLen--; // last newline is not sent
+}
+
+void bench_compress() {
+    static uint8_t packed[CFG_INFLUX_BATCH_BYTES];
+    static uint16_t head[GZIP_HASH_SIZE];
+    writeLines(nullptr, 0, MAX_BATCH_SIZE);
+
+    size_t size = 0;
+    benchTitle("gzipCompress, one batch");
+    char name[64];
+    snprintf(name, sizeof(name), "%u lines, %u B", MAX_BATCH_SIZE, (unsigned) batchLen);
+    BenchResult r = bench(name, [&] {
+        size = gzipCompress((uint8_t*) batch, batchLen, packed, sizeof(packed), head);
+    });
+
+    // gzip member: magic, deflate, trailer with input size
+    TEST_ASSERT_TRUE(size > GZIP_OVERHEAD && size < batchLen);
+    TEST_ASSERT_EQUAL(0x1f, packed[0]);
+    TEST_ASSERT_EQUAL(0x8b, packed[1]);
+    uint32_t isize = packed[size - 4] | (packed[size - 3] << 8) | (packed[size - 2] << 16) | ((uint32_t) packed[size - 1] << 24);
+    TEST_ASSERT_EQUAL(batchLen, isize);
+
+    printf("  %u B -> %u B, %.2fx, %.1f B per line, %.1f MB/s\n",
+        (unsigned) batchLen, (unsigned) size, (double) batchLen / size,
+        (double) size / MAX_BATCH_SIZE, batchLen / r.nsPerOp * 1e3);
+}
+
+/*
+    One connection for all batches, reconnect only after transport error
+*/
+void test_connection_reuse() {
+    cfg.influxGzip = true;
+    InfluxWriter writer(&cfg);
+    uint32_t connects = WiFiClient::connects;
+    uint32_t created = WiFiClient::created;
+
+    for (uint32_t b = 0; b < 10; b++) {
+        writeLines(&writer, b * MAX_BATCH_SIZE, MAX_BATCH_SIZE);
+        writer.flushBuffer();
+        TEST_ASSERT_TRUE(writer.isBufferEmpty());
+    }
+    size_t posts = mockHttp().requests.size(); // batch is split at CFG_INFLUX_BATCH_BYTES
+    TEST_ASSERT_TRUE(posts >= 10);
+    TEST_ASSERT_EQUAL_STRING("gzip", mockHttp().requests[0].headers["Content-Encoding"].c_str());
+    TEST_ASSERT_EQUAL(1, WiFiClient::connects - connects);
+    TEST_ASSERT_EQUAL(1, WiFiClient::created - created);
+    printf("\n%u posts: %u B raw, %u B sent, 1 connection\n", (unsigned) posts, writer.bytesRaw, writer.bytesSent);
+
+    // connection lost, next batch connects again
+    mockHttp().code = -1;
+    writeLines(&writer, 0, 1);
+    writer.flushBuffer();
+    TEST_ASSERT_FALSE(writer.isBufferEmpty());
+    mockHttp().code = 204;
+    delay(CFG_INFLUX_RETRY_INTERVAL + 1);
+    writer.flushBuffer();
+    TEST_ASSERT_TRUE(writer.isBufferEmpty());
+    TEST_ASSERT_EQUAL(2, WiFiClient::connects - connects);
+}
+
+/*
+    Batch rejected by server is dropped, busy or failing server is retried
+*/
+void test_rejected_batch() {
+    cfg.influxGzip = false;
+    InfluxWriter writer(&cfg);
+
+    const int permanent[] = { 400, 404, 413 };
+    for (int code : permanent) {
+        mockHttp().code = code;
+        writeLines(&writer, 0, 3);
+        writer.flushBuffer();
+        TEST_ASSERT_TRUE(writer.isBufferEmpty());
+        TEST_ASSERT_FALSE(writer.isRetryPending());
+    }
+    TEST_ASSERT_EQUAL(9, writer.rejected);
+    TEST_ASSERT_EQUAL(0, writer.failures);
+
+    const int transient[] = { -1, 408, 429, 500, 503 };
+    for (int code : transient) {
+        InfluxWriter retried(&cfg);
+        mockHttp().code = code;
+        writeLines(&retried, 0, 1);
+        retried.flushBuffer();
+        TEST_ASSERT_FALSE(retried.isBufferEmpty());
+        TEST_ASSERT_TRUE(retried.isRetryPending());
+        TEST_ASSERT_EQUAL(1, retried.failures);
+        TEST_ASSERT_EQUAL(0, retried.rejected);
+    }
+}
+
+int main() {
+    settingsLoad(&cfg, "aranet4");
+    strcpy(cfg.sysName, "bridge");
+    strcpy(cfg.influxUrl, "http://influx.local:8086");
+    strcpy(cfg.influxBucket, "aranet");
+    cfg.influxDbVer = 1;
+
+    UNITY_BEGIN();
+    RUN_TEST(bench_compress);
+    RUN_TEST(test_connection_reuse);
+    RUN_TEST(test_rejected_batch);
+    return UNITY_END();
+}
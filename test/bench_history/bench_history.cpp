@@ -0,0 +1,207 @@
+#include "bench.h"
+#include <Arduino.h>
+#include <unity.h>
+#include <thread>
+#include "config.h"
+#include "types.h"
+#include "settings.h"
+#include "cursor.h"
+#include "tsstore.h"
+#include "influx/influx.h"
+
+/*
+    History download throughput, serial vs pipelined (CFG_HISTORY_PIPELINED).
+    Download loop and chunk upload follow downloadHistory() and
+    historyUploadChunk(), egress thread follows EgressTaskCode(). BLE transfer
+    time comes from simulated sensor, upload time from simulated server,
+    series block writes (tsstore.h) take simulated flash time.
+*/
+
+static NodeConfig cfg;
+static EgressRing ring;
+static std::atomic<bool> egressRun;
+static std::atomic<uint32_t> egressStallMs;
+
+void setUp() {}
+
+void tearDown() {}
+
+// same as egressPush() with CFG_EGRESS_HISTORY_WAIT
+static bool push(Measurement* m) {
+    bool ok = ring.push(*m);
+    uint32_t start = millis();
+    while (!ok && millis() - start < CFG_EGRESS_HISTORY_WAIT) {
+        delay(1);
+        ok = ring.push(*m);
+    }
+    egressStallMs += millis() - start;
+    return ok;
+}
+
+static void uploadChunk(HistoryChunk* chunk) {
+    AranetDevice* d = chunk->device;
+    AranetData adata = chunk->base;
+    long timestamp = chunk->timestamp;
+
+    for (uint16_t k = 0; k < chunk->count; k++) {
+        AranetDataCompact* log = &chunk->logs[k];
+        adata.co2 = log->aranet4.co2;
+        adata.temperature = log->aranet4.temperature;
+        adata.pressure = log->aranet4.pressure;
+        adata.humidity = log->aranet4.humidity;
+
+        Measurement m;
+        measurementFromData(&m, MEAS_KIND_ARANET, d->addr.getNative(), &adata, timestamp, 0);
+        push(&m);
+        tsAppend(d, &adata, timestamp);
+        timestamp += adata.interval;
+    }
+    cursorUpdate(d, timestamp - adata.interval, chunk->lastIndex);
+}
+
+static void egressTask(InfluxWriter* writer) {
+    Measurement m;
+    char buf[CFG_INFLUX_LINE_SIZE];
+    while (egressRun) {
+        bool idle = true;
+        for (uint8_t i = 0; i < MAX_BATCH_SIZE && ring.pop(&m); i++) {
+            LineWriter lw(buf, sizeof(buf));
+            if (influxWriteMeasurement(&lw, &cfg, "bench", &m)) influxSendLine(writer, &lw);
+            idle = false;
+        }
+        if (writer->isBatchFull() || (idle && !writer->isBufferEmpty())) writer->flushBuffer();
+        if (idle) delay(1);
+    }
+}
+
+/*
+    @param buffers 1 - serial, chunk is uploaded by GATT worker,
+                   2 - pipelined, uploaded by history upload task
+    @return records per second
+*/
+static double download(AranetDevice* d, uint16_t records, uint8_t buffers, long timestamp) {
+    static AranetDataCompact logs[2][CFG_HISTORY_CHUNK_SIZE];
+    SemaphoreHandle_t free = xSemaphoreCreateCounting(buffers, buffers);
+    QueueHandle_t queue = xQueueCreate(1, sizeof(HistoryChunk));
+    std::atomic<bool> uploaderRun(true);
+
+    std::thread uploader([&] {
+        HistoryChunk chunk;
+        while (uploaderRun) {
+            if (xQueueReceive(queue, &chunk, 10) == pdTRUE) {
+                uploadChunk(&chunk);
+                xSemaphoreGive(chunk.release);
+            }
+        }
+    });
+
+    Aranet4 ar4(nullptr);
+    ar4.connect(d->addr, false);
+    int total = ar4.getTotalReadings();
+    int newRecords = records;
+    int start = total - newRecords;
+    uint8_t chunkNo = 0;
+    uint32_t began = millis();
+
+    while (newRecords > 0) {
+        uint16_t count = newRecords < CFG_HISTORY_CHUNK_SIZE ? newRecords : CFG_HISTORY_CHUNK_SIZE;
+        if (buffers > 1) xSemaphoreTake(free, portMAX_DELAY);
+        AranetDataCompact* buf = logs[chunkNo++ % buffers];
+        ar4.getHistory(start, count, buf, AR4_PARAM_FLAGS);
+        start += count;
+        newRecords -= count;
+
+        HistoryChunk chunk = { d, buf, free, count, (uint16_t) (start - 1), timestamp, d->data };
+        timestamp += d->data.interval * count;
+        if (buffers > 1) {
+            xQueueSend(queue, &chunk, portMAX_DELAY);
+        } else {
+            uploadChunk(&chunk);
+        }
+    }
+
+    // wait for uploads in flight
+    if (buffers > 1) {
+        for (uint8_t i = 0; i < buffers; i++) xSemaphoreTake(free, portMAX_DELAY);
+    }
+    uint32_t elapsed = millis() - began;
+
+    uploaderRun = false;
+    uploader.join();
+    return records * 1000.0 / elapsed;
+}
+
+static void scenario(const char* title, uint32_t recordUs, uint32_t postMs, uint32_t flashMs) {
+    const uint16_t records = 600;
+
+    uint8_t mac[6] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xC0 };
+    AranetDevice d;
+    d.addr = NimBLEAddress(mac, BLE_ADDR_RANDOM);
+    d.data.type = ARANET4;
+    d.data.interval = 60;
+
+    MockAranet sensor;
+    sensor.data = d.data;
+    sensor.total = 2000;
+    sensor.recordUs = recordUs;
+    mockAranetAdd(d.addr, sensor);
+    mockHttp().latencyMs = postMs;
+    mockHttp().record = false;
+
+    InfluxWriter writer(&cfg);
+    tsAppend(&d, &d.data, 1); // series file is created before measurement
+    mockFsWriteMs() = flashMs;
+    egressRun = true;
+    std::thread egress(egressTask, &writer);
+
+    printf("\n%s: BLE %u us/record, POST %u ms per %u lines, flash %u ms per block, %u records\n",
+        title, recordUs, postMs, MAX_BATCH_SIZE, flashMs, records);
+    for (uint8_t buffers = 1; buffers <= 2; buffers++) {
+        egressStallMs = 0;
+        d.cursor = { 0, 0 };
+        static long timestamp = 1700000000;
+        timestamp += 100000; // newer than stored series
+        double rate = download(&d, records, buffers, timestamp);
+        printf("  %-10s %8.0f records/s, producer stalled %u ms\n", buffers == 1 ? "serial" : "pipelined", rate, (uint32_t) egressStallMs);
+        TEST_ASSERT_EQUAL(timestamp + 60 * (records - 1), d.cursor.timestamp);
+
+        // drain before next mode
+        while (!ring.empty() || !writer.isBufferEmpty()) delay(5);
+    }
+
+    egressRun = false;
+    egress.join();
+    mockFsWriteMs() = 0;
+    tsClose(&d);
+}
+
+void bench_ble_bound() {
+    scenario("BLE bound", 2000, 30, 0);
+}
+
+void bench_upload_bound() {
+    scenario("upload bound", 500, 60, 0);
+}
+
+void bench_flash() {
+    scenario("BLE bound, slow flash", 2000, 30, 40);
+}
+
+void bench_balanced_flash() {
+    scenario("balanced, slow flash", 1000, 60, 40);
+}
+
+int main() {
+    settingsLoad(&cfg, "aranet4");
+    strcpy(cfg.influxUrl, "http://influx.local:8086");
+    strcpy(cfg.influxBucket, "aranet");
+    cfg.influxDbVer = 1;
+    cfg.influxGzip = false;
+
+    UNITY_BEGIN();
+    RUN_TEST(bench_ble_bound);
+    RUN_TEST(bench_upload_bound);
+    RUN_TEST(bench_flash);
+    RUN_TEST(bench_balanced_flash);
+    return UNITY_END();
+}
@@ -0,0 +1,126 @@
+#include "bench.h"
+#include <Arduino.h>
+#include <unity.h>
+#include "config.h"
+#include "utils.h"
+#include "settings.h"
+#include "html.h"
+
+/*
+    HTML pages: whole page String (before HtmlWriter) vs chunked response.
+    Chunks have size of one TCP segment, like async_tcp fill() calls.
+    Time to first byte is time until first chunk can be sent, peak heap
+    is heap held by response above level before request.
+*/
+
+#define CHUNK 1436
+
+static NodeConfig cfg;
+
+void setUp() {}
+
+void tearDown() {}
+
+/*
+    Chunked response, fill() until done
+    @return page size
+*/
+static size_t chunked(AsyncWebServerResponse* r, String* out, double* ttfb) {
+    static uint8_t buf[CHUNK];
+    double start = benchNow();
+    size_t index = 0;
+    size_t n;
+    while ((n = r->fill(buf, sizeof(buf), index)) > 0) {
+        if (index == 0 && ttfb) *ttfb = benchNow() - start;
+        if (out) out->concat((const char*) buf, n);
+        index += n;
+    }
+    return index;
+}
+
+/*
+    Page built in String and copied into response, as before HtmlWriter.
+    Page is rendered once and appended in pieces, like page += ... did.
+*/
+static AsyncWebServerResponse* wholePage(AsyncWebServerRequest* request, HtmlRenderer render) {
+    static uint8_t rendered[32768];
+    String page;
+    AsyncWebServerResponse* r = beginHtmlResponse(request, render);
+    size_t size = r->fill(rendered, sizeof(rendered), 0);
+    delete r;
+    for (size_t i = 0; i < size; i += 128) {
+        page.concat((const char*) rendered + i, size - i < 128 ? size - i : 128);
+    }
+    return request->beginResponse(200, "text/html", page);
+}
+
+static void benchPage(const char* title, HtmlRenderer render) {
+    AsyncWebServerRequest request;
+    char name[64];
+    benchTitle(title);
+
+    // same bytes either way
+    String whole;
+    String streamed;
+    AsyncWebServerResponse* r = wholePage(&request, render);
+    whole = r->content;
+    delete r;
+    r = beginHtmlResponse(&request, render);
+    size_t size = chunked(r, &streamed, nullptr);
+    delete r;
+    TEST_ASSERT_EQUAL(whole.length(), size);
+    TEST_ASSERT_EQUAL_STRING(whole.c_str(), streamed.c_str());
+
+    int64_t base = allocStats.live;
+    allocPeakReset();
+    double start = benchNow();
+    r = wholePage(&request, render);
+    double ttfbWhole = benchNow() - start;
+    int64_t peakWhole = allocPeakAbove(base);
+    delete r;
+
+    base = allocStats.live;
+    allocPeakReset();
+    double ttfbChunked = 0;
+    r = beginHtmlResponse(&request, render);
+    chunked(r, nullptr, &ttfbChunked);
+    int64_t peakChunked = allocPeakAbove(base);
+    delete r;
+
+    snprintf(name, sizeof(name), "whole page String, %u B", (unsigned) size);
+    bench(name, [&] {
+        delete wholePage(&request, render);
+    });
+    snprintf(name, sizeof(name), "chunked, %u chunks", (unsigned) ((size + CHUNK - 1) / CHUNK));
+    bench(name, [&] {
+        AsyncWebServerResponse* c = beginHtmlResponse(&request, render);
+        chunked(c, nullptr, nullptr);
+        delete c;
+    });
+
+    printf("  first byte: whole page %.1f us, chunked %.1f us\n", ttfbWhole * 1e6, ttfbChunked * 1e6);
+    printf("  peak heap:  whole page %lld B, chunked %lld B\n", (long long) peakWhole, (long long) peakChunked);
+    TEST_ASSERT_TRUE(peakChunked < peakWhole);
+    TEST_ASSERT_TRUE(peakChunked < 1024);
+}
+
+void bench_index() {
+    benchPage("index page", [](HtmlWriter* w) { printHtmlIndex(w); });
+}
+
+void bench_settings() {
+    benchPage("settings page", [](HtmlWriter* w) { printHtmlConfig(w, &cfg); });
+}
+
+void bench_devices() {
+    benchPage("devices page", [](HtmlWriter* w) { printDevicesPage(w); });
+}
+
+int main() {
+    settingsLoad(&cfg, "aranet4");
+    UNITY_BEGIN();
+    RUN_TEST(bench_index);
+    RUN_TEST(bench_settings);
+    RUN_TEST(bench_devices);
+    return UNITY_END();
+}
@@ -0,0 +1,126 @@
+#include "bench.h"
+#include <Arduino.h>
+#include <unity.h>
+#include "config.h"
+#include "types.h"
+#include "settings.h"
+#include "influx/influx.h"
+
+/*
+    Line encoding per measurement: Point of InfluxDB client (write path
+    before lineproto.h) vs LineWriter. Point path follows removed
+    influxCreateMeasurementPoint() and pointToLineProtocol().
+*/
+
+static NodeConfig cfg;
+static const char* deviceName = "Office, 2nd floor";
+
+void setUp() {}
+
+void tearDown() {}
+
+static Point oldAranetPoint(const char* name, AranetData* data) {
+    Point point("aranet");
+    point.addTag("device", cfg.sysName);
+    point.addTag("name", name);
+
+    if (data->type == AranetType::ARANET_RADIATION) {
+        if (data->radiation_duration) point.addField("duration", data->radiation_duration);
+        point.addField("radiation", data->radiation_rate / 1000.0);
+        point.addField("radiation_total", data->radiation_total / 1000.0);
+    } else if (data->type == AranetType::ARANET2) {
+        point.addField("temperature", data->temperature / 20.0);
+        point.addField("humidity", data->humidity / 10.0);
+    } else if (data->type == AranetType::ARANET4) {
+        point.addField("co2", data->co2);
+        point.addField("temperature", data->temperature / 20.0);
+        point.addField("pressure", data->pressure / 10.0);
+        point.addField("humidity", data->humidity / 1.0);
+    }
+    point.addField("battery", data->battery);
+    point.addField("interval", data->interval);
+    point.addField("ago", data->ago);
+    return point;
+}
+
+static String oldEncode(Measurement* m) {
+    AranetData data;
+    measurementToData(m, &data);
+    Point point = oldAranetPoint(deviceName, &data);
+    if (m->rssi) point.addField("rssi", m->rssi);
+    point.setTime(m->timestamp);
+    return point.toLineProtocol();
+}
+
+static void makeMeasurements(Measurement* ms) {
+    uint8_t mac[6] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xC0 };
+    AranetData data;
+    data.type = ARANET4;
+    data.co2 = 812;
+    data.temperature = 451;
+    data.pressure = 10132;
+    data.humidity = 41;
+    data.battery = 87;
+    data.interval = 60;
+    data.ago = 17;
+    measurementFromData(&ms[0], MEAS_KIND_ARANET, mac, &data, 1700000000, -71);
+
+    mac[0]++;
+    data.type = ARANET2;
+    data.temperature = 402;
+    data.humidity = 553;
+    measurementFromData(&ms[1], MEAS_KIND_ARANET, mac, &data, 1700000060, -80);
+
+    mac[0]++;
+    data.type = ARANET_RADIATION;
+    data.radiation_rate = 110;
+    data.radiation_total = 5123456;
+    data.radiation_duration = 0;
+    measurementFromData(&ms[2], MEAS_KIND_ARANET, mac, &data, 1700000120, -65);
+}
+
+void test_same_line() {
+    Measurement ms[3];
+    makeMeasurements(ms);
+    char buf[CFG_INFLUX_LINE_SIZE];
+    for (Measurement &m : ms) {
+        LineWriter lw(buf, sizeof(buf));
+        TEST_ASSERT_TRUE(influxWriteMeasurement(&lw, &cfg, deviceName, &m));
+        TEST_ASSERT_EQUAL_STRING(oldEncode(&m).c_str(), buf);
+    }
+}
+
+void bench_encode() {
+    Measurement ms[3];
+    makeMeasurements(ms);
+    char buf[CFG_INFLUX_LINE_SIZE];
+    uint32_t next = 0;
+    volatile size_t len;
+
+    benchTitle("measurement mix: Aranet4, Aranet2, radiation");
+
+    BenchResult old = bench("Point + toLineProtocol", [&] {
+        String line = oldEncode(&ms[next++ % 3]);
+        len = line.length();
+    });
+
+    BenchResult lp = bench("LineWriter", [&] {
+        LineWriter lw(buf, sizeof(buf));
+        influxWriteMeasurement(&lw, &cfg, deviceName, &ms[next++ % 3]);
+        len = lw.length();
+    });
+    (void) len;
+
+    printf("  %.1fx points/s, %.1f fewer allocations per point\n", old.nsPerOp / lp.nsPerOp, old.allocsPerOp - lp.allocsPerOp);
+    TEST_ASSERT_TRUE(lp.allocsPerOp < 0.01);
+}
+
+int main() {
+    settingsLoad(&cfg, "aranet4");
+    strcpy(cfg.sysName, "bridge 1");
+
+    UNITY_BEGIN();
+    RUN_TEST(test_same_line);
+    RUN_TEST(bench_encode);
+    return UNITY_END();
+}
@@ -0,0 +1,102 @@
+#include "bench.h"
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+#include "config.h"
+#include "types.h"
+#include "registry.h"
+
+/*
+    Device lookup per advertisement: linear scan over device list
+    (before hash index) vs DeviceIndex, with and without devicesMux
+*/
+
+portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+void setUp() {}
+
+void tearDown() {}
+
+static void makeDevices(std::vector<AranetDevice*>* devices, uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t mac[6] = { (uint8_t) i, (uint8_t) (i >> 8), 0x5A, (uint8_t) (i * 7), 0x3C, 0xC0 };
+        AranetDevice* d = new AranetDevice();
+        d->addr = NimBLEAddress(mac, BLE_ADDR_RANDOM);
+        devices->push_back(d);
+    }
+}
+
+static AranetDevice* linearFind(std::vector<AranetDevice*> &devices, const NimBLEAddress &addr) {
+    for (AranetDevice* d : devices) {
+        if (d->addr == addr) return d;
+    }
+    return nullptr;
+}
+
+template <uint16_t N>
+static void benchCount(uint16_t count) {
+    std::vector<AranetDevice*> devices;
+    makeDevices(&devices, count);
+
+    static DeviceIndex<AranetDevice, N> index;
+    index.clear();
+    for (AranetDevice* d : devices) TEST_ASSERT_TRUE(index.insert(macKey(d->addr.getNative()), d));
+
+    uint8_t unknown[6] = { 1, 2, 3, 4, 5, 6 };
+    NimBLEAddress miss(unknown, BLE_ADDR_RANDOM);
+    uint16_t next = 0;
+    AranetDevice* found = nullptr;
+
+    char title[64];
+    snprintf(title, sizeof(title), "%u devices", count);
+    benchTitle(title);
+
+    bench("linear scan, hit", [&] {
+        found = linearFind(devices, devices[next++ % count]->addr);
+    });
+    TEST_ASSERT_NOT_NULL(found);
+
+    bench("linear scan, miss", [&] {
+        found = linearFind(devices, miss);
+    });
+    TEST_ASSERT_NULL(found);
+
+    bench("index, hit", [&] {
+        found = index.find(macKey(devices[next++ % count]->addr.getNative()));
+    });
+    TEST_ASSERT_NOT_NULL(found);
+
+    bench("index, miss", [&] {
+        found = index.find(macKey(miss.getNative()));
+    });
+    TEST_ASSERT_NULL(found);
+
+    bench("index under devicesMux, hit", [&] {
+        portENTER_CRITICAL(&mux);
+        found = index.find(macKey(devices[next++ % count]->addr.getNative()));
+        portEXIT_CRITICAL(&mux);
+    });
+    TEST_ASSERT_NOT_NULL(found);
+
+    for (AranetDevice* d : devices) delete d;
+}
+
+void bench_10() {
+    benchCount<16>(10);
+}
+
+void bench_100() {
+    benchCount<256>(100);
+}
+
+void bench_1000() {
+    benchCount<2048>(1000);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(bench_10);
+    RUN_TEST(bench_100);
+    RUN_TEST(bench_1000);
+    return UNITY_END();
+}
@@ -0,0 +1,378 @@
+#include "bench.h"
+#define CFG_CAPTURE 1
+#include <Arduino.h>
+#include <unity.h>
+#include <math.h>
+#include <set>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "types.h"
+#include "registry.h"
+#include "scan.h"
+
+/*
+    Replay of advertisement capture (capture.h) through scan callback and
+    consumer. Consumer follows processAdvertisement() and
+    registerScannedDevice(): registry lookups, vendor decode and reading
+    push. GATT jobs, scheduler and web push are left out. Every other
+    device of known vendor is saved, rest stay scanned devices.
+
+    Capture file is read from AR4_CAPTURE, as downloaded from /capture.
+    Without it, simulated office is recorded with captureAdv() until
+    capture buffer is full. AR4_REPLAY_SPEED sets speed of timed replay,
+    1 - recorded speed, default 10.
+*/
+
+// Aranet4: flags, manufacturer data with counter in last byte
+static const uint8_t advAranet[] = {
+    0x02, 0x01, 0x06,
+    0x19, 0xFF, 0x02, 0x07, 0x21, 0x13, 0x04, 0x01, 0x00, 0x0F, 0x01, 0x00, 0xE0, 0x01, 0x9A, 0x01,
+    0x93, 0x27, 0x2A, 0x5F, 0x01, 0x3C, 0x00, 0x1E, 0x00, 0x07
+};
+
+// Aranet4 scan response: complete name
+static const uint8_t advAranetName[] = {
+    0x0E, 0x09, 'A', 'r', 'a', 'n', 'e', 't', '4', ' ', '1', '2', '3', '4', '5'
+};
+
+// MikroTik tag
+static const uint8_t advMikrotik[] = {
+    0x02, 0x01, 0x06,
+    0x15, 0xFF, 0x4F, 0x09, 0x01, 0x00, 0x12, 0x34, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x17, 0x10, 0x27, 0x00, 0x00, 0x00, 0x5A
+};
+
+// Airvalent: 128-bit service
+static const uint8_t advAirvalent[] = {
+    0x02, 0x01, 0x06,
+    0x11, 0x07, 0xDF, 0x02, 0xEA, 0x29, 0x82, 0x0C, 0x57, 0x93, 0x41, 0x4D, 0x2B, 0x6B, 0xA4, 0x94, 0x1C, 0xB8
+};
+
+// iBeacon, stands for phones, tags and other unrelated traffic
+static const uint8_t advBeacon[] = {
+    0x02, 0x01, 0x06,
+    0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60,
+    0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5
+};
+
+static const char* vendorNames[] = { "Aranet", "MikroTik", "Airvalent", "ignored" }; // by AdvVendor
+
+static std::vector<NimBLEAdvertisedDevice> advs;
+static std::vector<uint32_t> times; // ms since capture start
+static std::vector<AdvVendor> vendors;
+static uint32_t captureLostRecords = 0;
+static bool simulated = false;
+
+static AdvRing ring;
+static MyScanCallbacks callbacks(&ring);
+static EgressRing egress;
+static DeviceIndex<AranetDevice, CFG_SAVED_INDEX_SIZE> savedIndex;
+static DeviceIndex<AranetDevice, CFG_SCANNED_INDEX_SIZE> scannedIndex;
+static uint32_t readings = 0;
+
+void setUp() {}
+
+void tearDown() {}
+
+/*
+    Simulated office: 8 Aranet4 with scan responses, 4 MikroTik tags,
+    Airvalent and 48 phones and beacons advertising every 100-200 ms
+*/
+static std::vector<uint8_t> recordOffice() {
+    TEST_ASSERT_TRUE(captureStart());
+    uint32_t start = captureStartedAt;
+
+    for (uint32_t t = 0; captureLost == 0; t++) {
+        for (uint8_t i = 0; i < 61; i++) {
+            uint8_t mac[6] = { i, 0x5A, 0x3C, 0x00, 0x00, 0xC0 };
+            int8_t rssi = -50 - (i * 7 + t / 100) % 45;
+            uint32_t phase = i * 37;
+            if (i < 8) {
+                if ((t + phase) % 1000 == 0) {
+                    uint8_t payload[sizeof(advAranet)];
+                    memcpy(payload, advAranet, sizeof(payload));
+                    payload[15] = 0x80 + i;
+                    captureAdv(mac, BLE_ADDR_RANDOM, rssi, payload, sizeof(payload), start + t);
+                }
+                if ((t + phase) % 1000 == 5) captureAdv(mac, BLE_ADDR_RANDOM, rssi, advAranetName, sizeof(advAranetName), start + t);
+            } else if (i < 12) {
+                if ((t + phase) % 1000 == 0) captureAdv(mac, BLE_ADDR_RANDOM, rssi, advMikrotik, sizeof(advMikrotik), start + t);
+            } else if (i < 13) {
+                if ((t + phase) % 2000 == 0) captureAdv(mac, BLE_ADDR_RANDOM, rssi, advAirvalent, sizeof(advAirvalent), start + t);
+            } else {
+                if ((t + phase) % (100 + i * 2) == 0) captureAdv(mac, BLE_ADDR_RANDOM, rssi, advBeacon, sizeof(advBeacon), start + t);
+            }
+        }
+    }
+
+    // download, as GET /capture
+    CaptureWriter writer;
+    TEST_ASSERT_TRUE(writer.begin());
+    std::vector<uint8_t> file(writer.size());
+    size_t index = 0;
+    while (index < file.size()) index += writer.read(file.data() + index, 1436, index);
+    return file;
+}
+
+static std::vector<uint8_t> readFile(const char* path) {
+    std::vector<uint8_t> file;
+    FILE* f = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) file.insert(file.end(), buf, buf + n);
+    fclose(f);
+    return file;
+}
+
+static uint32_t u32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void loadCapture(const std::vector<uint8_t> &file) {
+    TEST_ASSERT_TRUE(file.size() >= CAPTURE_HEADER_SIZE);
+    TEST_ASSERT_EQUAL(0, memcmp(file.data(), "AR4C", 4));
+    TEST_ASSERT_EQUAL(CAPTURE_VERSION, file[4]);
+    TEST_ASSERT_EQUAL(6, file[5]);
+    uint32_t records = u32(&file[12]);
+    captureLostRecords = u32(&file[16]);
+
+    size_t pos = CAPTURE_HEADER_SIZE;
+    for (uint32_t i = 0; i < records; i++) {
+        TEST_ASSERT_TRUE(pos + CAPTURE_RECORD_SIZE <= file.size());
+        const uint8_t* p = &file[pos];
+        uint8_t len = p[12];
+        TEST_ASSERT_TRUE(pos + CAPTURE_RECORD_SIZE + len <= file.size());
+
+        AdvInfo info;
+        if (!adClassify(p + CAPTURE_RECORD_SIZE, len, advMatchTable, &info)) info.vendor = ADV_VENDOR_NONE;
+        advs.emplace_back(NimBLEAddress(p + 4, p[10]), (int8_t) p[11], p + CAPTURE_RECORD_SIZE, len);
+        times.push_back(u32(p));
+        vendors.push_back(info.vendor);
+        pos += CAPTURE_RECORD_SIZE + len;
+    }
+    TEST_ASSERT_EQUAL(file.size(), pos);
+}
+
+// every other device of known vendor is saved, by first appearance
+static void saveDevices() {
+    std::set<uint64_t> seen;
+    for (size_t i = 0; i < advs.size(); i++) {
+        if (vendors[i] == ADV_VENDOR_NONE) continue;
+        uint64_t key = macKey(advs[i].getAddress().getNative());
+        if (!seen.insert(key).second || seen.size() % 2 == 0 || savedIndex.full()) continue;
+        AranetDevice* d = new AranetDevice();
+        d->addr = advs[i].getAddress();
+        d->enabled = true;
+        savedIndex.insert(key, d);
+    }
+}
+
+static void reading(AranetDevice* d, uint8_t kind, int8_t rssi) {
+    d->updated = millis() | 1;
+    Measurement m;
+    measurementFromData(&m, kind, d->addr.getNative(), &d->data, 0, rssi);
+    egress.push(m);
+    readings++;
+}
+
+// processAdvertisement() without GATT and scheduler
+static void consume(AdvRecord* adv) {
+    uint64_t key = macKey(adv->addr);
+    AranetDevice* d = savedIndex.find(key);
+    AdSpan mfr = adv->mfr();
+    const uint8_t* data = mfr.data;
+    int len = mfr.len;
+
+    if (d && d->enabled) {
+        switch (adv->info.vendor) {
+        case ADV_VENDOR_ARANET:
+            if (len >= 9) {
+                uint8_t counter = d->data.counter;
+                bool first = d->updated == 0;
+                if (d->data.parseFromAdvertisement(data + 2, len - 2, ARANET4) && (first || counter != d->data.counter)) {
+                    reading(d, MEAS_KIND_ARANET, adv->rssi);
+                }
+            }
+            break;
+        case ADV_VENDOR_MIKROTIK: {
+            MikroTikBeacon beacon;
+            beacon.unpack(data, len);
+            if (!beacon.isValid()) break;
+            Measurement m;
+            memset(&m, 0, sizeof(m));
+            m.kind = MEAS_KIND_MIKROTIK;
+            m.type = beacon.flags;
+            m.battery = beacon.battery;
+            memcpy(m.mac, adv->addr, 6);
+            m.rssi = adv->rssi;
+            m.tag.temperature = beacon.hasTemperature() ? (int16_t) lroundf(beacon.temperature * 100) : MEAS_NO_TEMPERATURE;
+            m.tag.accel[0] = lroundf(beacon.acceleration.x * 1000);
+            m.tag.accel[1] = lroundf(beacon.acceleration.y * 1000);
+            m.tag.accel[2] = lroundf(beacon.acceleration.z * 1000);
+            egress.push(m);
+            readings++;
+            break;
+        }
+        default:
+            break; // Airvalent is read over GATT
+        }
+        d->lastSeen = millis();
+        d->rssi = adv->rssi;
+        return;
+    }
+
+    // registerScannedDevice()
+    d = scannedIndex.find(key);
+    if (!d) {
+        if (scannedIndex.full()) return;
+        d = new AranetDevice();
+        adv->copyName(d->name, sizeof(d->name));
+        d->addr = adv->address();
+        scannedIndex.insert(key, d);
+    } else if (adv->info.nameLen > 0) {
+        char fresh[sizeof(d->name)];
+        adv->copyName(fresh, sizeof(fresh));
+        if (strcmp(fresh, d->name) != 0) strcpy(d->name, fresh);
+    }
+    d->lastSeen = millis();
+    d->rssi = adv->rssi;
+}
+
+static uint32_t drain() {
+    uint32_t n = 0;
+    AdvRecord* adv;
+    while ((adv = ring.front()) != nullptr) {
+        consume(adv);
+        ring.pop();
+        n++;
+    }
+    while (egress.front()) egress.pop();
+    return n;
+}
+
+static void deliver(size_t i) {
+    NimBLEDevice::getScan()->mockResult(&advs[i]);
+}
+
+void test_load() {
+    const char* path = getenv("AR4_CAPTURE");
+    std::vector<uint8_t> file = path ? readFile(path) : recordOffice();
+    simulated = path == nullptr;
+    loadCapture(file);
+    TEST_ASSERT_TRUE(advs.size() > 0);
+    NimBLEDevice::getScan()->setAdvertisedDeviceCallbacks(&callbacks);
+    saveDevices();
+
+    uint32_t counts[4] = { 0 };
+    for (AdvVendor v : vendors) counts[v]++;
+    double seconds = (times.back() + 1) / 1000.0;
+    printf("\n%s: %u B, %u adverts in %.1f s (%.0f/s), %u lost\n", path ? path : "simulated office",
+        (unsigned) file.size(), (unsigned) advs.size(), seconds, advs.size() / seconds, captureLostRecords);
+    for (uint8_t v = 0; v < 4; v++) printf("  %-10s %6u\n", vendorNames[v], counts[v]);
+    printf("  %u saved devices\n", savedIndex.size());
+    if (simulated) {
+        TEST_ASSERT_TRUE(captureLostRecords > 0); // recorded until buffer was full
+        TEST_ASSERT_TRUE(counts[ADV_VENDOR_ARANET] > 0 && counts[ADV_VENDOR_MIKROTIK] > 0 && counts[ADV_VENDOR_NONE] > 0);
+    }
+}
+
+/*
+    As fast as possible: adverts/s, per vendor cost and allocations
+*/
+void bench_dispatch() {
+    // first pass makes scanned devices, as after boot
+    uint64_t allocs = allocStats.count;
+    for (size_t i = 0; i < advs.size(); i++) {
+        deliver(i);
+        drain();
+    }
+    printf("\nfirst pass: %llu allocations, %u scanned devices, %u readings\n",
+        (unsigned long long) (allocStats.count - allocs), scannedIndex.size(), readings);
+
+    benchTitle("whole capture, callback + consumer");
+    size_t n = advs.size();
+    BenchResult all = bench("per advert", [&] {
+        for (size_t i = 0; i < n; i++) {
+            deliver(i);
+            drain();
+        }
+    }, n);
+    printf("  %.0f adverts/s\n", 1e9 / all.nsPerOp);
+    TEST_ASSERT_TRUE(all.allocsPerOp < 0.01);
+
+    benchTitle("per vendor");
+    char name[64];
+    double total = 0;
+    double cost[4] = { 0 };
+    uint32_t counts[4] = { 0 };
+    for (uint8_t v = 0; v < 4; v++) {
+        std::vector<size_t> idx;
+        for (size_t i = 0; i < n; i++) if (vendors[i] == v) idx.push_back(i);
+        if (idx.empty()) continue;
+        size_t next = 0;
+        snprintf(name, sizeof(name), "%s, %u adverts", vendorNames[v], (unsigned) idx.size());
+        BenchResult r = bench(name, [&] {
+            deliver(idx[next++ % idx.size()]);
+            drain();
+        });
+        counts[v] = idx.size();
+        cost[v] = r.nsPerOp * idx.size();
+        total += cost[v];
+    }
+    for (uint8_t v = 0; v < 4; v++) {
+        if (counts[v]) printf("  %-10s %5.1f%% of time\n", vendorNames[v], cost[v] * 100 / total);
+    }
+}
+
+/*
+    Recorded timing scaled by speed, consumer in own thread like loop task
+*/
+void bench_timed() {
+    const char* env = getenv("AR4_REPLAY_SPEED");
+    double speed = env ? atof(env) : 10;
+    if (speed <= 0) speed = 10;
+
+    std::atomic<bool> done(false);
+    uint32_t maxDepth = 0;
+    uint32_t consumed = 0;
+    uint32_t dropped = callbacks.dropped;
+    std::thread loopTask([&] {
+        while (!done || !ring.empty()) {
+            uint32_t depth = ring.size();
+            if (depth > maxDepth) maxDepth = depth;
+            consumed += drain();
+            delay(1);
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    double lateMs = 0;
+    for (size_t i = 0; i < advs.size(); i++) {
+        auto at = start + std::chrono::microseconds((uint64_t) (times[i] * 1000 / speed));
+        std::this_thread::sleep_until(at);
+        double late = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - at).count();
+        if (late > lateMs) lateMs = late;
+        deliver(i);
+    }
+    done = true;
+    loopTask.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dropped = callbacks.dropped - dropped;
+
+    printf("\ntimed replay at %.0fx: %.2f s, %.0f adverts/s offered\n", speed, elapsed, advs.size() / elapsed);
+    printf("  ring max depth %u of %u, %u dropped, producer max %.2f ms late\n", maxDepth, CFG_ADV_RING_SIZE, dropped, lateMs);
+    uint32_t known = 0;
+    for (AdvVendor v : vendors) known += v != ADV_VENDOR_NONE;
+    TEST_ASSERT_EQUAL(known - dropped, consumed);
+    if (simulated) TEST_ASSERT_EQUAL(0, dropped);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_load);
+    RUN_TEST(bench_dispatch);
+    RUN_TEST(bench_timed);
+    return UNITY_END();
+}
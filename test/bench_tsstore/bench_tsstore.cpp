@@ -0,0 +1,146 @@
+#include "bench.h"
+#include <Arduino.h>
+#include <unity.h>
+#include "config.h"
+#include "types.h"
+#include "registry.h"
+#include "tsstore.h"
+
+/*
+    Time series store (tsstore.h): encoded bytes per sample for typical
+    readings, append cost, and /series query latency with chunks of one
+    TCP segment, as sent by chunked HTTP response.
+*/
+
+#define CHUNK 1436
+
+static AranetDevice device;
+
+AranetDevice* findSavedDevice(uint64_t key) {
+    return key == macKey(device.addr.getNative()) ? &device : nullptr;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+// slowly changing Aranet4 readings, one per minute
+static void nextReading(AranetData* data, uint32_t i) {
+    data->co2 = 600 + (i * 7) % 400 - (i % 5);
+    data->temperature = 450 + (i / 30) % 20;
+    data->humidity = 400 + (i / 10) % 30;
+    data->pressure = 10100 + (i / 60) % 15;
+}
+
+static double bytesPerSample(uint8_t type) {
+    static uint8_t block[CFG_TS_BLOCK_SIZE];
+    TsBlockWriter writer(block, sizeof(block));
+    AranetData data;
+    TsSample s;
+    uint32_t samples = 0;
+    uint32_t bytes = 0;
+    uint32_t i = 0;
+
+    for (uint8_t b = 0; b < 16; b++) {
+        writer.begin(b, type);
+        for (;; i++) {
+            nextReading(&data, i);
+            data.type = (AranetType) type;
+            data.radiation_rate = 100 + i % 13;
+            data.radiation_total = 5000000 + i * 110;
+            tsSampleFromData(&s, &data, 1700000000 + i * 60);
+            if (!writer.append(&s)) break;
+        }
+        samples += writer.header()->count;
+        bytes += CFG_TS_BLOCK_SIZE;
+    }
+    return (double) bytes / samples;
+}
+
+void bench_size() {
+    printf("\nencoded size, %u byte blocks incl. %u byte header\n", CFG_TS_BLOCK_SIZE, (unsigned) sizeof(TsBlockHeader));
+    printf("  Aranet4        %6.2f B/sample\n", bytesPerSample(ARANET4));
+    printf("  radiation      %6.2f B/sample\n", bytesPerSample(ARANET_RADIATION));
+    printf("  TsSample       %6u B/sample, uncompressed\n", (unsigned) sizeof(TsSample));
+    printf("  Measurement    %6u B/sample, flash queue record\n", (unsigned) sizeof(Measurement));
+    printf("  %u blocks      %6.1f days of 1 minute Aranet4 readings\n", CFG_TS_BLOCKS,
+        CFG_TS_BLOCKS * CFG_TS_BLOCK_SIZE / bytesPerSample(ARANET4) / 1440);
+}
+
+void bench_query() {
+    static uint32_t i = 0;
+    uint32_t first = 1700000000;
+
+    benchTitle("append and query");
+    bench("tsAppend", [&] {
+        nextReading(&device.data, i);
+        tsAppend(&device, &device.data, first + i * 60);
+        i++;
+    });
+
+    // fill whole ring
+    while (i < CFG_TS_BLOCKS * (uint32_t) (CFG_TS_BLOCK_SIZE / 5)) {
+        nextReading(&device.data, i);
+        tsAppend(&device, &device.data, first + i * 60);
+        i++;
+    }
+    uint32_t last = first + (i - 1) * 60;
+    uint64_t key = macKey(device.addr.getNative());
+    static uint8_t buf[CHUNK];
+
+    struct {
+        const char* name;
+        uint32_t from;
+    } ranges[] = {
+        { "query, last hour", last - 3600 },
+        { "query, last day", last - 86400 },
+        { "query, whole series", 0 },
+    };
+
+    for (auto &r : ranges) {
+        size_t total = 0;
+        uint32_t lines = 0;
+        uint32_t chunks = 0;
+        double ttfb = 0;
+        BenchResult res = bench(r.name, [&] {
+            double start = benchNow();
+            TsQuery query(key, r.from, 0xFFFFFFFF);
+            total = 0;
+            lines = 0;
+            chunks = 0;
+            size_t n;
+            while ((n = query.read(buf, sizeof(buf))) > 0) {
+                if (chunks++ == 0) ttfb = benchNow() - start;
+                total += n;
+                for (size_t k = 0; k < n; k++) lines += buf[k] == '\n';
+            }
+        });
+        TEST_ASSERT_TRUE(total > 0);
+        printf("  %u lines in %u chunks, first chunk %.1f us, %.2f us per chunk\n",
+            lines, chunks, ttfb * 1e6, res.nsPerOp / 1000 / chunks);
+    }
+
+    // device removed while response is sent
+    TsQuery query(key, 0, 0xFFFFFFFF);
+    TEST_ASSERT_TRUE(query.read(buf, sizeof(buf)) > 0);
+    uint8_t other[6] = { 9, 9, 9, 9, 9, 9 };
+    NimBLEAddress saved = device.addr;
+    device.addr = NimBLEAddress(other, BLE_ADDR_RANDOM);
+    size_t rest = 0, n;
+    while ((n = query.read(buf, sizeof(buf))) > 0) rest += n;
+    TEST_ASSERT_TRUE(rest < 8 * CHUNK); // rest of loaded block only
+    device.addr = saved;
+}
+
+int main() {
+    uint8_t mac[6] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xC1 };
+    device.addr = NimBLEAddress(mac, BLE_ADDR_RANDOM);
+    device.data.type = ARANET4;
+    device.data.interval = 60;
+
+    UNITY_BEGIN();
+    RUN_TEST(bench_size);
+    RUN_TEST(bench_query);
+    tsClose(&device);
+    return UNITY_END();
+}
@@ -0,0 +1,277 @@
+#ifndef __MOCK_ARANET4_H
+#define __MOCK_ARANET4_H
+
+/*
+    Aranet4-ESP32 library API with simulated sensors. Sensors are added
+    with mockAranetAdd(), connect, reads and history requests sleep for
+    configured time, so GATT pool and history pipeline can be timed on host.
+    Advertisement layout follows Aranet4 v1.2 manufacturer data.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include "Arduino.h"
+#include "NimBLEDevice.h"
+
+typedef uint16_t ar4_err_t;
+
+#define AR4_OK                   0
+#define AR4_FAIL                 ((ar4_err_t) -1)
+#define AR4_ERR_NO_GATT_SERVICE  0x01
+#define AR4_ERR_NO_GATT_CHAR     0x02
+#define AR4_ERR_NO_CLIENT        0x03
+#define AR4_ERR_NOT_CONNECTED    0x04
+
+#define ARANET4_MANUFACTURER_ID  0x0702
+
+#define AR4_PARAM_TEMPERATURE_FLAG       (1 << 1)
+#define AR4_PARAM_HUMIDITY_FLAG          (1 << 2)
+#define AR4_PARAM_PRESSURE_FLAG          (1 << 3)
+#define AR4_PARAM_CO2_FLAG               (1 << 4)
+#define AR4_PARAM_HUMIDITY2_FLAG         (1 << 5)
+#define AR4_PARAM_RADIATION_DOSE_FLAG    (1 << 6)
+#define AR4_PARAM_RADIATION_RATE_FLAG    (1 << 7)
+#define AR4_PARAM_RADIATION_PULSES_FLAG  (1 << 8)
+#define AR4_PARAM_FLAGS (AR4_PARAM_TEMPERATURE_FLAG | AR4_PARAM_HUMIDITY_FLAG | AR4_PARAM_PRESSURE_FLAG | AR4_PARAM_CO2_FLAG)
+#define AR2_PARAM_FLAGS (AR4_PARAM_TEMPERATURE_FLAG | AR4_PARAM_HUMIDITY2_FLAG)
+#define ARR_PARAM_FLAGS (AR4_PARAM_RADIATION_DOSE_FLAG | AR4_PARAM_RADIATION_RATE_FLAG)
+
+enum AranetType : uint8_t {
+    ARANET4 = 1,
+    ARANET2 = 2,
+    ARANET_RADIATION = 3,
+    UNKNOWN = 0xFF
+};
+
+class AranetData {
+public:
+    AranetType type = ARANET4;
+    uint16_t co2 = 0;
+    uint16_t temperature = 0;
+    uint16_t pressure = 0;
+    uint16_t humidity = 0;
+    uint8_t  battery = 0;
+    uint8_t  status = 0;
+    uint8_t  counter = 0;
+    uint16_t interval = 0;
+    uint16_t ago = 0;
+
+    uint32_t radiation_pulses = 0;
+    uint32_t radiation_rate = 0;
+    uint64_t radiation_total = 0;
+    uint32_t radiation_duration = 0;
+
+    /*
+        @param data manufacturer data after company id
+    */
+    bool parseFromAdvertisement(const uint8_t* data, size_t len, AranetType t) {
+        type = t;
+        if (len < 21) return false;
+        const uint8_t* p = data + 8;
+        if (type == ARANET_RADIATION) {
+            radiation_rate = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+            radiation_total = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t) p[7] << 24;
+        } else {
+            co2 = p[0] | p[1] << 8;
+            temperature = p[2] | p[3] << 8;
+            pressure = p[4] | p[5] << 8;
+            humidity = p[6];
+        }
+        battery = p[7];
+        status = p[8];
+        interval = p[9] | p[10] << 8;
+        ago = p[11] | p[12] << 8;
+        counter = len > 21 ? data[21] : 0;
+        return interval > 0;
+    }
+
+    uint16_t getCO2() { return co2; }
+    float getTemperature() { return temperature / 20.0; }
+    float getPressure() { return pressure / 10.0; }
+    float getHumidity() { return type == ARANET2 ? humidity / 10.0 : humidity; }
+    unsigned long getRadiationRate() { return radiation_rate; }
+    unsigned long long getRadiationTotal() { return radiation_total; }
+    unsigned long getRadiationDuration() { return radiation_duration; }
+};
+
+typedef union {
+    struct {
+        uint16_t co2;
+        uint16_t temperature;
+        uint16_t pressure;
+        uint16_t humidity;
+    } aranet4;
+    struct {
+        uint32_t rad_pulses;
+        uint32_t rad_dose_rate;
+        uint64_t rad_dose_integral;
+    } aranetr;
+} AranetDataCompact;
+
+class Aranet4Callbacks: public NimBLEClientCallbacks {
+public:
+    virtual uint32_t onPinRequested() = 0;
+
+    uint32_t onPassKeyRequest() {
+        return onPinRequested();
+    }
+};
+
+// simulated sensor
+typedef struct {
+    AranetData data;
+    uint16_t total = 0;      // records in history
+    uint32_t connectMs = 0;
+    uint32_t readMs = 0;
+    uint32_t recordUs = 0;   // history transfer time per record
+    bool askPin = false;     // not bonded, pin is requested on secure connect
+    uint32_t pin = 654321;
+    bool reachable = true;
+    uint32_t connects = 0;
+} MockAranet;
+
+struct MockAranets {
+    std::mutex m;
+    std::map<std::string, MockAranet> sensors;
+};
+
+inline MockAranets &mockAranets() {
+    static MockAranets a;
+    return a;
+}
+
+inline void mockAranetAdd(const NimBLEAddress &addr, const MockAranet &sensor) {
+    std::lock_guard<std::mutex> lock(mockAranets().m);
+    mockAranets().sensors[addr.toString()] = sensor;
+}
+
+inline void mockAranetClear() {
+    std::lock_guard<std::mutex> lock(mockAranets().m);
+    mockAranets().sensors.clear();
+}
+
+class Aranet4 {
+    Aranet4Callbacks* callbacks;
+    std::string peer;
+    bool connected = false;
+    ar4_err_t status = AR4_OK;
+
+    bool sensor(MockAranet* out) {
+        std::lock_guard<std::mutex> lock(mockAranets().m);
+        auto it = mockAranets().sensors.find(peer);
+        if (it == mockAranets().sensors.end()) return false;
+        *out = it->second;
+        return true;
+    }
+
+public:
+    Aranet4(Aranet4Callbacks* callbacks) : callbacks(callbacks) {}
+
+    static void init(uint16_t = 247) {}
+    void setConnectTimeout(uint8_t) {}
+
+    ar4_err_t connect(NimBLEAddress addr, bool secure = true) {
+        MockAranet s;
+        peer = addr.toString();
+        if (!sensor(&s) || !s.reachable) {
+            delay(s.connectMs);
+            return status = AR4_ERR_NOT_CONNECTED;
+        }
+        delay(s.connectMs);
+        {
+            std::lock_guard<std::mutex> lock(mockAranets().m);
+            mockAranets().sensors[peer].connects++;
+        }
+        connected = true;
+        status = AR4_OK;
+        if (secure && s.askPin) return secureConnection();
+        return status;
+    }
+
+    ar4_err_t secureConnection() {
+        MockAranet s;
+        if (!connected || !sensor(&s)) return status = AR4_ERR_NOT_CONNECTED;
+        if (s.askPin && callbacks->onPassKeyRequest() != s.pin) {
+            connected = false;
+            return status = AR4_FAIL;
+        }
+        return status = AR4_OK;
+    }
+
+    void disconnect() {
+        connected = false;
+    }
+
+    bool isConnected() {
+        return connected;
+    }
+
+    ar4_err_t getStatus() {
+        return status;
+    }
+
+    AranetData getCurrentReadings() {
+        MockAranet s;
+        if (!connected || !sensor(&s)) {
+            status = AR4_ERR_NOT_CONNECTED;
+            return AranetData();
+        }
+        delay(s.readMs);
+        status = AR4_OK;
+        return s.data;
+    }
+
+    AranetType getType() {
+        MockAranet s;
+        return sensor(&s) ? s.data.type : UNKNOWN;
+    }
+
+    String getName() {
+        return "Aranet4 Mock";
+    }
+
+    int getTotalReadings() {
+        MockAranet s;
+        return connected && sensor(&s) ? s.total : 0;
+    }
+
+    uint16_t getInterval() {
+        MockAranet s;
+        return sensor(&s) ? s.data.interval : 0;
+    }
+
+    /*
+        Records start..start+count-1, 1 is oldest. Values are made
+        from record index, so gaps and duplicates can be detected.
+    */
+    int getHistory(int start, uint16_t count, AranetDataCompact* data, uint16_t params = AR4_PARAM_FLAGS) {
+        MockAranet s;
+        if (!connected || !sensor(&s)) {
+            status = AR4_ERR_NOT_CONNECTED;
+            return -1;
+        }
+        if (start < 1) start = 1;
+        if (start + count - 1 > s.total) count = start > s.total ? 0 : s.total - start + 1;
+        std::this_thread::sleep_for(std::chrono::microseconds((uint64_t) s.recordUs * count));
+
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t index = start + i;
+            memset(&data[i], 0, sizeof(AranetDataCompact));
+            if (s.data.type == ARANET_RADIATION) {
+                data[i].aranetr.rad_dose_rate = index;
+                data[i].aranetr.rad_dose_integral = index;
+            } else {
+                data[i].aranet4.co2 = index;
+                data[i].aranet4.temperature = 440;
+                data[i].aranet4.pressure = 10130;
+                data[i].aranet4.humidity = 40;
+            }
+        }
+        status = AR4_OK;
+        return count;
+    }
+};
+
+#endif
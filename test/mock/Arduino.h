@@ -0,0 +1,123 @@
+#ifndef __MOCK_ARDUINO_H
+#define __MOCK_ARDUINO_H
+
+/*
+    Minimal Arduino-ESP32 API for native tests. Only what firmware headers
+    use is provided. millis() follows the host clock and can be moved
+    forward with mockAdvanceMillis(), so timeouts can be tested.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "WString.h"
+
+using std::min;
+using std::max;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef uint8_t byte;
+
+// glibc before 2.38 has no strlcpy
+inline size_t mockStrlcpy(char* dst, const char* src, size_t size) {
+    size_t len = strlen(src);
+    if (size) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = 0;
+    }
+    return len;
+}
+#define strlcpy mockStrlcpy
+
+inline std::atomic<int64_t> &mockMillisShift() {
+    static std::atomic<int64_t> shift{0};
+    return shift;
+}
+
+inline void mockAdvanceMillis(uint32_t ms) {
+    mockMillisShift() += ms;
+}
+
+inline uint32_t millis() {
+    return (uint32_t) (esp_timer_get_time() / 1000 + mockMillisShift());
+}
+
+inline uint32_t micros() {
+    return (uint32_t) esp_timer_get_time();
+}
+
+inline void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void yield() {
+    std::this_thread::yield();
+}
+
+#define log_e(fmt, ...) fprintf(stderr, "[E] " fmt "\n", ##__VA_ARGS__)
+#define log_w(fmt, ...) fprintf(stderr, "[W] " fmt "\n", ##__VA_ARGS__)
+#define log_i(fmt, ...) do {} while (0)
+#define log_d(fmt, ...) do {} while (0)
+
+/*
+    Console, quiet unless MOCK_VERBOSE is set in environment
+*/
+class HardwareSerial {
+    bool verbose() {
+        static int v = getenv("MOCK_VERBOSE") ? 1 : 0;
+        return v;
+    }
+
+public:
+    void begin(unsigned long) {}
+
+    int printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        if (!verbose()) return 0;
+        va_list args;
+        va_start(args, fmt);
+        int n = vprintf(fmt, args);
+        va_end(args);
+        return n;
+    }
+
+    size_t print(const char* s) { return verbose() ? fputs(s, stdout), strlen(s) : 0; }
+    size_t print(const String &s) { return print(s.c_str()); }
+    size_t print(char c) { char s[2] = { c, 0 }; return print(s); }
+    size_t print(int v) { return print(String(v)); }
+    size_t print(unsigned v) { return print(String(v)); }
+    size_t print(long v) { return print(String(v)); }
+    size_t print(unsigned long v) { return print(String(v)); }
+    size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+
+    size_t println() { return print("\n"); }
+    template <typename T>
+    size_t println(T v) { return print(v) + println(); }
+};
+
+inline HardwareSerial Serial;
+
+class EspClass {
+public:
+    uint32_t getFreeHeap() { return 160 * 1024; }
+    uint32_t getMinFreeHeap() { return 120 * 1024; }
+    uint32_t getHeapSize() { return 300 * 1024; }
+    void restart() { abort(); }
+};
+
+inline EspClass ESP;
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __MOCK_ARDUINOMQTTCLIENT_H
+#define __MOCK_ARDUINOMQTTCLIENT_H
+
+/*
+    MQTT client that records published messages
+*/
+
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+typedef struct {
+    std::string topic;
+    std::string payload;
+} MockMqttMessage;
+
+class MqttClient {
+    bool isConnected = false;
+    bool inMessage = false;
+    MockMqttMessage current;
+
+public:
+    std::vector<MockMqttMessage> messages;
+    String user;
+    String password;
+    String id;
+    bool refuse = false; // connect fails
+
+    MqttClient(WiFiClient*) {}
+    MqttClient(WiFiClient &) {}
+
+    void setUsernamePassword(const String &u, const String &p) {
+        user = u;
+        password = p;
+    }
+
+    void setId(const String &i) { id = i; }
+    void setConnectionTimeout(unsigned long) {}
+    void setKeepAliveInterval(unsigned long) {}
+
+    int connect(const char*, uint16_t) {
+        isConnected = !refuse;
+        return isConnected;
+    }
+
+    int connectError() { return refuse ? -2 : 0; }
+    int connected() { return isConnected; }
+    void stop() { isConnected = false; }
+    void poll() {}
+
+    int beginMessage(const char* topic, bool = false, uint8_t = 0) {
+        current.topic = topic;
+        current.payload.clear();
+        inMessage = true;
+        return 1;
+    }
+
+    size_t print(const char* s) {
+        if (inMessage) current.payload += s;
+        return strlen(s);
+    }
+
+    size_t print(const String &s) { return print(s.c_str()); }
+    size_t print(int v) { return print(String(v)); }
+    size_t print(unsigned v) { return print(String(v)); }
+    size_t print(long v) { return print(String(v)); }
+    size_t print(unsigned long v) { return print(String(v)); }
+    size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+
+    int endMessage() {
+        if (!inMessage) return 0;
+        inMessage = false;
+        messages.push_back(current);
+        return 1;
+    }
+};
+
+#endif
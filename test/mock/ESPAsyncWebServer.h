@@ -0,0 +1,86 @@
+#ifndef __MOCK_ESPASYNCWEBSERVER_H
+#define __MOCK_ESPASYNCWEBSERVER_H
+
+/*
+    Response side of ESPAsyncWebServer. Tests call fill() like async_tcp
+    task does, with buffer size of one TCP segment.
+*/
+
+#include <functional>
+#include <map>
+#include <string>
+#include "Arduino.h"
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+
+class AsyncWebServerResponse {
+public:
+    int code = 200;
+    String contentType;
+    size_t contentLength = 0; // 0 - chunked or empty
+    String content;
+    AwsResponseFiller filler;
+    std::map<std::string, std::string> headers;
+
+    virtual ~AsyncWebServerResponse() {}
+
+    void addHeader(const String &name, const String &value) {
+        headers[name.c_str()] = value.c_str();
+    }
+
+    void setCode(int c) {
+        code = c;
+    }
+
+    size_t fill(uint8_t* buf, size_t maxLen, size_t index) {
+        return filler ? filler(buf, maxLen, index) : 0;
+    }
+};
+
+class AsyncWebServerRequest {
+public:
+    std::map<std::string, std::string> params;
+    AsyncWebServerResponse* sent = nullptr;
+
+    ~AsyncWebServerRequest() {
+        delete sent;
+    }
+
+    AsyncWebServerResponse* beginChunkedResponse(const String &type, AwsResponseFiller filler) {
+        AsyncWebServerResponse* r = new AsyncWebServerResponse();
+        r->contentType = type;
+        r->filler = filler;
+        return r;
+    }
+
+    AsyncWebServerResponse* beginResponse(const String &type, size_t len, AwsResponseFiller filler) {
+        AsyncWebServerResponse* r = beginChunkedResponse(type, filler);
+        r->contentLength = len;
+        return r;
+    }
+
+    AsyncWebServerResponse* beginResponse(int code, const String &type = String(), const String &content = String()) {
+        AsyncWebServerResponse* r = new AsyncWebServerResponse();
+        r->code = code;
+        r->contentType = type;
+        r->content = content;
+        return r;
+    }
+
+    void send(AsyncWebServerResponse* r) {
+        delete sent;
+        sent = r;
+    }
+
+    void send(int code, const String &type = String(), const String &content = String()) {
+        send(beginResponse(code, type, content));
+    }
+
+    bool hasParam(const String &name, bool = false) {
+        return params.count(name.c_str()) > 0;
+    }
+};
+
+#endif
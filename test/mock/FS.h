@@ -0,0 +1,136 @@
+#ifndef __MOCK_FS_H
+#define __MOCK_FS_H
+
+/*
+    SPIFFS on host files. Paths are mapped below a temporary directory,
+    created on first use and left for inspection after the test.
+    mockFsWriteMs() adds flash write time to every write call.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include "Arduino.h"
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+inline uint32_t &mockFsWriteMs() {
+    static uint32_t ms = 0;
+    return ms;
+}
+
+namespace fs {
+
+enum SeekMode {
+    SeekSet = SEEK_SET,
+    SeekCur = SEEK_CUR,
+    SeekEnd = SEEK_END
+};
+
+class File {
+    std::shared_ptr<FILE> f;
+    std::string path;
+
+public:
+    File() {}
+    File(FILE* f, const std::string &path) : f(f, fclose), path(path) {}
+
+    explicit operator bool() const { return f != nullptr; }
+
+    size_t read(uint8_t* buf, size_t len) { return f ? fread(buf, 1, len, f.get()) : 0; }
+    int read() { return f ? fgetc(f.get()) : -1; }
+    size_t write(const uint8_t* buf, size_t len) {
+        if (!f) return 0;
+        delay(mockFsWriteMs());
+        return fwrite(buf, 1, len, f.get());
+    }
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+    bool seek(uint32_t pos, SeekMode mode = SeekSet) { return f && fseek(f.get(), pos, mode) == 0; }
+    size_t position() const { return f ? ftell(f.get()) : 0; }
+
+    size_t size() const {
+        if (!f) return 0;
+        struct stat st;
+        fflush(f.get());
+        return fstat(fileno(f.get()), &st) == 0 ? st.st_size : 0;
+    }
+
+    int available() { return size() - position(); }
+    void flush() { if (f) fflush(f.get()); }
+    void close() { f.reset(); }
+    const char* name() const { return path.c_str(); }
+};
+
+class FS {
+    std::string root;
+
+    std::string real(const char* path) {
+        if (root.empty()) {
+            const char* env = getenv("MOCK_SPIFFS_ROOT");
+            if (env) {
+                root = env;
+            } else {
+                char tmpl[] = "/tmp/spiffs-XXXXXX";
+                root = mkdtemp(tmpl);
+            }
+        }
+        return root + (path[0] == '/' ? "" : "/") + path;
+    }
+
+    void makeParents(const std::string &path) {
+        for (size_t i = root.size() + 1; i < path.size(); i++) {
+            if (path[i] == '/') mkdir(path.substr(0, i).c_str(), 0755);
+        }
+    }
+
+public:
+    bool begin(bool formatOnFail = false, const char* = "/spiffs", uint8_t = 10, const char* = nullptr) {
+        real("/");
+        return true;
+    }
+
+    File open(const char* path, const char* mode = FILE_READ) {
+        std::string p = real(path);
+        if (mode[0] != 'r') makeParents(p);
+        // binary access, "r+" keeps contents like SPIFFS
+        std::string m = std::string(mode) + "b";
+        FILE* f = fopen(p.c_str(), m.c_str());
+        return f ? File(f, path) : File();
+    }
+
+    File open(const String &path, const char* mode = FILE_READ) {
+        return open(path.c_str(), mode);
+    }
+
+    bool exists(const char* path) {
+        return access(real(path).c_str(), F_OK) == 0;
+    }
+
+    bool exists(const String &path) {
+        return exists(path.c_str());
+    }
+
+    bool remove(const char* path) {
+        return ::remove(real(path).c_str()) == 0;
+    }
+
+    bool rename(const char* from, const char* to) {
+        return ::rename(real(from).c_str(), real(to).c_str()) == 0;
+    }
+
+    size_t totalBytes() { return 1024 * 1024; }
+    size_t usedBytes() { return 0; }
+};
+
+}
+
+using fs::File;
+using fs::FS;
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef __MOCK_HTTPCLIENT_H
+#define __MOCK_HTTPCLIENT_H
+
+/*
+    HTTP client with scripted server. Every POST is recorded in
+    mockHttp().requests and answered with mockHttp().code.
+*/
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+typedef struct {
+    std::string url;
+    std::map<std::string, std::string> headers;
+    std::string body;
+} MockHttpRequest;
+
+struct MockHttp {
+    int code = 204;
+    uint32_t latencyMs = 0; // server and network time per request
+    bool record = true;     // keep requests, off for long benchmarks
+    std::vector<MockHttpRequest> requests;
+};
+
+inline MockHttp &mockHttp() {
+    static MockHttp http;
+    return http;
+}
+
+class HTTPClient {
+    WiFiClient* client = nullptr;
+    bool reuse = true;
+    MockHttpRequest request;
+
+public:
+    void setReuse(bool r) { reuse = r; }
+    void setTimeout(uint16_t) {}
+
+    bool begin(WiFiClient &c, const String &url) {
+        client = &c;
+        request = MockHttpRequest();
+        request.url = url.c_str();
+        return true;
+    }
+
+    void addHeader(const String &name, const String &value) {
+        request.headers[name.c_str()] = value.c_str();
+    }
+
+    int POST(uint8_t* body, size_t size) {
+        if (!client) return -1;
+        client->mockConnect();
+        request.body.assign((const char*) body, size);
+        if (mockHttp().record) mockHttp().requests.push_back(request);
+        delay(mockHttp().latencyMs);
+        return mockHttp().code;
+    }
+
+    // like library, connection is closed unless reuse is set
+    void end() {
+        if (client && !reuse) client->stop();
+        client = nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef __MOCK_INFLUXDBCLIENT_H
+#define __MOCK_INFLUXDBCLIENT_H
+
+/*
+    Point of ESP8266 Influxdb 3.13, builds line protocol in String members
+    the same way, so old write path can be compared with LineWriter.
+*/
+
+#include "Arduino.h"
+
+class Point {
+    char* measurement;
+    String tags;
+    String fields;
+    String timestamp;
+
+    static char* escape(const char* s, const char* chars) {
+        size_t n = strlen(s);
+        for (const char* c = s; *c; c++) if (strchr(chars, *c)) n++;
+        char* out = new char[n + 1];
+        char* o = out;
+        for (const char* c = s; *c; c++) {
+            if (strchr(chars, *c)) *o++ = '\\';
+            *o++ = *c;
+        }
+        *o = 0;
+        return out;
+    }
+
+    void putField(const String &name, const String &value) {
+        if (fields.length() > 0) fields += ',';
+        char* s = escape(name.c_str(), ",= ");
+        fields += s;
+        delete[] s;
+        fields += '=';
+        fields += value;
+    }
+
+public:
+    Point(const String &m) {
+        measurement = escape(m.c_str(), ", ");
+    }
+
+    Point(const Point &o) : tags(o.tags), fields(o.fields), timestamp(o.timestamp) {
+        measurement = escape(o.measurement, "");
+    }
+
+    ~Point() {
+        delete[] measurement;
+    }
+
+    void addTag(const String &name, String value) {
+        if (tags.length() > 0) tags += ',';
+        char* s = escape(name.c_str(), ",= ");
+        tags += s;
+        delete[] s;
+        tags += '=';
+        s = escape(value.c_str(), ",= ");
+        tags += s;
+        delete[] s;
+    }
+
+    void addField(const String &name, int value) { putField(name, String(value) + "i"); }
+    void addField(const String &name, long value) { putField(name, String(value) + "i"); }
+    void addField(const String &name, unsigned int value) { putField(name, String(value) + "i"); }
+    void addField(const String &name, unsigned long value) { putField(name, String(value) + "i"); }
+    void addField(const String &name, float value, int decimals = 2) { putField(name, String(value, decimals)); }
+    void addField(const String &name, double value, int decimals = 2) { putField(name, String(value, decimals)); }
+    void addField(const String &name, bool value) { putField(name, value ? "true" : "false"); }
+    void addField(const String &name, const char* value) {
+        char* s = escape(value, "\"\\");
+        putField(name, String("\"") + s + "\"");
+        delete[] s;
+    }
+
+    void setTime(unsigned long long ts) {
+        timestamp = String(ts);
+    }
+
+    void clearFields() {
+        fields = "";
+        timestamp = "";
+    }
+
+    void clearTags() {
+        tags = "";
+    }
+
+    bool hasFields() const {
+        return fields.length() > 0;
+    }
+
+    String toLineProtocol(const String &includeTags = "") const {
+        String line;
+        line.reserve(strlen(measurement) + 1 + includeTags.length() + 1 + tags.length() + 1 + fields.length() + 1 + timestamp.length());
+        line += measurement;
+        if (includeTags.length() > 0) {
+            line += ",";
+            line += includeTags;
+        }
+        if (tags.length() > 0) {
+            line += ",";
+            line += tags;
+        }
+        if (fields.length() > 0) {
+            line += " ";
+            line += fields;
+        }
+        if (timestamp.length() > 0) {
+            line += " ";
+            line += timestamp;
+        }
+        return line;
+    }
+};
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef __MOCK_INFLUXDBCLOUD_H
+#define __MOCK_INFLUXDBCLOUD_H
+
+#include "InfluxDbClient.h"
+
+static const char InfluxDbCloud2CACert[] = "-----BEGIN CERTIFICATE-----\nMOCK\n-----END CERTIFICATE-----\n";
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef __MOCK_MIKROTIKBT5_H
+#define __MOCK_MIKROTIKBT5_H
+
+/*
+    MikroTik BT5 tag beacon, version 1 manufacturer data:
+    company id, version, user data, salt, accel x/y/z and temperature
+    in 8.8 fixed point, uptime, flags, battery
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define MIKROTIK_MANUFACTURER_ID 0x094F
+
+typedef struct {
+    float x;
+    float y;
+    float z;
+} MikroTikAcceleration;
+
+class MikroTikBeacon {
+    bool valid = false;
+    bool temperatureValid = false;
+
+    static int16_t i16(const uint8_t* p) {
+        return (int16_t) (p[0] | p[1] << 8);
+    }
+
+public:
+    uint8_t version = 0;
+    MikroTikAcceleration acceleration = { 0, 0, 0 };
+    float temperature = 0;
+    uint32_t uptime = 0;
+    uint8_t flags = 0;
+    uint8_t battery = 0;
+
+    void unpack(const uint8_t* data, size_t len) {
+        valid = false;
+        if (len < 20 || (data[0] | data[1] << 8) != MIKROTIK_MANUFACTURER_ID) return;
+        const uint8_t* p = data + 2;
+        version = p[0];
+        if (version != 1) return;
+        acceleration.x = i16(p + 4) / 256.0;
+        acceleration.y = i16(p + 6) / 256.0;
+        acceleration.z = i16(p + 8) / 256.0;
+        int16_t t = i16(p + 10);
+        temperatureValid = t != INT16_MIN;
+        temperature = t / 256.0;
+        uptime = p[12] | p[13] << 8 | p[14] << 16 | (uint32_t) p[15] << 24;
+        flags = p[16];
+        battery = p[17];
+        valid = true;
+    }
+
+    bool isValid() { return valid; }
+    bool hasTemperature() { return temperatureValid; }
+};
+
+#endif
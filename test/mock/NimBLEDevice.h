@@ -0,0 +1,230 @@
+#ifndef __MOCK_NIMBLEDEVICE_H
+#define __MOCK_NIMBLEDEVICE_H
+
+/*
+    NimBLE-Arduino 1.4 types used by firmware. Advertised device getters
+    search raw payload on every call, like the library, so old callback
+    code can be measured against adparser.h.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "Arduino.h"
+
+#define BLE_ADDR_PUBLIC 0
+#define BLE_ADDR_RANDOM 1
+
+#define BLE_HS_IO_DISPLAY_ONLY     0
+#define BLE_HS_IO_DISPLAY_YESNO    1
+#define BLE_HS_IO_KEYBOARD_ONLY    2
+#define BLE_HS_IO_NO_INPUT_OUTPUT  3
+#define BLE_HS_IO_KEYBOARD_DISPLAY 4
+
+class NimBLEAddress {
+    uint8_t native[6] = {0};
+    uint8_t type = BLE_ADDR_PUBLIC;
+
+public:
+    NimBLEAddress() {}
+
+    NimBLEAddress(const uint8_t address[6], uint8_t type = BLE_ADDR_PUBLIC) : type(type) {
+        memcpy(native, address, 6);
+    }
+
+    // "aa:bb:cc:dd:ee:ff", most significant byte first
+    NimBLEAddress(const std::string &s, uint8_t type = BLE_ADDR_PUBLIC) : type(type) {
+        unsigned b[6];
+        if (s.size() == 17 && sscanf(s.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x", &b[5], &b[4], &b[3], &b[2], &b[1], &b[0]) == 6) {
+            for (int i = 0; i < 6; i++) native[i] = b[i];
+        }
+    }
+
+    const uint8_t* getNative() const { return native; }
+    uint8_t getType() const { return type; }
+
+    std::string toString() const {
+        char buf[18];
+        snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+            native[5], native[4], native[3], native[2], native[1], native[0]);
+        return buf;
+    }
+
+    operator std::string() const { return toString(); }
+
+    bool equals(const NimBLEAddress &o) const { return memcmp(native, o.native, 6) == 0; }
+    bool operator==(const NimBLEAddress &o) const { return equals(o); }
+    bool operator!=(const NimBLEAddress &o) const { return !equals(o); }
+};
+
+class NimBLEUUID {
+    uint8_t value[16] = {0}; // little endian
+    uint8_t bits = 0;
+
+public:
+    NimBLEUUID() {}
+
+    NimBLEUUID(uint16_t uuid) : bits(16) {
+        value[0] = uuid & 0xFF;
+        value[1] = uuid >> 8;
+    }
+
+    NimBLEUUID(const char* s) : bits(128) {
+        int n = 15;
+        for (const char* c = s; *c && n >= 0; c++) {
+            if (*c == '-') continue;
+            unsigned b;
+            if (sscanf(c, "%2x", &b) != 1) break;
+            value[n--] = b;
+            c++;
+        }
+    }
+
+    NimBLEUUID(const uint8_t* data, uint8_t size) : bits(size * 8) {
+        memcpy(value, data, size);
+    }
+
+    uint8_t bitSize() const { return bits; }
+    const uint8_t* getNative() const { return value; }
+
+    bool equals(const NimBLEUUID &o) const {
+        return bits == o.bits && memcmp(value, o.value, bits / 8) == 0;
+    }
+    bool operator==(const NimBLEUUID &o) const { return equals(o); }
+};
+
+class NimBLEAdvertisedDevice {
+    NimBLEAddress address;
+    int rssi;
+    std::string payload;
+
+    // first AD structure of given type, like NimBLE findAdvField()
+    bool findField(uint8_t type, size_t* off, size_t* len, uint8_t index = 0) {
+        const uint8_t* p = (const uint8_t*) payload.data();
+        size_t pos = 0;
+        while (pos + 1 < payload.size()) {
+            uint8_t l = p[pos];
+            if (l == 0 || pos + 1 + l > payload.size()) break;
+            if (p[pos + 1] == type && index-- == 0) {
+                *off = pos + 2;
+                *len = l - 1;
+                return true;
+            }
+            pos += 1 + l;
+        }
+        return false;
+    }
+
+    bool hasUuid(uint8_t type, const NimBLEUUID &uuid) {
+        size_t size = uuid.bitSize() / 8;
+        for (uint8_t i = 0;; i++) {
+            size_t off, len;
+            if (!findField(type, &off, &len, i)) return false;
+            for (size_t k = 0; k + size <= len; k += size) {
+                if (NimBLEUUID((const uint8_t*) payload.data() + off + k, size) == uuid) return true;
+            }
+        }
+    }
+
+public:
+    NimBLEAdvertisedDevice(const NimBLEAddress &address, int rssi, const uint8_t* data, size_t len)
+        : address(address), rssi(rssi), payload((const char*) data, len) {}
+
+    NimBLEAddress getAddress() { return address; }
+    int getRSSI() { return rssi; }
+    uint8_t* getPayload() { return (uint8_t*) payload.data(); }
+    size_t getPayloadLength() { return payload.size(); }
+
+    bool haveName() {
+        size_t off, len;
+        return findField(0x09, &off, &len) || findField(0x08, &off, &len);
+    }
+
+    std::string getName() {
+        size_t off, len;
+        if (findField(0x09, &off, &len) || findField(0x08, &off, &len)) return payload.substr(off, len);
+        return "";
+    }
+
+    bool haveManufacturerData() {
+        size_t off, len;
+        return findField(0xFF, &off, &len);
+    }
+
+    std::string getManufacturerData() {
+        size_t off, len;
+        if (findField(0xFF, &off, &len)) return payload.substr(off, len);
+        return "";
+    }
+
+    bool isAdvertisingService(const NimBLEUUID &uuid) {
+        if (uuid.bitSize() == 16) return hasUuid(0x02, uuid) || hasUuid(0x03, uuid);
+        if (uuid.bitSize() == 128) return hasUuid(0x06, uuid) || hasUuid(0x07, uuid);
+        return false;
+    }
+};
+
+class NimBLEAdvertisedDeviceCallbacks {
+public:
+    virtual ~NimBLEAdvertisedDeviceCallbacks() {}
+    virtual void onResult(NimBLEAdvertisedDevice* advertisedDevice) = 0;
+};
+
+class NimBLEClient;
+class NimBLERemoteService;
+class NimBLERemoteCharacteristic;
+
+class NimBLEClientCallbacks {
+public:
+    virtual ~NimBLEClientCallbacks() {}
+    virtual void onConnect(NimBLEClient*) {}
+    virtual void onDisconnect(NimBLEClient*) {}
+    virtual uint32_t onPassKeyRequest() { return 123456; }
+    virtual bool onConfirmPIN(uint32_t) { return true; }
+};
+
+class NimBLEScan {
+    NimBLEAdvertisedDeviceCallbacks* callbacks = nullptr;
+    bool scanning = false;
+
+public:
+    uint16_t interval = 0;
+    uint16_t window = 0;
+
+    void setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks* cb, bool = false) { callbacks = cb; }
+    void setActiveScan(bool) {}
+    void setInterval(uint16_t v) { interval = v; }
+    void setWindow(uint16_t v) { window = v; }
+    void setMaxResults(uint8_t) {}
+    void setDuplicateFilter(bool) {}
+    bool start(uint32_t, void (*)(void*) = nullptr, bool = false) { scanning = true; return true; }
+    bool stop() { scanning = false; return true; }
+    bool isScanning() { return scanning; }
+    void clearResults() {}
+
+    // deliver advertisement like NimBLE host task
+    void mockResult(NimBLEAdvertisedDevice* adv) {
+        if (callbacks) callbacks->onResult(adv);
+    }
+};
+
+class NimBLEDevice {
+public:
+    static void init(const std::string &) {}
+    static NimBLEScan* getScan() {
+        static NimBLEScan scan;
+        return &scan;
+    }
+    static void setPower(int) {}
+    static void setMTU(uint16_t) {}
+    static void setSecurityAuth(bool, bool, bool) {}
+    static void setSecurityIOCap(uint8_t) {}
+    static bool deleteBond(const NimBLEAddress &) { return true; }
+};
+
+inline int ble_store_clear() {
+    return 0;
+}
+
+#endif
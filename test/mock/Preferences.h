@@ -0,0 +1,105 @@
+#ifndef __MOCK_PREFERENCES_H
+#define __MOCK_PREFERENCES_H
+
+#include "Arduino.h"
+#include "nvs.h"
+
+/*
+    Preferences on top of RAM NVS mock
+*/
+class Preferences {
+    nvs_handle_t handle = 0;
+    bool readOnly = false;
+
+    size_t getLength(const char* key) {
+        size_t len = 0;
+        return handle && mockNvsGet(handle, key, nullptr, &len, false) == ESP_OK ? len : 0;
+    }
+
+public:
+    bool begin(const char* name, bool readOnly = false) {
+        this->readOnly = readOnly;
+        return nvs_open(name, readOnly ? NVS_READONLY : NVS_READWRITE, &handle) == ESP_OK;
+    }
+
+    void end() {
+        if (handle && !readOnly) nvs_commit(handle);
+        handle = 0;
+    }
+
+    bool clear() {
+        return handle && !readOnly && nvs_erase_all(handle) == ESP_OK;
+    }
+
+    bool remove(const char* key) {
+        return handle && !readOnly && nvs_erase_key(handle, key) == ESP_OK;
+    }
+
+    bool isKey(const char* key) {
+        return getLength(key) > 0;
+    }
+
+    size_t putBytes(const char* key, const void* value, size_t len) {
+        if (!handle || readOnly) return 0;
+        return nvs_set_blob(handle, key, value, len) == ESP_OK ? len : 0;
+    }
+
+    size_t getBytesLength(const char* key) {
+        return getLength(key);
+    }
+
+    size_t getBytes(const char* key, void* buf, size_t maxLen) {
+        size_t len = getLength(key);
+        if (!len || len > maxLen) return 0;
+        return nvs_get_blob(handle, key, buf, &len) == ESP_OK ? len : 0;
+    }
+
+    size_t putString(const char* key, const char* value) {
+        if (!handle || readOnly) return 0;
+        return nvs_set_str(handle, key, value) == ESP_OK ? strlen(value) : 0;
+    }
+
+    size_t putString(const char* key, const String &value) {
+        return putString(key, value.c_str());
+    }
+
+    String getString(const char* key, const String &def = String()) {
+        size_t len = getLength(key);
+        if (!len) return def;
+        std::string buf(len, 0);
+        if (nvs_get_str(handle, key, &buf[0], &len) != ESP_OK) return def;
+        return String(buf.c_str());
+    }
+
+    size_t putUInt(const char* key, uint32_t value) {
+        return handle && !readOnly && nvs_set_u32(handle, key, value) == ESP_OK ? 4 : 0;
+    }
+
+    uint32_t getUInt(const char* key, uint32_t def = 0) {
+        uint32_t value = def;
+        if (handle) nvs_get_u32(handle, key, &value);
+        return value;
+    }
+
+    size_t putUShort(const char* key, uint16_t value) {
+        return handle && !readOnly && nvs_set_u16(handle, key, value) == ESP_OK ? 2 : 0;
+    }
+
+    uint16_t getUShort(const char* key, uint16_t def = 0) {
+        uint16_t value = def;
+        if (handle) nvs_get_u16(handle, key, &value);
+        return value;
+    }
+
+    size_t putBool(const char* key, bool value) {
+        return handle && !readOnly && nvs_set_u8(handle, key, value) == ESP_OK ? 1 : 0;
+    }
+
+    bool getBool(const char* key, bool def = false) {
+        uint8_t value = def;
+        if (handle) nvs_get_u8(handle, key, &value);
+        return value;
+    }
+};
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef __MOCK_SPIFFS_H
+#define __MOCK_SPIFFS_H
+
+#include "FS.h"
+
+inline fs::FS SPIFFS;
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef __MOCK_WSTRING_H
+#define __MOCK_WSTRING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+/*
+    Arduino String on top of std::string. Heap use is similar to the
+    ESP32 core, short strings stay in object, longer ones allocate.
+*/
+class String {
+    std::string s;
+
+public:
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const std::string &c) : s(c) {}
+    String(char c) : s(1, c) {}
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+    String(long long v) : s(std::to_string(v)) {}
+    String(unsigned long long v) : s(std::to_string(v)) {}
+    String(float v, unsigned decimals = 2) { setFloat(v, decimals); }
+    String(double v, unsigned decimals = 2) { setFloat(v, decimals); }
+
+    void setFloat(double v, unsigned decimals) {
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        s = buf;
+    }
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int size) { s.reserve(size); return true; }
+
+    bool concat(const String &o) { s += o.s; return true; }
+    bool concat(const char* c) { if (c) s += c; return true; }
+    bool concat(const char* c, unsigned int n) { s.append(c, n); return true; }
+    bool concat(char c) { s += c; return true; }
+    template <typename T>
+    bool concat(T v) { return concat(String(v)); }
+
+    template <typename T>
+    String &operator+=(T v) { concat(v); return *this; }
+
+    char charAt(unsigned int i) const { return i < s.size() ? s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    char &operator[](unsigned int i) { return s[i]; }
+
+    bool equals(const String &o) const { return s == o.s; }
+    bool equals(const char* c) const { return s == c; }
+    bool operator==(const String &o) const { return s == o.s; }
+    bool operator==(const char* c) const { return s == c; }
+    bool operator!=(const String &o) const { return s != o.s; }
+    bool operator!=(const char* c) const { return s != c; }
+    bool operator<(const String &o) const { return s < o.s; }
+
+    bool startsWith(const String &p) const { return s.compare(0, p.s.size(), p.s) == 0; }
+    bool endsWith(const String &p) const {
+        return s.size() >= p.s.size() && s.compare(s.size() - p.s.size(), p.s.size(), p.s) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t i = s.find(c, from);
+        return i == std::string::npos ? -1 : (int) i;
+    }
+    int indexOf(const String &p, unsigned int from = 0) const {
+        size_t i = s.find(p.s, from);
+        return i == std::string::npos ? -1 : (int) i;
+    }
+
+    String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) std::swap(from, to);
+        if (from >= s.size()) return String();
+        return String(s.substr(from, to - from));
+    }
+
+    void remove(unsigned int index) { if (index < s.size()) s.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < s.size()) s.erase(index, count); }
+
+    void toCharArray(char* buf, unsigned int size, unsigned int index = 0) const {
+        if (!size) return;
+        size_t n = index < s.size() ? s.copy(buf, size - 1, index) : 0;
+        buf[n] = 0;
+    }
+
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+    void toLowerCase() { for (char &c : s) c = tolower(c); }
+    void toUpperCase() { for (char &c : s) c = toupper(c); }
+    void trim() {
+        size_t b = s.find_first_not_of(" \t\r\n");
+        size_t e = s.find_last_not_of(" \t\r\n");
+        s = b == std::string::npos ? "" : s.substr(b, e - b + 1);
+    }
+};
+
+// result of operator+, ArduinoJson checks for this type
+class StringSumHelper: public String {
+public:
+    StringSumHelper(const String &s) : String(s) {}
+    StringSumHelper(const char* s) : String(s) {}
+};
+
+inline StringSumHelper operator+(const String &a, const String &b) {
+    StringSumHelper r(a);
+    r.concat(b);
+    return r;
+}
+
+inline StringSumHelper operator+(const String &a, const char* b) {
+    StringSumHelper r(a);
+    r.concat(b);
+    return r;
+}
+
+inline StringSumHelper operator+(const char* a, const String &b) {
+    StringSumHelper r(a);
+    r.concat(b);
+    return r;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef __MOCK_WIFI_H
+#define __MOCK_WIFI_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass {
+public:
+    wl_status_t connectionStatus = WL_CONNECTED;
+    int8_t rssi = -60;
+    uint8_t mac[6] = { 0x24, 0x0A, 0xC4, 0x12, 0x34, 0x56 };
+
+    wl_status_t status() { return connectionStatus; }
+    int8_t RSSI() { return rssi; }
+
+    uint8_t* macAddress(uint8_t* out) {
+        memcpy(out, mac, 6);
+        return out;
+    }
+};
+
+inline WiFiClass WiFi;
+
+#endif
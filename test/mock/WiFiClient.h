@@ -0,0 +1,29 @@
+#ifndef __MOCK_WIFICLIENT_H
+#define __MOCK_WIFICLIENT_H
+
+#include "Arduino.h"
+
+/*
+    Socket stand-in. Counts instances and connections, so tests can check
+    that connections are kept between requests.
+*/
+class WiFiClient {
+public:
+    static inline uint32_t created = 0;
+    static inline uint32_t connects = 0;
+    bool open = false;
+
+    WiFiClient() { created++; }
+    virtual ~WiFiClient() {}
+
+    // called by HTTPClient mock when request needs a connection
+    void mockConnect() {
+        if (!open) connects++;
+        open = true;
+    }
+
+    uint8_t connected() { return open; }
+    void stop() { open = false; }
+};
+
+#endif
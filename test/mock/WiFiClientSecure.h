@@ -0,0 +1,15 @@
+#ifndef __MOCK_WIFICLIENTSECURE_H
+#define __MOCK_WIFICLIENTSECURE_H
+
+#include "WiFiClient.h"
+
+class WiFiClientSecure: public WiFiClient {
+public:
+    const char* caCert = nullptr;
+    bool insecure = false;
+
+    void setCACert(const char* cert) { caCert = cert; }
+    void setInsecure() { insecure = true; }
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __MOCK_AIRVALENT_STUB_H
+#define __MOCK_AIRVALENT_STUB_H
+
+/*
+    Airvalent client without NimBLE GATT, for tests that create GATT pool.
+    Sensors are never reachable.
+*/
+
+#include "include/airvalent.h"
+
+Airvalent::Airvalent(NimBLEClientCallbacks*) {}
+Airvalent::~Airvalent() {}
+void Airvalent::init(uint16_t) {}
+void Airvalent::setConnectTimeout(uint8_t) {}
+airv_err_t Airvalent::connect(NimBLEAddress, bool) { return status = AIRV_ERR_NOT_CONNECTED; }
+void Airvalent::disconnect() {}
+bool Airvalent::isConnected() { return false; }
+AirvalentData Airvalent::getCurrentReadings() { return AirvalentData(); }
+uint16_t Airvalent::getInterval() { return 0; }
+uint16_t Airvalent::getBattery() { return 0; }
+airv_err_t Airvalent::getStatus() { return status; }
+
+#endif
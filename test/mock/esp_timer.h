@@ -0,0 +1,13 @@
+#ifndef __MOCK_ESP_TIMER_H
+#define __MOCK_ESP_TIMER_H
+
+#include <stdint.h>
+#include <chrono>
+
+// microseconds since first call, like esp_timer since boot
+inline int64_t esp_timer_get_time() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
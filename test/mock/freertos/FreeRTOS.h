@@ -0,0 +1,228 @@
+#ifndef __MOCK_FREERTOS_H
+#define __MOCK_FREERTOS_H
+
+/*
+    FreeRTOS on host threads. Tasks are detached std::threads, ticks are
+    milliseconds, critical sections are recursive mutexes. Handles are
+    never freed while a task may still wait on them, so tasks left
+    blocked at exit do not touch destroyed objects.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  1
+#define pdFAIL  0
+#define portMAX_DELAY      0xFFFFFFFF
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms)  (ms)
+#define configMAX_PRIORITIES 25
+#define tskNO_AFFINITY     0x7FFFFFFF
+
+// critical section
+typedef struct {
+    std::recursive_mutex m;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux)     (mux)->m.lock()
+#define portEXIT_CRITICAL(mux)      (mux)->m.unlock()
+#define portENTER_CRITICAL_ISR(mux) (mux)->m.lock()
+#define portEXIT_CRITICAL_ISR(mux)  (mux)->m.unlock()
+
+inline bool mockWait(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, TickType_t ticks, std::function<bool()> ready) {
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+// tasks
+typedef void (*TaskFunction_t)(void*);
+
+struct MockTask {
+    std::mutex m;
+    std::condition_variable cv;
+    uint32_t notified = 0;
+};
+typedef MockTask* TaskHandle_t;
+
+inline MockTask* &mockCurrentTask() {
+    static thread_local MockTask* task = nullptr;
+    return task;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+    MockTask* &t = mockCurrentTask();
+    if (!t) t = new MockTask();
+    return t;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char*, uint32_t, void* param, UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+    MockTask* task = new MockTask();
+    if (handle) *handle = task;
+    std::thread([code, param, task]() {
+        mockCurrentTask() = task;
+        code(param);
+    }).detach();
+    return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stack, void* param, UBaseType_t prio, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(code, name, stack, param, prio, handle, tskNO_AFFINITY);
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline void vTaskDelete(TaskHandle_t) {
+    // host threads can not be killed, park calling task
+    for (;;) std::this_thread::sleep_for(std::chrono::hours(1));
+}
+
+inline BaseType_t xPortGetCoreID() {
+    return 0;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(task->m);
+    task->notified++;
+    task->cv.notify_all();
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    MockTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->m);
+    mockWait(task->cv, lock, ticks, [task]() { return task->notified > 0; });
+    uint32_t value = task->notified;
+    if (value) task->notified = clear ? 0 : value - 1;
+    return value;
+}
+
+// semaphores, mutexes are binary semaphores with holder
+struct MockSemaphore {
+    std::mutex m;
+    std::condition_variable cv;
+    uint32_t count;
+    uint32_t max;
+    bool isMutex;
+    TaskHandle_t holder = nullptr;
+};
+typedef MockSemaphore* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateCounting(uint32_t max, uint32_t initial) {
+    MockSemaphore* s = new MockSemaphore();
+    s->count = initial;
+    s->max = max;
+    s->isMutex = false;
+    return s;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SemaphoreHandle_t s = xSemaphoreCreateCounting(1, 1);
+    s->isMutex = true;
+    return s;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(s->m);
+    if (!mockWait(s->cv, lock, ticks, [s]() { return s->count > 0; })) return pdFALSE;
+    s->count--;
+    if (s->isMutex) s->holder = xTaskGetCurrentTaskHandle();
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+    std::lock_guard<std::mutex> lock(s->m);
+    if (s->count >= s->max) return pdFALSE;
+    s->count++;
+    s->holder = nullptr;
+    s->cv.notify_one();
+    return pdTRUE;
+}
+
+inline TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t s) {
+    std::lock_guard<std::mutex> lock(s->m);
+    return s->holder;
+}
+
+inline UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t s) {
+    std::lock_guard<std::mutex> lock(s->m);
+    return s->count;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t) {
+    // kept, see above
+}
+
+// queues of fixed size items
+struct MockQueue {
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+};
+typedef MockQueue* QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    MockQueue* q = new MockQueue();
+    q->length = length;
+    q->itemSize = itemSize;
+    return q;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(q->m);
+    if (!mockWait(q->cv, lock, ticks, [q]() { return q->items.size() < q->length; })) return pdFALSE;
+    const uint8_t* p = (const uint8_t*) item;
+    q->items.emplace_back(p, p + q->itemSize);
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+#define xQueueSendToBack xQueueSend
+
+inline BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(q->m);
+    if (!mockWait(q->cv, lock, ticks, [q]() { return !q->items.empty(); })) return pdFALSE;
+    memcpy(item, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    std::lock_guard<std::mutex> lock(q->m);
+    return q->items.size();
+}
+
+inline BaseType_t xQueueReset(QueueHandle_t q) {
+    std::lock_guard<std::mutex> lock(q->m);
+    q->items.clear();
+    q->cv.notify_all();
+    return pdPASS;
+}
+
+inline void vQueueDelete(QueueHandle_t) {}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef __MOCK_NVS_H
+#define __MOCK_NVS_H
+
+/*
+    NVS in RAM, shared with Preferences mock. mockNvsWrites counts
+    set calls, so tests can check flash wear of batched writes.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef int esp_err_t;
+typedef uint32_t nvs_handle_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL               -1
+#define ESP_ERR_NVS_NOT_FOUND   0x1102
+#define ESP_ERR_NVS_INVALID_LENGTH 0x110c
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+typedef std::map<std::string, std::vector<uint8_t>> MockNvsNamespace;
+
+struct MockNvs {
+    std::mutex m;
+    std::vector<std::string> handles; // handle - 1 is index
+    std::map<std::string, MockNvsNamespace> spaces;
+    uint32_t writes = 0;
+    uint32_t commits = 0;
+
+    MockNvsNamespace* space(nvs_handle_t h) {
+        if (h == 0 || h > handles.size()) return nullptr;
+        return &spaces[handles[h - 1]];
+    }
+};
+
+inline MockNvs &mockNvs() {
+    static MockNvs nvs;
+    return nvs;
+}
+
+inline void mockNvsClear() {
+    MockNvs &nvs = mockNvs();
+    std::lock_guard<std::mutex> lock(nvs.m);
+    nvs.spaces.clear();
+    nvs.writes = nvs.commits = 0;
+}
+
+inline esp_err_t nvs_open(const char* ns, nvs_open_mode_t, nvs_handle_t* out) {
+    MockNvs &nvs = mockNvs();
+    std::lock_guard<std::mutex> lock(nvs.m);
+    nvs.handles.push_back(ns);
+    *out = nvs.handles.size();
+    return ESP_OK;
+}
+
+inline void nvs_close(nvs_handle_t) {}
+
+inline esp_err_t mockNvsSet(nvs_handle_t h, const char* key, const void* data, size_t len) {
+    MockNvs &nvs = mockNvs();
+    std::lock_guard<std::mutex> lock(nvs.m);
+    MockNvsNamespace* s = nvs.space(h);
+    if (!s) return ESP_FAIL;
+    const uint8_t* p = (const uint8_t*) data;
+    (*s)[key] = std::vector<uint8_t>(p, p + len);
+    nvs.writes++;
+    return ESP_OK;
+}
+
+inline esp_err_t mockNvsGet(nvs_handle_t h, const char* key, void* data, size_t* len, bool exact) {
+    MockNvs &nvs = mockNvs();
+    std::lock_guard<std::mutex> lock(nvs.m);
+    MockNvsNamespace* s = nvs.space(h);
+    if (!s) return ESP_FAIL;
+    auto it = s->find(key);
+    if (it == s->end()) return ESP_ERR_NVS_NOT_FOUND;
+    size_t n = it->second.size();
+    if (!data) {
+        *len = n;
+        return ESP_OK;
+    }
+    if (exact ? n != *len : n > *len) return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(data, it->second.data(), n);
+    *len = n;
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_set_str(nvs_handle_t h, const char* key, const char* value) {
+    return mockNvsSet(h, key, value, strlen(value) + 1);
+}
+
+inline esp_err_t nvs_get_str(nvs_handle_t h, const char* key, char* out, size_t* len) {
+    return mockNvsGet(h, key, out, len, false);
+}
+
+inline esp_err_t nvs_set_blob(nvs_handle_t h, const char* key, const void* value, size_t len) {
+    return mockNvsSet(h, key, value, len);
+}
+
+inline esp_err_t nvs_get_blob(nvs_handle_t h, const char* key, void* out, size_t* len) {
+    return mockNvsGet(h, key, out, len, false);
+}
+
+#define MOCK_NVS_INT(suffix, type) \
+    inline esp_err_t nvs_set_##suffix(nvs_handle_t h, const char* key, type value) { \
+        return mockNvsSet(h, key, &value, sizeof(value)); \
+    } \
+    inline esp_err_t nvs_get_##suffix(nvs_handle_t h, const char* key, type* out) { \
+        size_t len = sizeof(type); \
+        return mockNvsGet(h, key, out, &len, true); \
+    }
+
+MOCK_NVS_INT(u8, uint8_t)
+MOCK_NVS_INT(i8, int8_t)
+MOCK_NVS_INT(u16, uint16_t)
+MOCK_NVS_INT(i16, int16_t)
+MOCK_NVS_INT(u32, uint32_t)
+MOCK_NVS_INT(i32, int32_t)
+
+inline esp_err_t nvs_erase_key(nvs_handle_t h, const char* key) {
+    MockNvs &nvs = mockNvs();
+    std::lock_guard<std::mutex> lock(nvs.m);
+    MockNvsNamespace* s = nvs.space(h);
+    if (!s || !s->erase(key)) return ESP_ERR_NVS_NOT_FOUND;
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_erase_all(nvs_handle_t h) {
+    MockNvs &nvs = mockNvs();
+    std::lock_guard<std::mutex> lock(nvs.m);
+    MockNvsNamespace* s = nvs.space(h);
+    if (!s) return ESP_FAIL;
+    s->clear();
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_commit(nvs_handle_t) {
+    MockNvs &nvs = mockNvs();
+    std::lock_guard<std::mutex> lock(nvs.m);
+    nvs.commits++;
+    return ESP_OK;
+}
+
+#endif
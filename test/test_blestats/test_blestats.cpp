@@ -0,0 +1,67 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "config.h"
+#include "blestats.h"
+
+static uint64_t key(uint32_t n) {
+    return 0x0123456789C0ULL + n;
+}
+
+void setUp() {
+    for (uint32_t i = 0; i < CFG_BLESTATS_SLOTS + 4; i++) bleStatsRemove(key(i));
+}
+
+void tearDown() {}
+
+void test_record_take() {
+    BleDeviceStats out;
+    TEST_ASSERT_TRUE(bleStatsAdd(key(1)));
+    bleStatRecord(key(1), BLE_OP_CONNECT, 300, 0);
+    bleStatRecord(key(1), BLE_OP_CONNECT, 120, 5);
+    bleStatHistory(key(1), 100, 2000);
+
+    TEST_ASSERT_TRUE(bleStatsTake(key(1), &out));
+    TEST_ASSERT_EQUAL(2, out.ops[BLE_OP_CONNECT].count);
+    TEST_ASSERT_EQUAL(420, out.ops[BLE_OP_CONNECT].totalMs);
+    TEST_ASSERT_EQUAL(300, out.ops[BLE_OP_CONNECT].maxMs);
+    TEST_ASSERT_EQUAL(1, out.ops[BLE_OP_CONNECT].failures);
+    TEST_ASSERT_EQUAL(5, out.ops[BLE_OP_CONNECT].lastError);
+    TEST_ASSERT_EQUAL(100, out.historyRecords);
+    TEST_ASSERT_EQUAL_STRING("connect", bleOpNames[BLE_OP_CONNECT]); // field name in report
+
+    // max restarts after report, totals are kept
+    TEST_ASSERT_TRUE(bleStatsTake(key(1), &out));
+    TEST_ASSERT_EQUAL(0, out.ops[BLE_OP_CONNECT].maxMs);
+    TEST_ASSERT_EQUAL(2, out.ops[BLE_OP_CONNECT].count);
+}
+
+/*
+    Removed device frees its slot, late records do not take it again
+*/
+void test_remove() {
+    BleDeviceStats out;
+    for (uint32_t i = 0; i < CFG_BLESTATS_SLOTS; i++) TEST_ASSERT_TRUE(bleStatsAdd(key(i)));
+    TEST_ASSERT_FALSE(bleStatsAdd(key(CFG_BLESTATS_SLOTS)));
+
+    bleStatsRemove(key(3));
+    bleStatRecord(key(3), BLE_OP_HISTORY, 800, 0);
+    TEST_ASSERT_FALSE(bleStatsTake(key(3), &out));
+
+    // slot is reused by next saved device, with clean counters
+    TEST_ASSERT_TRUE(bleStatsAdd(key(CFG_BLESTATS_SLOTS)));
+    TEST_ASSERT_TRUE(bleStatsTake(key(CFG_BLESTATS_SLOTS), &out));
+    TEST_ASSERT_EQUAL(0, out.ops[BLE_OP_HISTORY].count);
+
+    // adding saved device again keeps its stats
+    bleStatRecord(key(0), BLE_OP_READ, 50, 0);
+    TEST_ASSERT_TRUE(bleStatsAdd(key(0)));
+    TEST_ASSERT_TRUE(bleStatsTake(key(0), &out));
+    TEST_ASSERT_EQUAL(1, out.ops[BLE_OP_READ].count);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_record_take);
+    RUN_TEST(test_remove);
+    return UNITY_END();
+}
@@ -0,0 +1,228 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "config.h"
+#include "influx/flashqueue.h"
+
+#define SECTORS 4
+#define PER_SECTOR ((FQ_SECTOR_SIZE - 8) / sizeof(Measurement))
+
+/*
+    Cuts writes after given number of bytes, as if power was lost
+*/
+class PowerLossStorage: public FileStorage {
+public:
+    int32_t budget = -1; // bytes that still reach flash, -1 - no limit
+
+    bool write(uint32_t offset, const void* data, size_t len) {
+        if (budget < 0) return FileStorage::write(offset, data, len);
+        size_t n = len < (size_t) budget ? len : budget;
+        budget -= n;
+        if (n > 0) FileStorage::write(offset, data, n);
+        return n == len;
+    }
+};
+
+static char path[32];
+
+// storage and queue as after boot
+struct Node {
+    PowerLossStorage storage;
+    FlashQueue queue;
+
+    Node() {
+        TEST_ASSERT_TRUE(storage.begin(path, SECTORS * FQ_SECTOR_SIZE));
+        TEST_ASSERT_TRUE(queue.begin(&storage));
+    }
+};
+
+static bool push(FlashQueue* q, uint32_t n) {
+    Measurement m;
+    memset(&m, 0, sizeof(m));
+    m.kind = MEAS_KIND_ARANET;
+    m.timestamp = 1700000000 + n;
+    m.env.co2 = n & 0xFFFF;
+    return q->push(&m);
+}
+
+// @return timestamp offset of oldest record, or -1 if empty
+static int32_t oldest(FlashQueue* q) {
+    Measurement m;
+    if (q->peek(&m, 1) == 0) return -1;
+    return m.timestamp - 1700000000;
+}
+
+void setUp() {
+    strcpy(path, "/tmp/flashqueue-XXXXXX");
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    close(fd);
+}
+
+void tearDown() {
+    unlink(path);
+}
+
+void test_push_consume_restart() {
+    Measurement batch[50];
+    {
+        Node n;
+        TEST_ASSERT_TRUE(n.queue.empty());
+        TEST_ASSERT_EQUAL((SECTORS - 1) * PER_SECTOR, n.queue.capacity());
+        for (uint32_t i = 0; i < 200; i++) TEST_ASSERT_TRUE(push(&n.queue, i));
+        TEST_ASSERT_EQUAL(200, n.queue.depth());
+
+        TEST_ASSERT_EQUAL(50, n.queue.peek(batch, 50));
+        for (uint32_t i = 0; i < 50; i++) {
+            TEST_ASSERT_TRUE(n.queue.validate(&batch[i]));
+            TEST_ASSERT_EQUAL(1700000000 + i, batch[i].timestamp);
+        }
+        n.queue.consume(50);
+        TEST_ASSERT_EQUAL(150, n.queue.depth());
+    }
+
+    // consumed position survives restart
+    Node n;
+    TEST_ASSERT_EQUAL(150, n.queue.depth());
+    TEST_ASSERT_EQUAL(50, oldest(&n.queue));
+}
+
+/*
+    Sector ring wraps many times, records come out in order
+*/
+void test_wraparound() {
+    Node n;
+    Measurement batch[40];
+    uint32_t next = 0;
+    uint32_t expect = 0;
+
+    for (uint32_t round = 0; round < 100; round++) {
+        for (uint32_t i = 0; i < 37; i++) TEST_ASSERT_TRUE(push(&n.queue, next++));
+        uint16_t count = n.queue.peek(batch, 30);
+        for (uint16_t i = 0; i < count; i++) {
+            TEST_ASSERT_TRUE(n.queue.validate(&batch[i]));
+            TEST_ASSERT_EQUAL(1700000000 + expect++, batch[i].timestamp);
+        }
+        n.queue.consume(count);
+        TEST_ASSERT_EQUAL(next - expect, n.queue.depth());
+        if (n.queue.depth() > 200) {
+            // drain, so queue does not overflow
+            while ((count = n.queue.peek(batch, 40)) > 0) {
+                for (uint16_t i = 0; i < count; i++) TEST_ASSERT_EQUAL(1700000000 + expect++, batch[i].timestamp);
+                n.queue.consume(count);
+            }
+            TEST_ASSERT_TRUE(n.queue.empty());
+        }
+    }
+    TEST_ASSERT_EQUAL(0, n.queue.dropped);
+    TEST_ASSERT_TRUE(next > 3 * SECTORS * PER_SECTOR);
+}
+
+/*
+    Full queue drops oldest sector, newest records are kept in order
+*/
+void test_overflow() {
+    uint32_t total = SECTORS * PER_SECTOR + 10;
+    uint32_t depth;
+    {
+        Node n;
+        for (uint32_t i = 0; i < total; i++) TEST_ASSERT_TRUE(push(&n.queue, i));
+        TEST_ASSERT_EQUAL(PER_SECTOR, n.queue.dropped);
+        depth = n.queue.depth();
+        TEST_ASSERT_EQUAL(total - n.queue.dropped, depth);
+        TEST_ASSERT_EQUAL(PER_SECTOR, oldest(&n.queue));
+    }
+
+    Node n;
+    TEST_ASSERT_EQUAL(depth, n.queue.depth());
+    TEST_ASSERT_EQUAL(PER_SECTOR, oldest(&n.queue));
+}
+
+/*
+    Power lost while record is written: record is torn, older records are
+    kept, torn one is rejected by validate() and queue continues after it
+*/
+void test_power_loss_record() {
+    {
+        Node n;
+        for (uint32_t i = 0; i < 10; i++) TEST_ASSERT_TRUE(push(&n.queue, i));
+        n.storage.budget = sizeof(Measurement) / 2;
+        TEST_ASSERT_FALSE(push(&n.queue, 10));
+    }
+
+    Node n;
+    Measurement batch[16];
+    TEST_ASSERT_EQUAL(11, n.queue.depth());
+    TEST_ASSERT_EQUAL(11, n.queue.peek(batch, 16));
+    for (uint32_t i = 0; i < 10; i++) TEST_ASSERT_TRUE(n.queue.validate(&batch[i]));
+    TEST_ASSERT_FALSE(n.queue.validate(&batch[10]));
+    TEST_ASSERT_EQUAL(1, n.queue.corrupt);
+    n.queue.consume(11);
+
+    TEST_ASSERT_TRUE(push(&n.queue, 11));
+    TEST_ASSERT_EQUAL(1, n.queue.peek(batch, 16));
+    TEST_ASSERT_TRUE(n.queue.validate(&batch[0]));
+    TEST_ASSERT_EQUAL(1700000011, batch[0].timestamp);
+}
+
+/*
+    Power lost while next sector header is written, mid-sector consumed
+    position is not yet recorded: records are delivered again, not lost
+*/
+void test_power_loss_sector() {
+    {
+        Node n;
+        for (uint32_t i = 0; i < PER_SECTOR; i++) TEST_ASSERT_TRUE(push(&n.queue, i));
+        Measurement batch[5];
+        n.queue.peek(batch, 5);
+        n.storage.budget = 0;
+        n.queue.consume(5); // marker write lost
+        n.storage.budget = 2;
+        TEST_ASSERT_FALSE(push(&n.queue, PER_SECTOR));
+    }
+
+    Node n;
+    TEST_ASSERT_EQUAL(PER_SECTOR, n.queue.depth());
+    TEST_ASSERT_EQUAL(0, oldest(&n.queue));
+
+    // torn sector is opened again
+    TEST_ASSERT_TRUE(push(&n.queue, PER_SECTOR));
+    TEST_ASSERT_EQUAL(PER_SECTOR + 1, n.queue.depth());
+    n.queue.consume(PER_SECTOR);
+    TEST_ASSERT_EQUAL(PER_SECTOR, oldest(&n.queue));
+}
+
+/*
+    Bit errors in stored record are caught by crc
+*/
+void test_validate() {
+    Node n;
+    TEST_ASSERT_TRUE(push(&n.queue, 1));
+    TEST_ASSERT_TRUE(push(&n.queue, 2));
+
+    // clear one bit of co2 in second record
+    uint8_t b = 0xFD;
+    TEST_ASSERT_TRUE(n.storage.write(8 + sizeof(Measurement) + offsetof(Measurement, env), &b, 1));
+
+    Measurement batch[2];
+    TEST_ASSERT_EQUAL(2, n.queue.peek(batch, 2));
+    TEST_ASSERT_TRUE(n.queue.validate(&batch[0]));
+    TEST_ASSERT_FALSE(n.queue.validate(&batch[1]));
+
+    // empty slot is not a record
+    memset(&batch[0], 0xFF, sizeof(Measurement));
+    TEST_ASSERT_FALSE(n.queue.validate(&batch[0]));
+    TEST_ASSERT_EQUAL(2, n.queue.corrupt);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_push_consume_restart);
+    RUN_TEST(test_wraparound);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_power_loss_record);
+    RUN_TEST(test_power_loss_sector);
+    RUN_TEST(test_validate);
+    return UNITY_END();
+}
@@ -0,0 +1,102 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include "config.h"
+#include "types.h"
+#include "metrics.h"
+
+static std::vector<AranetDevice*> devices;
+
+static AranetDevice* addDevice(uint8_t n, const char* name, uint8_t kind) {
+    uint8_t mac[6] = { n, 0x23, 0x45, 0x67, 0x89, 0xC0 };
+    AranetDevice* d = new AranetDevice();
+    d->addr = NimBLEAddress(mac, BLE_ADDR_RANDOM);
+    strcpy(d->name, name);
+    d->enabled = true;
+    d->updated = millis() | 1;
+    d->kind = kind;
+    d->data.type = ARANET4;
+    devices.push_back(d);
+    return d;
+}
+
+static std::string render() {
+    MetricsWriter metrics(&devices);
+    std::string out;
+    uint8_t buf[100]; // smaller than one line
+    size_t n;
+    while ((n = metrics.read(buf, sizeof(buf))) > 0) out.append((const char*) buf, n);
+    return out;
+}
+
+// value of metric for device, NAN if missing
+static double value(const std::string &out, const char* metric, const char* name) {
+    std::string prefix = std::string(metric) + "{name=\"" + name + "\"";
+    size_t pos = out.find(prefix);
+    if (pos == std::string::npos) return NAN;
+    return atof(out.c_str() + out.find("} ", pos) + 2);
+}
+
+void setUp() {
+    for (AranetDevice* d : devices) delete d;
+    devices.clear();
+}
+
+void tearDown() {}
+
+void test_aranet4() {
+    AranetDevice* d = addDevice(1, "Office", MEAS_KIND_ARANET);
+    d->data.co2 = 812;
+    d->data.temperature = 451; // 1/20 C
+    d->data.pressure = 10132;  // 1/10 hPa
+    d->data.humidity = 41;     // %
+    d->data.battery = 87;
+
+    std::string out = render();
+    TEST_ASSERT_EQUAL_FLOAT(812, value(out, "aranet_co2_ppm", "Office"));
+    TEST_ASSERT_EQUAL_FLOAT(22.55, value(out, "aranet_temperature_celsius", "Office"));
+    TEST_ASSERT_EQUAL_FLOAT(1013.2, value(out, "aranet_pressure_hpa", "Office"));
+    TEST_ASSERT_EQUAL_FLOAT(41, value(out, "aranet_humidity_percent", "Office"));
+    TEST_ASSERT_EQUAL_FLOAT(87, value(out, "aranet_battery_percent", "Office"));
+    TEST_ASSERT_TRUE(isnan(value(out, "aranet_radiation_rate", "Office")));
+}
+
+/*
+    Airvalent is stored as ARANET4 type, scaled as influxWriteAirvalent()
+*/
+void test_airvalent() {
+    AranetDevice* d = addDevice(2, "Lab", MEAS_KIND_AIRVALENT);
+    d->data.co2 = 640;
+    d->data.temperature = 225; // 1/10 C
+    d->data.pressure = 1013;   // hPa
+    d->data.humidity = 415;    // 1/10 %
+    d->data.battery = 90;
+
+    std::string out = render();
+    TEST_ASSERT_EQUAL_FLOAT(640, value(out, "aranet_co2_ppm", "Lab"));
+    TEST_ASSERT_EQUAL_FLOAT(22.5, value(out, "aranet_temperature_celsius", "Lab"));
+    TEST_ASSERT_EQUAL_FLOAT(1013, value(out, "aranet_pressure_hpa", "Lab"));
+    TEST_ASSERT_EQUAL_FLOAT(41.5, value(out, "aranet_humidity_percent", "Lab"));
+    TEST_ASSERT_EQUAL_FLOAT(90, value(out, "aranet_battery_percent", "Lab"));
+}
+
+void test_aranet2() {
+    AranetDevice* d = addDevice(3, "Bedroom", MEAS_KIND_ARANET);
+    d->data.type = ARANET2;
+    d->data.temperature = 402;
+    d->data.humidity = 553;
+
+    std::string out = render();
+    TEST_ASSERT_EQUAL_FLOAT(20.1, value(out, "aranet_temperature_celsius", "Bedroom"));
+    TEST_ASSERT_EQUAL_FLOAT(55.3, value(out, "aranet_humidity_percent", "Bedroom"));
+    TEST_ASSERT_TRUE(isnan(value(out, "aranet_co2_ppm", "Bedroom")));
+    TEST_ASSERT_TRUE(isnan(value(out, "aranet_pressure_hpa", "Bedroom")));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_aranet4);
+    RUN_TEST(test_airvalent);
+    RUN_TEST(test_aranet2);
+    return UNITY_END();
+}
@@ -0,0 +1,89 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "config.h"
+#include "mqtt/mqtt.h"
+
+WiFiClient wifi;
+MqttClient client(wifi);
+NodeConfig cfg;
+AranetDevice device;
+
+void setUp() {
+    client.messages.clear();
+    memset(&cfg, 0, sizeof(cfg));
+    strcpy(device.name, "Living Room");
+    mqttBuildTopic(&device);
+}
+
+void tearDown() {}
+
+AranetData reading() {
+    AranetData data;
+    data.type = AranetType::ARANET4;
+    data.co2 = 612;
+    data.temperature = 441; // 22.05 C
+    data.pressure = 10132;
+    data.humidity = 41;
+    data.battery = 87;
+    return data;
+}
+
+void test_topic() {
+    TEST_ASSERT_EQUAL_STRING(CFG_MQTT_TOPIC_PREFIX "living-room", device.mqttTopic);
+}
+
+void test_connect() {
+    cfg.mqttServer = str2ip("10.0.1.5");
+    cfg.mqttPort = 1883;
+    strcpy(cfg.mqttUser, "bridge");
+    TEST_ASSERT_EQUAL(1, mqttConnect(&client, &cfg));
+    TEST_ASSERT_EQUAL_STRING("bridge", client.user.c_str());
+    TEST_ASSERT_EQUAL_STRING("aranet4bridge-123456", client.id.c_str());
+
+    cfg.mqttServer = 0;
+    TEST_ASSERT_EQUAL(0, mqttConnect(&client, &cfg));
+}
+
+void test_point_json() {
+    AranetData data = reading();
+    cfg.mqttJson = true;
+    mqttSendPoint(&client, &cfg, device.mqttTopic, &data);
+
+    TEST_ASSERT_EQUAL(1, client.messages.size());
+    TEST_ASSERT_EQUAL_STRING(CFG_MQTT_TOPIC_PREFIX "living-room/state", client.messages[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"co2\":612,\"temperature\":22.05,\"pressure\":1013.20,\"humidity\":41,\"battery\":87}",
+        client.messages[0].payload.c_str());
+}
+
+void test_point_topics() {
+    AranetData data = reading();
+    mqttSendPoint(&client, &cfg, device.mqttTopic, &data);
+
+    TEST_ASSERT_EQUAL(5, client.messages.size());
+    TEST_ASSERT_EQUAL_STRING(CFG_MQTT_TOPIC_PREFIX "living-room/co2", client.messages[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("612", client.messages[0].payload.c_str());
+    TEST_ASSERT_EQUAL_STRING("22.05", client.messages[1].payload.c_str());
+    TEST_ASSERT_EQUAL_STRING(CFG_MQTT_TOPIC_PREFIX "living-room/battery", client.messages[4].topic.c_str());
+}
+
+void test_discovery() {
+    MqttMessage msg;
+    msg.kind = MQTT_MSG_CONFIG;
+    strcpy(msg.topic, device.mqttTopic);
+    cfg.mqttJson = true;
+    mqttSendMessage(&client, &cfg, &msg);
+
+    TEST_ASSERT_EQUAL(5, client.messages.size());
+    TEST_ASSERT_EQUAL_STRING(CFG_MQTT_TOPIC_PREFIX "living-room-co2/config", client.messages[0].topic.c_str());
+    TEST_ASSERT_NOT_NULL(strstr(client.messages[0].payload.c_str(), "\"value_template\":\"{{ value_json.co2 }}\""));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_topic);
+    RUN_TEST(test_connect);
+    RUN_TEST(test_point_json);
+    RUN_TEST(test_point_topics);
+    RUN_TEST(test_discovery);
+    return UNITY_END();
+}
@@ -0,0 +1,121 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <thread>
+#include "config.h"
+#include "ring.h"
+#include "scan.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_fifo_full() {
+    SpscRing<uint32_t, 8> ring;
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_NULL(ring.front());
+
+    for (uint32_t i = 0; i < 8; i++) TEST_ASSERT_TRUE(ring.push(i));
+    TEST_ASSERT_EQUAL(8, ring.size());
+    TEST_ASSERT_NULL(ring.claim());
+    TEST_ASSERT_FALSE(ring.push(8));
+
+    uint32_t v;
+    for (uint32_t i = 0; i < 8; i++) {
+        TEST_ASSERT_TRUE(ring.pop(&v));
+        TEST_ASSERT_EQUAL(i, v);
+    }
+    TEST_ASSERT_FALSE(ring.pop(&v));
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_wraparound() {
+    SpscRing<uint32_t, 4> ring;
+    uint32_t next = 0;
+    uint32_t expect = 0;
+
+    // slot index wraps many times, levels 1..3
+    for (uint32_t round = 0; round < 1000; round++) {
+        uint32_t n = 1 + round % 3;
+        for (uint32_t i = 0; i < n; i++) TEST_ASSERT_TRUE(ring.push(next++));
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t* v = ring.front();
+            TEST_ASSERT_NOT_NULL(v);
+            TEST_ASSERT_EQUAL(expect++, *v);
+            ring.pop();
+        }
+    }
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+/*
+    Producer and consumer threads, every item arrives once and in order
+*/
+void test_threads() {
+    static SpscRing<uint32_t, 16> ring;
+    const uint32_t count = 1000000;
+
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t* slot;
+            while ((slot = ring.claim()) == nullptr) std::this_thread::yield();
+            *slot = i;
+            ring.push();
+        }
+    });
+
+    uint32_t expect = 0;
+    bool ordered = true;
+    while (expect < count) {
+        uint32_t v;
+        if (!ring.pop(&v)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (v != expect) ordered = false;
+        expect++;
+    }
+    producer.join();
+
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+/*
+    Scan callbacks queue known vendors only and count drops when ring is full
+*/
+void test_scan_callbacks() {
+    static AdvRing ring;
+    MyScanCallbacks callbacks(&ring);
+    NimBLEScan* scan = NimBLEDevice::getScan();
+    scan->setAdvertisedDeviceCallbacks(&callbacks);
+
+    const uint8_t aranet[] = { 0x02, 0x01, 0x06, 0x04, 0xFF, 0x02, 0x07, 0x21 };
+    const uint8_t other[] = { 0x02, 0x01, 0x06, 0x04, 0xFF, 0x4C, 0x00, 0x02 };
+    NimBLEAddress addr(std::string("aa:bb:cc:dd:ee:01"), BLE_ADDR_RANDOM);
+
+    NimBLEAdvertisedDevice ignored(addr, -70, other, sizeof(other));
+    scan->mockResult(&ignored);
+    TEST_ASSERT_EQUAL(1, callbacks.ignored);
+    TEST_ASSERT_TRUE(ring.empty());
+
+    NimBLEAdvertisedDevice adv(addr, -60, aranet, sizeof(aranet));
+    for (uint32_t i = 0; i < CFG_ADV_RING_SIZE + 3; i++) scan->mockResult(&adv);
+    TEST_ASSERT_EQUAL(CFG_ADV_RING_SIZE, callbacks.received);
+    TEST_ASSERT_EQUAL(3, callbacks.dropped);
+
+    AdvRecord* rec = ring.front();
+    TEST_ASSERT_NOT_NULL(rec);
+    TEST_ASSERT_EQUAL(ADV_VENDOR_ARANET, rec->info.vendor);
+    TEST_ASSERT_EQUAL(-60, rec->rssi);
+    TEST_ASSERT_EQUAL(sizeof(aranet), rec->len);
+    TEST_ASSERT_TRUE(rec->address() == addr);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_full);
+    RUN_TEST(test_wraparound);
+    RUN_TEST(test_threads);
+    RUN_TEST(test_scan_callbacks);
+    return UNITY_END();
+}
@@ -0,0 +1,61 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "config.h"
+#include "scantune.h"
+
+static NodeConfig scanConfig(uint16_t interval, uint16_t window) {
+    NodeConfig cfg = {};
+    cfg.scanInterval = interval;
+    cfg.scanWindow = window;
+    return cfg;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_defaults_kept() {
+    NodeConfig cfg = scanConfig(0, 0);
+    TEST_ASSERT_FALSE(scanSettingsFix(&cfg));
+    TEST_ASSERT_EQUAL(0, cfg.scanInterval);
+    TEST_ASSERT_EQUAL(0, cfg.scanWindow);
+
+    cfg = scanConfig(160, 80);
+    TEST_ASSERT_FALSE(scanSettingsFix(&cfg));
+    TEST_ASSERT_EQUAL(160, cfg.scanInterval);
+    TEST_ASSERT_EQUAL(80, cfg.scanWindow);
+}
+
+void test_range() {
+    NodeConfig cfg = scanConfig(1, 2);
+    TEST_ASSERT_TRUE(scanSettingsFix(&cfg));
+    TEST_ASSERT_EQUAL(SCAN_PARAM_MIN, cfg.scanInterval);
+    TEST_ASSERT_EQUAL(SCAN_PARAM_MIN, cfg.scanWindow);
+
+    cfg = scanConfig(0xFFFF, 0);
+    TEST_ASSERT_TRUE(scanSettingsFix(&cfg));
+    TEST_ASSERT_EQUAL(SCAN_PARAM_MAX, cfg.scanInterval);
+    TEST_ASSERT_EQUAL(0, cfg.scanWindow);
+}
+
+/*
+    Window is limited by interval, default one when interval is 0
+*/
+void test_window_interval() {
+    NodeConfig cfg = scanConfig(100, 200);
+    TEST_ASSERT_TRUE(scanSettingsFix(&cfg));
+    TEST_ASSERT_EQUAL(100, cfg.scanWindow);
+
+    cfg = scanConfig(0, 0x4000);
+    TEST_ASSERT_TRUE(scanSettingsFix(&cfg));
+    TEST_ASSERT_EQUAL(0, cfg.scanInterval);
+    TEST_ASSERT_EQUAL(CFG_SCAN_INTERVAL, cfg.scanWindow);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_defaults_kept);
+    RUN_TEST(test_range);
+    RUN_TEST(test_window_interval);
+    return UNITY_END();
+}
@@ -0,0 +1,90 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "config.h"
+#include "settings.h"
+#include "cursor.h"
+
+void setUp() {
+    mockNvsClear();
+    settingsHandle = 0;
+    settingsGeneration = 0;
+}
+
+void tearDown() {}
+
+void test_defaults() {
+    NodeConfig cfg;
+    TEST_ASSERT_TRUE(settingsLoad(&cfg, "aranet4"));
+    TEST_ASSERT_EQUAL_STRING(CFG_DEF_LOGIN_USER, cfg.loginUser);
+    TEST_ASSERT_EQUAL(13231, cfg.wgPort);
+    TEST_ASSERT_EQUAL(CFG_DEF_MQTT_PORT, cfg.mqttPort);
+    TEST_ASSERT_EQUAL_STRING("", cfg.influxUrl);
+}
+
+void test_save_writes_changed_only() {
+    NodeConfig cfg;
+    settingsLoad(&cfg, "aranet4");
+    uint32_t writes = mockNvs().writes;
+
+    TEST_ASSERT_EQUAL(0, settingsSave(&cfg));
+    TEST_ASSERT_EQUAL(writes, mockNvs().writes);
+    TEST_ASSERT_EQUAL(0, settingsGeneration);
+
+    strcpy(cfg.sysName, "office");
+    cfg.mqttPort = 8883;
+    TEST_ASSERT_EQUAL(2, settingsSave(&cfg));
+    TEST_ASSERT_EQUAL(writes + 2, mockNvs().writes);
+    TEST_ASSERT_EQUAL(1, settingsGeneration);
+
+    NodeConfig loaded;
+    settingsLoad(&loaded, "aranet4");
+    TEST_ASSERT_EQUAL_STRING("office", loaded.sysName);
+    TEST_ASSERT_EQUAL(8883, loaded.mqttPort);
+}
+
+void test_cursor_batch() {
+    std::vector<AranetDevice*> devices;
+    for (uint8_t i = 0; i < 3; i++) {
+        uint8_t mac[6] = { i, 1, 2, 3, 4, 5 };
+        AranetDevice* d = new AranetDevice();
+        d->addr = NimBLEAddress(mac, BLE_ADDR_RANDOM);
+        devices.push_back(d);
+    }
+
+    cursorUpdate(devices[0], 1000, 5);
+    cursorUpdate(devices[2], 2000);
+    cursorUpdate(devices[2], 1500); // older, ignored
+    TEST_ASSERT_EQUAL(2, cursorSave(devices));
+    TEST_ASSERT_EQUAL(0, cursorSave(devices));
+
+    devices[0]->cursor = { 0, 0 };
+    devices[2]->cursor = { 0, 0 };
+    cursorLoad(devices);
+    TEST_ASSERT_EQUAL(1000, devices[0]->cursor.timestamp);
+    TEST_ASSERT_EQUAL(5, devices[0]->cursor.index);
+    TEST_ASSERT_EQUAL(0, devices[1]->cursor.timestamp);
+    TEST_ASSERT_EQUAL(2000, devices[2]->cursor.timestamp);
+
+    for (AranetDevice* d : devices) delete d;
+}
+
+void test_cursor_missing() {
+    AranetDevice d;
+    d.data.interval = 300;
+    TEST_ASSERT_EQUAL(0, cursorMissingRecords(&d, 10000)); // no cursor yet
+
+    d.cursor.timestamp = 10000;
+    TEST_ASSERT_EQUAL(0, cursorMissingRecords(&d, 10000));
+    TEST_ASSERT_EQUAL(0, cursorMissingRecords(&d, 10300)); // next record, sent as current reading
+    TEST_ASSERT_EQUAL(1, cursorMissingRecords(&d, 10600));
+    TEST_ASSERT_EQUAL(9, cursorMissingRecords(&d, 13000));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_defaults);
+    RUN_TEST(test_save_writes_changed_only);
+    RUN_TEST(test_cursor_batch);
+    RUN_TEST(test_cursor_missing);
+    return UNITY_END();
+}
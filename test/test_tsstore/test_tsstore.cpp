@@ -0,0 +1,91 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "types.h"
+#include "registry.h"
+#include "tsstore.h"
+
+#define T0 1700000000
+
+static AranetDevice device;
+
+AranetDevice* findSavedDevice(uint64_t key) {
+    return key == macKey(device.addr.getNative()) ? &device : nullptr;
+}
+
+static bool append(uint32_t minute) {
+    device.data.co2 = 600 + minute;
+    return tsAppend(&device, &device.data, T0 + minute * 60);
+}
+
+// stored timestamps in query order
+static std::vector<uint32_t> stored() {
+    TsQuery query(macKey(device.addr.getNative()), 0, 0xFFFFFFFF);
+    std::string out;
+    uint8_t buf[256];
+    size_t n;
+    while ((n = query.read(buf, sizeof(buf))) > 0) out.append((const char*) buf, n);
+
+    std::vector<uint32_t> ts;
+    for (size_t pos = 0; pos < out.size(); pos = out.find('\n', pos) + 1) ts.push_back(atol(out.c_str() + pos));
+    return ts;
+}
+
+void setUp() {
+    static uint8_t n = 0;
+    uint8_t mac[6] = { ++n, 0x23, 0x45, 0x67, 0x89, 0xC0 };
+    device.addr = NimBLEAddress(mac, BLE_ADDR_RANDOM);
+    device.data.type = ARANET4;
+    device.data.interval = 60;
+}
+
+void tearDown() {
+    tsClose(&device);
+}
+
+/*
+    History downloaded after live readings resume fills only the gap
+*/
+void test_backfill_after_live() {
+    for (uint32_t m = 0; m < 5; m++) TEST_ASSERT_TRUE(append(m));
+    TEST_ASSERT_TRUE(append(60)); // back in range
+
+    uint32_t kept = 0;
+    for (uint32_t m = 0; m <= 60; m++) kept += append(m);
+    TEST_ASSERT_EQUAL(55, kept);
+    TEST_ASSERT_TRUE(append(61));
+
+    std::vector<uint32_t> ts = stored();
+    TEST_ASSERT_EQUAL(62, ts.size());
+    std::sort(ts.begin(), ts.end());
+    for (uint32_t m = 0; m <= 61; m++) TEST_ASSERT_EQUAL(T0 + m * 60, ts[m]);
+
+    // same history again is not duplicated
+    for (uint32_t m = 0; m <= 60; m++) TEST_ASSERT_FALSE(append(m));
+}
+
+/*
+    Newest reading is found after reboot, when backfill block is current
+*/
+void test_backfill_reopen() {
+    TEST_ASSERT_TRUE(append(0));
+    TEST_ASSERT_TRUE(append(30));
+    for (uint32_t m = 1; m < 10; m++) TEST_ASSERT_TRUE(append(m));
+    tsClose(&device);
+
+    TEST_ASSERT_FALSE(append(20));
+    TEST_ASSERT_TRUE(append(40)); // gap since minute 30
+    TEST_ASSERT_FALSE(append(25));
+    TEST_ASSERT_TRUE(append(35));
+    TEST_ASSERT_EQUAL(13, stored().size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_backfill_after_live);
+    RUN_TEST(test_backfill_reopen);
+    return UNITY_END();
+}